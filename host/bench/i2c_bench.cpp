@@ -0,0 +1,542 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mbed.h"
+#include "i2c_sim.h"
+#include "i2c_lowlevel.h"
+#include "i2c_highlevel.h"
+#include "i2c_sensors.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Host CPU cost of the bus engines on the simulated bus, see README.md.
+// wait_ns() only advances the simulated clock, so the numbers are the
+// code paths themselves (plus the bus model), not the SCL timing.
+
+Serial pc(P0_0, P0_1);
+
+#define BENCH_ADDR 0x6d
+#define BENCH_MAX_LIMITS 16
+
+// Scratch registers of the sensor model, written and read back.
+#define BENCH_REG 0x40
+#define BENCH_BYTES 64
+
+#define BENCH_TRANSACTIONS 16
+#define BENCH_IDLE_LOOPS 10000
+#define BENCH_MEASUREMENTS 32
+
+// A timed batch runs the operations of a benchmark again until it took
+// at least this long, so timer resolution and scheduling noise matter
+// little.
+#define BENCH_BATCH_NS 5000000
+
+// The benchmark engines get a bus of their own; the sensor scheduler
+// owns P1_6/P0_2 and P1_10/P0_28.
+static SimI2CBus bench_bus(P0_3, P0_4);
+static SimPressureSensor bench_sensor(BENCH_ADDR);
+static LowLevelI2C low(P0_3, P0_4);
+static HighLevelI2C high(P0_3, P0_4, BENCH_ADDR);
+
+// Counted by the runs next to their operations; ops_done counts the
+// operations themselves.
+static uint32_t slots_done;
+static uint32_t loops_done;
+static uint32_t ops_done;
+
+// Cleared by a NACK or failed transfer, which would time other paths.
+static bool bus_ok = true;
+
+struct bench_result_t {
+    const char *name;
+    const char *per;
+    double ns;
+    double cycles;
+};
+
+// One round of operations; returns how many were done.
+typedef int (*BenchFunc)(void);
+
+struct bench_limit_t {
+    const char *name;
+    double ns;
+};
+
+static int repeat = 5;
+static double threshold_pct = 25.0;
+static double cpu_mhz = 0;
+static const char *baseline_file = NULL;
+static const char *out_file = NULL;
+static bool lockstep = true;
+static int bus_speed = I2C_SPEED_400KHZ;
+static struct bench_limit_t limits[BENCH_MAX_LIMITS];
+static int num_limits = 0;
+
+static uint64_t hostNs(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000u) + ts.tv_nsec;
+}
+
+// Time stamp counter where there is one; elsewhere cycles come from
+// --cpu-mhz.
+static uint64_t hostCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static bool hasCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return true;
+#else
+    return (cpu_mhz > 0);
+#endif
+}
+
+// Clocks a byte slot by slot, as HighLevelI2C does.
+static bool lowWrite(uint8_t val)
+{
+    bool ack;
+    
+    do {
+        ack = low.write(val);
+    } while (!low.ready());
+    return ack;
+}
+
+static uint8_t lowRead(bool send_ack)
+{
+    uint8_t val;
+    
+    do {
+        val = low.read(send_ack);
+    } while (!low.ready());
+    return val;
+}
+
+static void lowStart(void)
+{
+    do {
+        low.start();
+    } while (!low.ready());
+}
+
+static void lowStop(void)
+{
+    do {
+        low.stop();
+    } while (!low.ready());
+}
+
+static int benchLowWrite(void)
+{
+    uint32_t slots = low.slots();
+    
+    lowStart();
+    bus_ok &= lowWrite(BENCH_ADDR << 1);
+    lowWrite(BENCH_REG);
+    for (int i = 0; i < BENCH_BYTES; i++) {
+        lowWrite((uint8_t)(0x55 ^ i));
+    }
+    lowStop();
+    slots_done += low.slots() - slots;
+    return BENCH_BYTES + 2;
+}
+
+static int benchLowRead(void)
+{
+    lowStart();
+    lowWrite(BENCH_ADDR << 1);
+    lowWrite(BENCH_REG);
+    lowStart();
+    bus_ok &= lowWrite((BENCH_ADDR << 1) | 0x01);
+    for (int i = 0; i < BENCH_BYTES; i++) {
+        lowRead(i < (BENCH_BYTES - 1));
+    }
+    lowStop();
+    return BENCH_BYTES;
+}
+
+// The pressure read of an acquisition, one bit slot per loop() call as
+// the scheduler runs it by default.
+static int benchTransaction(void)
+{
+    uint8_t buf[3];
+    
+    for (int i = 0; i < BENCH_TRANSACTIONS; i++)
+    {
+        high.readBytes(0x06, buf, sizeof(buf));
+        do {
+            loops_done++;
+            high.loop(1, I2C_BUDGET_BITS);
+        } while (high.busy());
+        bus_ok &= (high.error() == I2C_ERROR_NONE);
+    }
+    return BENCH_TRANSACTIONS;
+}
+
+static int benchIdleLoop(void)
+{
+    for (int i = 0; i < BENCH_IDLE_LOOPS; i++) {
+        high.loop(1, I2C_BUDGET_BITS);
+    }
+    return BENCH_IDLE_LOOPS;
+}
+
+// A measurement is one new sample of each of the two sensors.
+static int benchMeasurement(void)
+{
+    struct sample_t samples[I2C_SAMPLE_RING_SIZE];
+    int n[2] = {0, 0};
+    
+    while ((n[0] < BENCH_MEASUREMENTS) || (n[1] < BENCH_MEASUREMENTS))
+    {
+        loops_done++;
+        I2c_SensorLoop();
+        for (int c = 0; c < 2; c++) {
+            n[c] += I2c_DrainChannel(c, samples, I2C_SAMPLE_RING_SIZE);
+        }
+    }
+    return BENCH_MEASUREMENTS;
+}
+
+// Best of repeat batches, per operation; the counters of the best batch
+// are left in slots_done, loops_done and ops_done.
+static void run(BenchFunc func, const char *name, const char *per, struct bench_result_t &r)
+{
+    uint32_t best_slots = 0;
+    uint32_t best_loops = 0;
+    uint32_t best_ops = 0;
+    
+    r.name = name;
+    r.per = per;
+    r.ns = 0;
+    r.cycles = 0;
+    func();     // warm up
+    
+    for (int i = 0; i < repeat; i++)
+    {
+        slots_done = 0;
+        loops_done = 0;
+        uint32_t ops = 0;
+        uint64_t t0 = hostNs();
+        uint64_t c0 = hostCycles();
+        uint64_t t1;
+        
+        do {
+            ops += func();
+            t1 = hostNs();
+        } while ((t1 - t0) < BENCH_BATCH_NS);
+        uint64_t c1 = hostCycles();
+        double ns = (double)(t1 - t0) / ops;
+        
+        if ((i == 0) || (ns < r.ns))
+        {
+            r.ns = ns;
+            r.cycles = (cpu_mhz > 0) ? (ns * cpu_mhz / 1000) : ((double)(c1 - c0) / ops);
+            best_slots = slots_done;
+            best_loops = loops_done;
+            best_ops = ops;
+        }
+    }
+    slots_done = best_slots;
+    loops_done = best_loops;
+    ops_done = best_ops;
+}
+
+// Another result from the best batch of r, whose ops_done operations
+// took count of it.
+static void derive(const struct bench_result_t &r, uint32_t count, const char *name,
+                   const char *per, struct bench_result_t &out)
+{
+    double ops = (double)count / ops_done;
+    
+    out.name = name;
+    out.per = per;
+    out.ns = r.ns / ops;
+    out.cycles = r.cycles / ops;
+}
+
+// The "ns" of name in a file written by this program, 0 when missing.
+static double baselineNs(const char *json, const char *name)
+{
+    char key[64];
+    
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    const char *p = strstr(json, key);
+    if (p == NULL) {
+        return 0;
+    }
+    p = strstr(p, "\"ns\":");
+    if (p == NULL) {
+        return 0;
+    }
+    return strtod(p + 5, NULL);
+}
+
+static char *readFile(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    char *buf = (char *)malloc(size + 1);
+    if ((buf != NULL) && (fread(buf, 1, size, f) != (size_t)size))
+    {
+        free(buf);
+        buf = NULL;
+    }
+    if (buf != NULL) {
+        buf[size] = '\0';
+    }
+    fclose(f);
+    return buf;
+}
+
+// The limit of a result: an absolute --limit wins, then the baseline
+// plus the threshold; 0 when there is none.
+static double limitNs(const char *baseline, const char *name)
+{
+    for (int i = 0; i < num_limits; i++)
+    {
+        if (strcmp(limits[i].name, name) == 0) {
+            return limits[i].ns;
+        }
+    }
+    if (baseline == NULL) {
+        return 0;
+    }
+    return baselineNs(baseline, name) * (1.0 + threshold_pct / 100.0);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: i2c_bench [options]\n"
+            "  --out FILE         write the JSON results to FILE (default stdout)\n"
+            "  --baseline FILE    fail on results slower than in FILE by more\n"
+            "                     than the threshold\n"
+            "  --threshold PCT    allowed slowdown against the baseline (25)\n"
+            "  --limit NAME=NS    fail when NAME takes more than NS ns\n"
+            "  --repeat N         batches per result, the best counts (5)\n"
+            "  --cpu-mhz MHZ      report cycles as ns * MHZ instead of the TSC\n"
+            "  --independent      clock the sensor buses independently\n"
+            "  --speed HZ         SCL frequency (400000)\n");
+}
+
+static bool parseArgs(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        
+        if (strcmp(arg, "--independent") == 0)
+        {
+            lockstep = false;
+            continue;
+        }
+        if (val == NULL) {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--out") == 0) {
+            out_file = val;
+        }
+        else if (strcmp(arg, "--baseline") == 0) {
+            baseline_file = val;
+        }
+        else if (strcmp(arg, "--threshold") == 0) {
+            threshold_pct = atof(val);
+        }
+        else if (strcmp(arg, "--repeat") == 0) {
+            repeat = atoi(val);
+        }
+        else if (strcmp(arg, "--cpu-mhz") == 0) {
+            cpu_mhz = atof(val);
+        }
+        else if (strcmp(arg, "--speed") == 0) {
+            bus_speed = atoi(val);
+        }
+        else if (strcmp(arg, "--limit") == 0)
+        {
+            const char *eq = strchr(val, '=');
+            
+            if ((eq == NULL) || (num_limits >= BENCH_MAX_LIMITS)) {
+                return false;
+            }
+            limits[num_limits].name = strndup(val, eq - val);
+            limits[num_limits].ns = atof(eq + 1);
+            num_limits++;
+        }
+        else {
+            return false;
+        }
+    }
+    return (repeat > 0) && (threshold_pct >= 0);
+}
+
+// I2c_SensorSetup() reports on stdout, where the JSON may go.
+static void sensorSetup(void)
+{
+    fflush(stdout);
+    int saved = dup(1);
+    int null_fd = open("/dev/null", O_WRONLY);
+    
+    if (null_fd >= 0) {
+        dup2(null_fd, 1);
+    }
+    I2c_SetLockstep(lockstep);
+    I2c_SetBusSpeed(bus_speed);
+    I2c_SensorSetup();
+    fflush(stdout);
+    if (null_fd >= 0)
+    {
+        dup2(saved, 1);
+        close(null_fd);
+    }
+    close(saved);
+}
+
+int main(int argc, char **argv)
+{
+    enum {
+        LOW_WRITE_BYTE = 0,
+        LOW_WRITE_BIT,
+        LOW_READ_BYTE,
+        TRANSACTION,
+        TRANSACTION_LOOP,
+        IDLE_LOOP,
+        MEASUREMENT,
+        MEASUREMENT_LOOP,
+        NUM_RESULTS,
+    };
+    struct bench_result_t results[NUM_RESULTS];
+    
+    if (!parseArgs(argc, argv))
+    {
+        usage();
+        return 2;
+    }
+    
+    char *baseline = NULL;
+    if (baseline_file != NULL)
+    {
+        baseline = readFile(baseline_file);
+        if (baseline == NULL)
+        {
+            fprintf(stderr, "i2c_bench: cannot read %s\n", baseline_file);
+            return 2;
+        }
+    }
+    
+    // Conversions finish at once so a measurement is the bus transfers
+    // and the scheduler, not the wait for the sensors.
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    
+    bench_bus.attach(bench_sensor);
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    sensor1.setConversionTime(0);
+    sensor2.setConversionTime(0);
+    
+    low.setSpeed(bus_speed);
+    high.bus().setSpeed(bus_speed);
+    
+    run(benchLowWrite, "lowlevel_write_byte", "byte", results[LOW_WRITE_BYTE]);
+    derive(results[LOW_WRITE_BYTE], slots_done, "lowlevel_write_bit",
+           "bit slot", results[LOW_WRITE_BIT]);
+    run(benchLowRead, "lowlevel_read_byte", "byte", results[LOW_READ_BYTE]);
+    run(benchTransaction, "highlevel_transaction", "3-byte register read", results[TRANSACTION]);
+    derive(results[TRANSACTION], loops_done, "highlevel_loop_call",
+           "loop() call in a transfer", results[TRANSACTION_LOOP]);
+    run(benchIdleLoop, "highlevel_loop_idle", "loop() call while idle", results[IDLE_LOOP]);
+    
+    sensorSetup();
+    run(benchMeasurement, "sensor_measurement", "sample of both sensors", results[MEASUREMENT]);
+    derive(results[MEASUREMENT], loops_done, "sensor_loop_call",
+           "I2c_SensorLoop() call", results[MEASUREMENT_LOOP]);
+    
+    int errors;
+    int total;
+    
+    I2c_GetMeasStats(errors, total);
+    if (!bus_ok || (errors > 0))
+    {
+        fprintf(stderr, "i2c_bench: transfers failed, results not valid\n");
+        return 2;
+    }
+    
+    FILE *out = stdout;
+    if (out_file != NULL)
+    {
+        out = fopen(out_file, "w");
+        if (out == NULL)
+        {
+            fprintf(stderr, "i2c_bench: cannot write %s\n", out_file);
+            return 2;
+        }
+    }
+    
+    int failed = 0;
+    
+    fprintf(out, "{\n");
+    fprintf(out, "  \"config\": {\"lockstep\": %s, \"speed_hz\": %d, \"repeat\": %d, \"threshold_pct\": %g},\n",
+            lockstep ? "true" : "false", bus_speed, repeat, threshold_pct);
+    fprintf(out, "  \"results\": {\n");
+    for (int i = 0; i < NUM_RESULTS; i++)
+    {
+        const struct bench_result_t &r = results[i];
+        double limit = limitNs(baseline, r.name);
+        bool slow = (limit > 0) && (r.ns > limit);
+        
+        fprintf(out, "    \"%s\": {\"per\": \"%s\", \"ns\": %.2f, ", r.name, r.per, r.ns);
+        if (hasCycles()) {
+            fprintf(out, "\"cycles\": %.1f, ", r.cycles);
+        }
+        else {
+            fprintf(out, "\"cycles\": null, ");
+        }
+        if (limit > 0) {
+            fprintf(out, "\"limit_ns\": %.2f, ", limit);
+        }
+        else {
+            fprintf(out, "\"limit_ns\": null, ");
+        }
+        fprintf(out, "\"pass\": %s}%s\n", slow ? "false" : "true", (i < NUM_RESULTS - 1) ? "," : "");
+        
+        if (slow)
+        {
+            fprintf(stderr, "i2c_bench: %s took %.2f ns, limit %.2f ns\n", r.name, r.ns, limit);
+            failed++;
+        }
+    }
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"regressions\": %d\n", failed);
+    fprintf(out, "}\n");
+    
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(baseline);
+    return (failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,731 @@
+#include <string.h>
+#include "i2c_sim.h"
+
+enum {
+    DEV_IDLE = 0,
+    DEV_ADDR,
+    DEV_RX,
+    DEV_ACK_TX,
+    DEV_TX,
+    DEV_ACK_RX,
+};
+
+static uint64_t sim_time = 0;
+static bool pin_low[SIM_NUM_PINS];
+static SimI2CBus *buses[SIM_I2C_MAX_BUSES];
+static uint32_t gpio_out[2];
+static uint32_t gpio_dir[2];
+static uint32_t gpio_writes = 0;
+static uint32_t gpio_reads = 0;
+static Ticker *tickers[SIM_MAX_TICKERS];
+static bool ticking = false;
+static SimVcd *recorder = NULL;
+
+NRF_GPIO_Type sim_gpio_p0(0);
+NRF_GPIO_Type sim_gpio_p1(1);
+
+uint64_t Sim_TimeNs(void)
+{
+    return sim_time;
+}
+
+static Ticker *nextTicker(void)
+{
+    Ticker *next = NULL;
+    
+    for (int i = 0; i < SIM_MAX_TICKERS; i++)
+    {
+        if ((tickers[i] != NULL) && ((next == NULL) || (tickers[i]->due() < next->due()))) {
+            next = tickers[i];
+        }
+    }
+    return next;
+}
+
+// Fires every Ticker deadline on the way, like interrupts arriving while
+// the main code waits. Waits inside a handler just advance the clock.
+void Sim_Advance(uint64_t ns)
+{
+    uint64_t end = sim_time + ns;
+    
+    if (ticking)
+    {
+        sim_time = end;
+        return;
+    }
+    ticking = true;
+    for (;;)
+    {
+        Ticker *next = nextTicker();
+        
+        if ((next == NULL) || (next->due() > end)) {
+            break;
+        }
+        if (next->due() > sim_time) {
+            sim_time = next->due();
+        }
+        next->fire();
+    }
+    if (end > sim_time) {
+        sim_time = end;
+    }
+    ticking = false;
+}
+
+void Sim_Sleep(void)
+{
+    Ticker *next = nextTicker();
+    
+    if ((next == NULL) || (next->due() <= sim_time)) {
+        Sim_Advance(1000);
+    }
+    else {
+        Sim_Advance(next->due() - sim_time);
+    }
+}
+
+void Sim_TickerAttach(Ticker *ticker)
+{
+    for (int i = 0; i < SIM_MAX_TICKERS; i++)
+    {
+        if (tickers[i] == ticker) {
+            return;
+        }
+    }
+    for (int i = 0; i < SIM_MAX_TICKERS; i++)
+    {
+        if (tickers[i] == NULL)
+        {
+            tickers[i] = ticker;
+            return;
+        }
+    }
+}
+
+void Sim_TickerDetach(Ticker *ticker)
+{
+    for (int i = 0; i < SIM_MAX_TICKERS; i++)
+    {
+        if (tickers[i] == ticker) {
+            tickers[i] = NULL;
+        }
+    }
+}
+
+void Sim_PinDrive(PinName pin, bool low)
+{
+    if ((pin < 0) || (pin >= SIM_NUM_PINS)) {
+        return;
+    }
+    pin_low[pin] = low;
+
+    SimI2CBus *bus = SimI2CBus::find(pin);
+    if (bus != NULL) {
+        bus->update();
+    }
+}
+
+int Sim_PinRead(PinName pin)
+{
+    if ((pin < 0) || (pin >= SIM_NUM_PINS)) {
+        return 1;
+    }
+
+    SimI2CBus *bus = SimI2CBus::find(pin);
+    if (bus == NULL) {
+        return pin_low[pin] ? 0 : 1;
+    }
+    bus->update();
+    return bus->line(pin);
+}
+
+// A pin pulls its line low when it is an output with OUT cleared.
+void Sim_GpioWrite(int port, int reg, uint32_t val)
+{
+    uint32_t low = gpio_dir[port] & ~gpio_out[port];
+
+    gpio_writes++;
+    switch (reg)
+    {
+    case SIM_GPIO_OUT:
+        gpio_out[port] = val;
+        break;
+
+    case SIM_GPIO_OUTSET:
+        gpio_out[port] |= val;
+        break;
+
+    case SIM_GPIO_OUTCLR:
+        gpio_out[port] &= ~val;
+        break;
+
+    case SIM_GPIO_DIR:
+        gpio_dir[port] = val;
+        break;
+
+    case SIM_GPIO_DIRSET:
+        gpio_dir[port] |= val;
+        break;
+
+    case SIM_GPIO_DIRCLR:
+        gpio_dir[port] &= ~val;
+        break;
+    }
+
+    uint32_t changed = low ^ (gpio_dir[port] & ~gpio_out[port]);
+
+    for (int i = 0; changed != 0; i++, changed >>= 1)
+    {
+        if (changed & 0x01) {
+            Sim_PinDrive((PinName)(port * 32 + i), !(low & (1u << i)));
+        }
+    }
+}
+
+uint32_t Sim_GpioRead(int port, int reg)
+{
+    uint32_t val = 0;
+
+    switch (reg)
+    {
+    case SIM_GPIO_OUT:
+        return gpio_out[port];
+
+    case SIM_GPIO_DIR:
+        return gpio_dir[port];
+
+    case SIM_GPIO_IN:
+        gpio_reads++;
+        for (int i = 0; (i < 32) && ((port * 32 + i) < SIM_NUM_PINS); i++)
+        {
+            if (Sim_PinRead((PinName)(port * 32 + i))) {
+                val |= (1u << i);
+            }
+        }
+        return val;
+    }
+    return 0;
+}
+
+uint32_t Sim_GpioWrites(void)
+{
+    return gpio_writes;
+}
+
+uint32_t Sim_GpioReads(void)
+{
+    return gpio_reads;
+}
+
+SimI2CDevice::SimI2CDevice(uint8_t addr)
+{
+    bus = NULL;
+    sda_low = false;
+    scl_low = false;
+    dev_addr = addr;
+    dev_state = DEV_IDLE;
+    bits = 0;
+    shift = 0;
+    reading = false;
+    master_ack = false;
+    stretch_ns = 0;
+    stretch_until = 0;
+}
+
+uint8_t SimI2CDevice::address(void)
+{
+    return dev_addr;
+}
+
+bool SimI2CDevice::sdaLow(void)
+{
+    return sda_low;
+}
+
+bool SimI2CDevice::sclLow(void)
+{
+    return scl_low;
+}
+
+void SimI2CDevice::setClockStretch(uint32_t ns)
+{
+    stretch_ns = ns;
+}
+
+void SimI2CDevice::stretch(void)
+{
+    if (stretch_ns > 0)
+    {
+        scl_low = true;
+        stretch_until = Sim_TimeNs() + stretch_ns;
+    }
+}
+
+// Lets go of a stretched SCL once its time is up.
+void SimI2CDevice::poll(void)
+{
+    if (scl_low && (Sim_TimeNs() >= stretch_until)) {
+        scl_low = false;
+    }
+}
+
+void SimI2CDevice::transmit(void)
+{
+    shift = onRead();
+    bits = 0;
+    sda_low = !(shift & 0x80);
+    dev_state = DEV_TX;
+}
+
+void SimI2CDevice::dataEdge(bool sda, bool scl)
+{
+    if (!scl) {
+        return;
+    }
+    if (!sda)
+    {
+        // START or repeated START
+        dev_state = DEV_ADDR;
+        bits = 0;
+        shift = 0;
+        sda_low = false;
+        onStart();
+    }
+    else
+    {
+        if (dev_state != DEV_IDLE) {
+            onStop();
+        }
+        dev_state = DEV_IDLE;
+        sda_low = false;
+    }
+}
+
+void SimI2CDevice::clockEdge(bool scl, bool sda)
+{
+    switch (dev_state)
+    {
+    case DEV_ADDR:
+    case DEV_RX:
+        if (scl)
+        {
+            shift = (uint8_t)((shift << 1) | (sda ? 1 : 0));
+            bits++;
+        }
+        else if (bits == 8)
+        {
+            bool ack;
+
+            if (dev_state == DEV_ADDR)
+            {
+                ack = ((shift >> 1) == dev_addr);
+                if (ack)
+                {
+                    reading = (shift & 0x01);
+                    onAddress(reading);
+                }
+            }
+            else {
+                ack = onWrite(shift);
+            }
+
+            if (ack)
+            {
+                sda_low = true;
+                dev_state = DEV_ACK_TX;
+            }
+            else {
+                dev_state = DEV_IDLE;
+            }
+        }
+        break;
+
+    case DEV_ACK_TX:
+        if (!scl)
+        {
+            stretch();
+            sda_low = false;
+            if (reading) {
+                transmit();
+            }
+            else
+            {
+                dev_state = DEV_RX;
+                bits = 0;
+                shift = 0;
+            }
+        }
+        break;
+
+    case DEV_TX:
+        if (!scl)
+        {
+            bits++;
+            if (bits == 8)
+            {
+                sda_low = false;
+                dev_state = DEV_ACK_RX;
+            }
+            else {
+                sda_low = !((shift << bits) & 0x80);
+            }
+        }
+        break;
+
+    case DEV_ACK_RX:
+        if (scl) {
+            master_ack = !sda;
+        }
+        else if (master_ack)
+        {
+            stretch();
+            transmit();
+        }
+        else {
+            dev_state = DEV_IDLE;
+        }
+        break;
+    }
+}
+
+SimI2CBus::SimI2CBus(PinName sda, PinName scl) : pin_sda(sda), pin_scl(scl)
+{
+    num_devices = 0;
+    updating = false;
+    num_starts = 0;
+    num_stops = 0;
+    last_sda = level(pin_sda, true);
+    last_scl = level(pin_scl, false);
+
+    for (int i = 0; i < SIM_I2C_MAX_BUSES; i++)
+    {
+        if (buses[i] == NULL)
+        {
+            buses[i] = this;
+            break;
+        }
+    }
+}
+
+SimI2CBus::~SimI2CBus()
+{
+    for (int i = 0; i < SIM_I2C_MAX_BUSES; i++)
+    {
+        if (buses[i] == this) {
+            buses[i] = NULL;
+        }
+    }
+    for (int i = 0; i < num_devices; i++) {
+        devices[i]->bus = NULL;
+    }
+}
+
+SimI2CBus *SimI2CBus::find(PinName pin)
+{
+    for (int i = 0; i < SIM_I2C_MAX_BUSES; i++)
+    {
+        if ((buses[i] != NULL) &&
+            ((buses[i]->pin_sda == pin) || (buses[i]->pin_scl == pin))) {
+            return buses[i];
+        }
+    }
+    return NULL;
+}
+
+SimI2CBus *SimI2CBus::get(int index)
+{
+    return ((index >= 0) && (index < SIM_I2C_MAX_BUSES)) ? buses[index] : NULL;
+}
+
+bool SimI2CBus::attach(SimI2CDevice &dev)
+{
+    if (num_devices >= SIM_I2C_MAX_DEVICES) {
+        return false;
+    }
+    devices[num_devices++] = &dev;
+    dev.bus = this;
+    return true;
+}
+
+bool SimI2CBus::level(PinName pin, bool dev_sda)
+{
+    if (pin_low[pin]) {
+        return false;
+    }
+    for (int i = 0; i < num_devices; i++)
+    {
+        if (dev_sda ? devices[i]->sda_low : devices[i]->scl_low) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int SimI2CBus::line(PinName pin)
+{
+    return (pin == pin_scl) ? scl() : sda();
+}
+
+int SimI2CBus::sda(void)
+{
+    return last_sda ? 1 : 0;
+}
+
+int SimI2CBus::scl(void)
+{
+    return last_scl ? 1 : 0;
+}
+
+uint32_t SimI2CBus::starts(void)
+{
+    return num_starts;
+}
+
+uint32_t SimI2CBus::stops(void)
+{
+    return num_stops;
+}
+
+void SimI2CBus::resetCounters(void)
+{
+    num_starts = 0;
+    num_stops = 0;
+}
+
+void SimI2CBus::update(void)
+{
+    // Devices react to edges by changing their own drivers, which may
+    // produce new edges; iterate until the lines are stable.
+    if (updating) {
+        return;
+    }
+    updating = true;
+
+    for (int i = 0; i < num_devices; i++) {
+        devices[i]->poll();
+    }
+
+    for (;;)
+    {
+        bool scl = level(pin_scl, false);
+        bool sda = level(pin_sda, true);
+
+        if (scl != last_scl)
+        {
+            last_scl = scl;
+            for (int i = 0; i < num_devices; i++) {
+                devices[i]->clockEdge(scl, last_sda);
+            }
+        }
+        else if (sda != last_sda)
+        {
+            last_sda = sda;
+            if (scl)
+            {
+                if (sda) {
+                    num_stops++;
+                }
+                else {
+                    num_starts++;
+                }
+            }
+            for (int i = 0; i < num_devices; i++) {
+                devices[i]->dataEdge(sda, scl);
+            }
+        }
+        else {
+            break;
+        }
+        if (recorder != NULL) {
+            recorder->busChanged(this);
+        }
+    }
+    updating = false;
+}
+
+SimPressureSensor::SimPressureSensor(uint8_t addr) : SimI2CDevice(addr)
+{
+    memset(regs, 0, sizeof(regs));
+    regs[0xA5] = 0x02;
+    pointer = 0;
+    pointer_pending = false;
+    converting = false;
+    ready_at = 0;
+    conversion_ns = 20000;
+    num_conversions = 0;
+    pressure = 0;
+    temperature = 0;
+}
+
+void SimPressureSensor::setPressure(int32_t raw)
+{
+    pressure = raw & 0xFFFFFF;
+}
+
+void SimPressureSensor::setTemperature(int16_t raw)
+{
+    temperature = raw;
+}
+
+void SimPressureSensor::setConversionTime(uint32_t ns)
+{
+    conversion_ns = ns;
+}
+
+uint8_t SimPressureSensor::reg(uint8_t addr)
+{
+    update();
+    return regs[addr];
+}
+
+void SimPressureSensor::setReg(uint8_t addr, uint8_t val)
+{
+    regs[addr] = val;
+}
+
+uint32_t SimPressureSensor::conversions(void)
+{
+    return num_conversions;
+}
+
+void SimPressureSensor::update(void)
+{
+    if (converting && (Sim_TimeNs() >= ready_at))
+    {
+        converting = false;
+        regs[0x06] = (uint8_t)(pressure >> 16);
+        regs[0x07] = (uint8_t)(pressure >> 8);
+        regs[0x08] = (uint8_t)pressure;
+        regs[0x09] = (uint8_t)(temperature >> 8);
+        regs[0x0A] = (uint8_t)temperature;
+        regs[0x30] &= ~0x08;
+        regs[0x02] |= 0x01;
+        num_conversions++;
+    }
+}
+
+void SimPressureSensor::onAddress(bool read)
+{
+    pointer_pending = !read;
+}
+
+bool SimPressureSensor::onWrite(uint8_t val)
+{
+    if (pointer_pending)
+    {
+        pointer = val;
+        pointer_pending = false;
+        return true;
+    }
+
+    update();
+    regs[pointer] = val;
+
+    if ((pointer == 0x30) && (val & 0x08))
+    {
+        converting = true;
+        ready_at = Sim_TimeNs() + conversion_ns;
+        regs[0x02] &= ~0x01;
+    }
+    pointer++;
+    return true;
+}
+
+uint8_t SimPressureSensor::onRead(void)
+{
+    update();
+    return regs[pointer++];
+}
+
+SimVcd::SimVcd(FILE *out) : vcd(out)
+{
+    start_ns = 0;
+    for (int i = 0; i < SIM_I2C_MAX_BUSES; i++) {
+        bus_var[i] = -1;
+    }
+    for (int i = 0; i < I2C_VCD_MAX_VARS; i++) {
+        state_var[i] = -1;
+    }
+}
+
+SimVcd::~SimVcd()
+{
+    stop();
+}
+
+// Declares one "busN" scope per bus and, when tracing, one scope per
+// engine with states, then dumps the current line levels.
+bool SimVcd::start(void)
+{
+    if ((recorder != NULL) || (vcd.vars() != 0)) {
+        return false;
+    }
+    for (int i = 0; i < SIM_I2C_MAX_BUSES; i++)
+    {
+        if (SimI2CBus::get(i) == NULL) {
+            continue;
+        }
+        snprintf(bus_scope[i], sizeof(bus_scope[i]), "bus%d", i);
+        bus_var[i] = vcd.wire(bus_scope[i], "sda");
+        vcd.wire(bus_scope[i], "scl");
+    }
+#if I2C_TRACE
+    for (int src = 0; (src < I2c_TraceNumSources()) && (src < I2C_VCD_MAX_VARS); src++)
+    {
+        if (I2c_TraceStateName(src, 0) == NULL) {
+            continue;
+        }
+        snprintf(state_scope[src], sizeof(state_scope[src]), "%s%d", I2c_TraceSourceKind(src), src);
+        state_var[src] = vcd.text(state_scope[src], "state");
+    }
+    I2c_TraceListen(traceEvent);
+#endif
+    vcd.header();
+    start_ns = Sim_TimeNs();
+    recorder = this;
+    
+    for (int i = 0; i < SIM_I2C_MAX_BUSES; i++)
+    {
+        if (bus_var[i] >= 0) {
+            busChanged(SimI2CBus::get(i));
+        }
+    }
+    return true;
+}
+
+void SimVcd::stop(void)
+{
+    if (recorder != this) {
+        return;
+    }
+#if I2C_TRACE
+    I2c_TraceListen(NULL);
+#endif
+    recorder = NULL;
+}
+
+void SimVcd::busChanged(SimI2CBus *bus)
+{
+    for (int i = 0; i < SIM_I2C_MAX_BUSES; i++)
+    {
+        if ((SimI2CBus::get(i) == bus) && (bus_var[i] >= 0))
+        {
+            vcd.change(Sim_TimeNs() - start_ns, bus_var[i], bus->sda());
+            vcd.change(Sim_TimeNs() - start_ns, bus_var[i] + 1, bus->scl());
+        }
+    }
+}
+
+void SimVcd::traceEvent(const struct trace_event_t &ev)
+{
+    SimVcd *rec = recorder;
+    
+    if ((rec == NULL) || (ev.type != I2C_TRACE_STATE) || (ev.source >= I2C_VCD_MAX_VARS) ||
+        (rec->state_var[ev.source] < 0)) {
+        return;
+    }
+#if I2C_TRACE
+    rec->vcd.change(Sim_TimeNs() - rec->start_ns, rec->state_var[ev.source],
+                    I2c_TraceStateName(ev.source, ev.arg));
+#endif
+}
@@ -0,0 +1,150 @@
+#ifndef _I2C_SIM_H_
+#define _I2C_SIM_H_
+
+#include "mbed.h"
+#include "i2c_trace.h"
+#include "i2c_vcd.h"
+
+#define SIM_I2C_MAX_BUSES 8
+#define SIM_I2C_MAX_DEVICES 4
+#define SIM_MAX_TICKERS 4
+
+class SimI2CBus;
+
+// Slave side of the open-drain bus. Decodes START/STOP, address and data
+// bits from the line edges and calls the on*() hooks per byte.
+class SimI2CDevice
+{
+public:
+    SimI2CDevice(uint8_t addr);
+    virtual ~SimI2CDevice() {}
+    uint8_t address(void);
+    bool sdaLow(void);
+    bool sclLow(void);
+    // Hold SCL low for this long after every ACK bit (0 disables).
+    void setClockStretch(uint32_t ns);
+
+protected:
+    virtual void onStart(void) {}
+    virtual void onStop(void) {}
+    virtual void onAddress(bool read) { (void)read; }
+    virtual bool onWrite(uint8_t val) = 0;
+    virtual uint8_t onRead(void) = 0;
+
+    SimI2CBus *bus;
+    bool sda_low;
+    bool scl_low;
+
+private:
+    friend class SimI2CBus;
+    void poll(void);
+    void stretch(void);
+    void clockEdge(bool scl, bool sda);
+    void dataEdge(bool sda, bool scl);
+    void transmit(void);
+
+    uint8_t dev_addr;
+    int dev_state;
+    int bits;
+    uint8_t shift;
+    bool reading;
+    bool master_ack;
+    uint32_t stretch_ns;
+    uint64_t stretch_until;
+};
+
+// Wired-AND SDA/SCL pair. Every pin driver (master pins and attached
+// devices) pulls a line low or releases it; the line is high only when
+// nobody pulls it down.
+class SimI2CBus
+{
+public:
+    SimI2CBus(PinName sda, PinName scl);
+    ~SimI2CBus();
+    bool attach(SimI2CDevice &dev);
+    int sda(void);
+    int scl(void);
+    int line(PinName pin);
+    uint32_t starts(void);
+    uint32_t stops(void);
+    void resetCounters(void);
+    void update(void);
+
+    static SimI2CBus *find(PinName pin);
+    static SimI2CBus *get(int index);
+
+private:
+    bool level(PinName pin, bool dev_sda);
+
+    PinName pin_sda;
+    PinName pin_scl;
+    SimI2CDevice *devices[SIM_I2C_MAX_DEVICES];
+    int num_devices;
+    bool last_sda;
+    bool last_scl;
+    bool updating;
+    uint32_t num_starts;
+    uint32_t num_stops;
+};
+
+// Register-level model of the 0x6d pressure sensor family:
+// 0x02 status (bit 0 data ready), 0x06..0x08 24-bit pressure,
+// 0x09..0x0A 16-bit temperature, 0x30 command/status with the
+// conversion-busy bit 0x08 and 0xA5 configuration. The register pointer
+// auto-increments on both reads and writes.
+class SimPressureSensor : public SimI2CDevice
+{
+public:
+    SimPressureSensor(uint8_t addr = 0x6d);
+    void setPressure(int32_t raw);
+    void setTemperature(int16_t raw);
+    void setConversionTime(uint32_t ns);
+    uint8_t reg(uint8_t addr);
+    void setReg(uint8_t addr, uint8_t val);
+    uint32_t conversions(void);
+
+protected:
+    virtual void onAddress(bool read);
+    virtual bool onWrite(uint8_t val);
+    virtual uint8_t onRead(void);
+
+private:
+    void update(void);
+
+    uint8_t regs[256];
+    uint8_t pointer;
+    bool pointer_pending;
+    bool converting;
+    uint64_t ready_at;
+    uint32_t conversion_ns;
+    uint32_t num_conversions;
+    int32_t pressure;
+    int16_t temperature;
+};
+
+// Records the SDA/SCL lines of every SimI2CBus (as the wired-AND of all
+// drivers, so clock stretching shows) to a VCD file in simulated ns, from
+// start() on. Built with I2C_TRACE=1 it also records the state names of
+// the bus engines (HighLevelI2C, MultiBusI2C) next to them. Buses and
+// engines must exist before start(); one recorder at a time.
+class SimVcd
+{
+public:
+    SimVcd(FILE *out);
+    ~SimVcd();
+    bool start(void);
+    void stop(void);
+    void busChanged(SimI2CBus *bus);
+
+private:
+    static void traceEvent(const struct trace_event_t &ev);
+    
+    VcdWriter vcd;
+    uint64_t start_ns;
+    int bus_var[SIM_I2C_MAX_BUSES];
+    char bus_scope[SIM_I2C_MAX_BUSES][8];
+    int state_var[I2C_VCD_MAX_VARS];
+    char state_scope[I2C_VCD_MAX_VARS][24];
+};
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef _HOST_MBED_H_
+#define _HOST_MBED_H_
+
+// Host stand-in for the subset of mbed used by the I2C drivers.
+// Pins are routed to the bus simulator in i2c_sim.cpp and all waits
+// advance a simulated clock instead of burning CPU time.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+typedef enum {
+    P0_0 = 0, P0_1, P0_2, P0_3, P0_4, P0_5, P0_6, P0_7,
+    P0_8, P0_9, P0_10, P0_11, P0_12, P0_13, P0_14, P0_15,
+    P0_16, P0_17, P0_18, P0_19, P0_20, P0_21, P0_22, P0_23,
+    P0_24, P0_25, P0_26, P0_27, P0_28, P0_29, P0_30, P0_31,
+    P1_0, P1_1, P1_2, P1_3, P1_4, P1_5, P1_6, P1_7,
+    P1_8, P1_9, P1_10, P1_11, P1_12, P1_13, P1_14, P1_15,
+    NC = -1,
+} PinName;
+
+#define SIM_NUM_PINS 48
+
+typedef enum {
+    PullNone = 0,
+    PullDown,
+    PullUp,
+} PinMode;
+
+extern void Sim_PinDrive(PinName pin, bool low);
+extern int Sim_PinRead(PinName pin);
+extern uint64_t Sim_TimeNs(void);
+extern void Sim_Advance(uint64_t ns);
+extern void Sim_Sleep(void);
+
+static inline void wait_ns(unsigned int ns)
+{
+    Sim_Advance(ns);
+}
+
+static inline void wait_us(int us)
+{
+    Sim_Advance((uint64_t)us * 1000);
+}
+
+// Reading the ticker costs a little simulated time, so code that spins
+// on it (waiting for a deadline) still makes the clock move.
+#define SIM_TICKER_READ_NS 100
+
+static inline uint32_t us_ticker_read(void)
+{
+    Sim_Advance(SIM_TICKER_READ_NS);
+    return (uint32_t)(Sim_TimeNs() / 1000);
+}
+
+// Sleeps until the next Ticker interrupt is due.
+static inline void sleep(void)
+{
+    Sim_Sleep();
+}
+
+// Simulated nRF52 GPIO port. Writes to the SET/CLR registers update the
+// pins of the bus simulator, reads of IN sample the simulated lines.
+enum {
+    SIM_GPIO_OUT = 0,
+    SIM_GPIO_OUTSET,
+    SIM_GPIO_OUTCLR,
+    SIM_GPIO_IN,
+    SIM_GPIO_DIR,
+    SIM_GPIO_DIRSET,
+    SIM_GPIO_DIRCLR,
+};
+
+extern void Sim_GpioWrite(int port, int reg, uint32_t val);
+extern uint32_t Sim_GpioRead(int port, int reg);
+
+// Register writes and IN reads of the simulated ports so far.
+extern uint32_t Sim_GpioWrites(void);
+extern uint32_t Sim_GpioReads(void);
+
+class SimGpioReg
+{
+public:
+    constexpr SimGpioReg(int port, int reg) : _port(port), _reg(reg) {}
+    SimGpioReg &operator=(uint32_t val)
+    {
+        Sim_GpioWrite(_port, _reg, val);
+        return *this;
+    }
+    operator uint32_t() const
+    {
+        return Sim_GpioRead(_port, _reg);
+    }
+
+private:
+    int _port;
+    int _reg;
+};
+
+struct NRF_GPIO_Type
+{
+    // constexpr so the ports are ready before any static pin object
+    constexpr NRF_GPIO_Type(int port) :
+        OUT(port, SIM_GPIO_OUT), OUTSET(port, SIM_GPIO_OUTSET),
+        OUTCLR(port, SIM_GPIO_OUTCLR), IN(port, SIM_GPIO_IN),
+        DIR(port, SIM_GPIO_DIR), DIRSET(port, SIM_GPIO_DIRSET),
+        DIRCLR(port, SIM_GPIO_DIRCLR), PIN_CNF() {}
+    SimGpioReg OUT;
+    SimGpioReg OUTSET;
+    SimGpioReg OUTCLR;
+    SimGpioReg IN;
+    SimGpioReg DIR;
+    SimGpioReg DIRSET;
+    SimGpioReg DIRCLR;
+    uint32_t PIN_CNF[32];
+};
+
+extern NRF_GPIO_Type sim_gpio_p0;
+extern NRF_GPIO_Type sim_gpio_p1;
+
+#define NRF_P0 (&sim_gpio_p0)
+#define NRF_P1 (&sim_gpio_p1)
+
+#define GPIO_PIN_CNF_DIR_Pos 0
+#define GPIO_PIN_CNF_DIR_Input 0
+#define GPIO_PIN_CNF_INPUT_Pos 1
+#define GPIO_PIN_CNF_INPUT_Connect 0
+#define GPIO_PIN_CNF_PULL_Pos 2
+#define GPIO_PIN_CNF_PULL_Disabled 0
+#define GPIO_PIN_CNF_DRIVE_Pos 8
+#define GPIO_PIN_CNF_DRIVE_S0S1 0
+#define GPIO_PIN_CNF_SENSE_Pos 16
+#define GPIO_PIN_CNF_SENSE_Disabled 0
+
+class DigitalInOut
+{
+public:
+    DigitalInOut(PinName pin) : _pin(pin)
+    {
+        input();
+    }
+    void input(void)
+    {
+        port()->DIRCLR = mask();
+    }
+    void output(void)
+    {
+        port()->DIRSET = mask();
+    }
+    void mode(PinMode pull)
+    {
+        (void)pull;
+    }
+    void write(int value)
+    {
+        if (value) {
+            port()->OUTSET = mask();
+        }
+        else {
+            port()->OUTCLR = mask();
+        }
+    }
+    int read(void)
+    {
+        return Sim_PinRead(_pin);
+    }
+    DigitalInOut &operator=(int value)
+    {
+        write(value);
+        return *this;
+    }
+    operator int()
+    {
+        return read();
+    }
+
+private:
+    NRF_GPIO_Type *port(void)
+    {
+        return (_pin < 32) ? NRF_P0 : NRF_P1;
+    }
+    uint32_t mask(void)
+    {
+        return 1u << (_pin & 31);
+    }
+
+    PinName _pin;
+};
+
+class Timer
+{
+public:
+    Timer() : _start(0), _elapsed(0), _running(false) {}
+    void start(void)
+    {
+        if (!_running)
+        {
+            _start = Sim_TimeNs();
+            _running = true;
+        }
+    }
+    void stop(void)
+    {
+        if (_running)
+        {
+            _elapsed += Sim_TimeNs() - _start;
+            _running = false;
+        }
+    }
+    void reset(void)
+    {
+        _start = Sim_TimeNs();
+        _elapsed = 0;
+    }
+    int read_us(void)
+    {
+        return (int)(elapsed_ns() / 1000);
+    }
+    float read(void)
+    {
+        return elapsed_ns() / 1e9f;
+    }
+
+private:
+    uint64_t elapsed_ns(void)
+    {
+        return _elapsed + (_running ? (Sim_TimeNs() - _start) : 0);
+    }
+
+    uint64_t _start;
+    uint64_t _elapsed;
+    bool _running;
+};
+
+// Stand-in for mbed::Callback<void()>: a plain function or an object
+// and one of its void(void) methods.
+class SimCallback
+{
+public:
+    SimCallback(void) : _obj(NULL), _func(NULL), _thunk(NULL) {}
+    SimCallback(void (*func)(void)) : _obj(NULL), _func(func), _thunk(callFunc) {}
+    template <typename T>
+    SimCallback(T *obj, void (T::*method)(void)) : _obj(obj), _func(NULL), _thunk(callMethod<T>)
+    {
+        static_assert(sizeof(method) <= sizeof(_method), "member pointer too large");
+        memcpy(_method, &method, sizeof(method));
+    }
+    void call(void)
+    {
+        if (_thunk != NULL) {
+            _thunk(this);
+        }
+    }
+    void operator()(void)
+    {
+        call();
+    }
+
+private:
+    static void callFunc(SimCallback *cb)
+    {
+        cb->_func();
+    }
+    template <typename T>
+    static void callMethod(SimCallback *cb)
+    {
+        void (T::*method)(void);
+        memcpy(&method, cb->_method, sizeof(method));
+        (static_cast<T *>(cb->_obj)->*method)();
+    }
+
+    void *_obj;
+    void (*_func)(void);
+    char _method[2 * sizeof(void *)];
+    void (*_thunk)(SimCallback *);
+};
+
+template <typename T>
+SimCallback callback(T *obj, void (T::*method)(void))
+{
+    return SimCallback(obj, method);
+}
+
+class Ticker;
+
+extern void Sim_TickerAttach(Ticker *ticker);
+extern void Sim_TickerDetach(Ticker *ticker);
+
+// Periodic interrupt on simulated time: the handler runs from
+// Sim_Advance() whenever the clock passes the next deadline.
+class Ticker
+{
+public:
+    Ticker() : _period_ns(0), _next_ns(0) {}
+    ~Ticker()
+    {
+        detach();
+    }
+    void attach_us(SimCallback func, uint32_t us)
+    {
+        _func = func;
+        _period_ns = (us > 0) ? ((uint64_t)us * 1000) : 1000;
+        _next_ns = Sim_TimeNs() + _period_ns;
+        Sim_TickerAttach(this);
+    }
+    void detach(void)
+    {
+        Sim_TickerDetach(this);
+    }
+    uint64_t due(void)
+    {
+        return _next_ns;
+    }
+    void fire(void)
+    {
+        _next_ns += _period_ns;
+        _func.call();
+    }
+
+private:
+    SimCallback _func;
+    uint64_t _period_ns;
+    uint64_t _next_ns;
+};
+
+class Serial
+{
+public:
+    Serial(PinName tx, PinName rx, int baud = 9600)
+    {
+        (void)tx;
+        (void)rx;
+        (void)baud;
+    }
+    int printf(const char *format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        int ret = vprintf(format, args);
+        va_end(args);
+        return ret;
+    }
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "i2c_test.h"
+#include "i2c_sensors.h"
+
+// Host test binary: without arguments every test runs, each in a child
+// process; with arguments only the tests named. --list prints the names.
+
+static I2cTestCase *tests = NULL;
+static I2cTestCase *last = NULL;
+static int failures = 0;
+
+I2cTestRegistrar::I2cTestRegistrar(I2cTestCase &tc, const char *name, I2cTestFunc func)
+{
+    tc.name = name;
+    tc.func = func;
+    tc.next = NULL;
+    if (last != NULL) {
+        last->next = &tc;
+    }
+    else {
+        tests = &tc;
+    }
+    last = &tc;
+}
+
+void I2c_TestFail(const char *file, int line, const char *expr)
+{
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+    failures++;
+}
+
+void I2c_TestRun(int ms)
+{
+    uint64_t end = Sim_TimeNs() + ((uint64_t)ms * 1000000);
+
+    while (Sim_TimeNs() < end) {
+        I2c_SensorLoop();
+    }
+}
+
+static bool runTest(const I2cTestCase &tc)
+{
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        tc.func();
+        fflush(stdout);
+        _exit((failures == 0) ? 0 : 1);
+    }
+
+    int status = 0;
+    bool ok = (pid > 0) && (waitpid(pid, &status, 0) == pid) &&
+              WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+
+    printf("%s %s\n", ok ? "PASS" : "FAIL", tc.name);
+    return ok;
+}
+
+static bool selected(const char *name, int argc, char **argv)
+{
+    if (argc < 2) {
+        return true;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    int run = 0;
+    int failed = 0;
+
+    if ((argc == 2) && (strcmp(argv[1], "--list") == 0))
+    {
+        for (I2cTestCase *tc = tests; tc != NULL; tc = tc->next) {
+            printf("%s\n", tc->name);
+        }
+        return 0;
+    }
+
+    for (I2cTestCase *tc = tests; tc != NULL; tc = tc->next)
+    {
+        if (!selected(tc->name, argc, argv)) {
+            continue;
+        }
+        run++;
+        if (!runTest(*tc)) {
+            failed++;
+        }
+    }
+    printf("%d tests, %d failed\n", run, failed);
+    return ((run == 0) || (failed != 0)) ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+#ifndef _I2C_TEST_H_
+#define _I2C_TEST_H_
+
+#include <stdio.h>
+#include <math.h>
+#include "i2c_sim.h"
+
+// Minimal test registry of the host test binary. Every I2C_TEST runs in
+// a process of its own (see i2c_test.cpp), as the sensor scheduler keeps
+// its registrations in module statics. Checks report and go on; a test
+// fails when any of its checks did.
+
+typedef void (*I2cTestFunc)(void);
+
+struct I2cTestCase {
+    const char *name;
+    I2cTestFunc func;
+    I2cTestCase *next;
+};
+
+class I2cTestRegistrar
+{
+public:
+    I2cTestRegistrar(I2cTestCase &tc, const char *name, I2cTestFunc func);
+};
+
+extern void I2c_TestFail(const char *file, int line, const char *expr);
+
+#define I2C_TEST(name)                                                  \
+    static void test_##name(void);                                      \
+    static I2cTestCase test_case_##name;                                \
+    static I2cTestRegistrar test_reg_##name(test_case_##name, #name, test_##name); \
+    static void test_##name(void)
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            I2c_TestFail(__FILE__, __LINE__, #cond);                    \
+        }                                                               \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                  \
+    do {                                                                \
+        long long check_a = (long long)(a);                             \
+        long long check_b = (long long)(b);                             \
+        if (check_a != check_b)                                         \
+        {                                                               \
+            char check_msg[160];                                        \
+            snprintf(check_msg, sizeof(check_msg), "%s == %s (%lld != %lld)", #a, #b, check_a, check_b); \
+            I2c_TestFail(__FILE__, __LINE__, check_msg);                \
+        }                                                               \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tol)                                           \
+    do {                                                                \
+        double check_a = (double)(a);                                   \
+        double check_b = (double)(b);                                   \
+        if (!(fabs(check_a - check_b) <= (tol)))                        \
+        {                                                               \
+            char check_msg[160];                                        \
+            snprintf(check_msg, sizeof(check_msg), "%s ~ %s (%g vs %g)", #a, #b, check_a, check_b); \
+            I2c_TestFail(__FILE__, __LINE__, check_msg);                \
+        }                                                               \
+    } while (0)
+
+// Pins of the bus the engine tests run on; the sensor scheduler owns
+// P1_6/P0_2 and P1_10/P0_28.
+#define TEST_SDA P0_3
+#define TEST_SCL P0_4
+
+// Second bus for the lockstep tests, on the same GPIO port.
+#define TEST_SDA2 P0_5
+#define TEST_SCL2 P0_6
+
+// Sensor that NACKs the nack_at-th byte written to it (1 = register).
+class NackingSensor : public SimPressureSensor
+{
+public:
+    NackingSensor(void) : nack_at(0), writes(0) {}
+    
+    int nack_at;
+
+protected:
+    virtual void onAddress(bool read)
+    {
+        if (!read) {
+            writes = 0;
+        }
+        SimPressureSensor::onAddress(read);
+    }
+    virtual bool onWrite(uint8_t val)
+    {
+        if (++writes == nack_at) {
+            return false;
+        }
+        return SimPressureSensor::onWrite(val);
+    }
+
+private:
+    int writes;
+};
+
+// Steps an engine until its transfer or command list is done; false
+// when it is still busy after max calls.
+template <class Engine>
+bool I2c_TestFinish(Engine &engine, int max = 100000)
+{
+    for (int i = 0; i < max; i++)
+    {
+        if (!engine.loop()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Runs the sensor scheduler for ms of simulated time.
+extern void I2c_TestRun(int ms);
+
+#endif
@@ -0,0 +1,99 @@
+#include "i2c_test.h"
+#include "i2c_breaker.h"
+#include "i2c_sensors.h"
+
+// The delay doubles per failure up to max; the trip-th failure opens the
+// breaker and a failed probe keeps it open.
+I2C_TEST(breaker_backoff_and_trip)
+{
+    I2cBreaker breaker;
+    
+    breaker.configure(1000, 8000, 5, 100000);
+    CHECK_EQ(breaker.failure(100), 1000);
+    CHECK_EQ(breaker.failure(200), 2000);
+    CHECK_EQ(breaker.failure(300), 4000);
+    CHECK_EQ(breaker.failure(400), 8000);
+    CHECK_EQ(breaker.state(), I2C_BREAKER_CLOSED);
+    CHECK_EQ(breaker.failure(500), 100000);
+    CHECK_EQ(breaker.state(), I2C_BREAKER_OPEN);
+    CHECK_EQ(breaker.trips(), 1);
+    
+    breaker.probe();
+    CHECK_EQ(breaker.state(), I2C_BREAKER_HALF_OPEN);
+    CHECK_EQ(breaker.failure(600), 100000);
+    CHECK_EQ(breaker.state(), I2C_BREAKER_OPEN);
+    CHECK_EQ(breaker.trips(), 1);
+    CHECK_EQ(breaker.failures(), 6);
+    
+    breaker.probe();
+    breaker.success(5100);
+    CHECK_EQ(breaker.state(), I2C_BREAKER_CLOSED);
+    CHECK_EQ(breaker.failures(), 0);
+    CHECK_EQ(breaker.recoveries(), 1);
+    CHECK_EQ(breaker.recoveryUs(), 5000);
+    CHECK_EQ(breaker.maxRecoveryUs(), 5000);
+    CHECK_EQ(breaker.failure(6000), 1000);
+}
+
+I2C_TEST(breaker_never_trips)
+{
+    I2cBreaker breaker;
+    
+    breaker.configure(1000, 4000, 0, 100000);
+    for (int i = 0; i < 50; i++) {
+        breaker.failure(i);
+    }
+    CHECK_EQ(breaker.failure(50), 4000);
+    CHECK_EQ(breaker.state(), I2C_BREAKER_CLOSED);
+    CHECK_EQ(breaker.trips(), 0);
+    
+    // a success without failures is no recovery
+    breaker.reset();
+    breaker.success(100);
+    CHECK_EQ(breaker.recoveries(), 0);
+}
+
+// The sensor on bus 1 stops answering: its channel backs off, its bus is
+// recovered, the breaker opens, and all closes again once it is back.
+// Channel 0 is not held up meanwhile.
+I2C_TEST(sensors_breaker_and_recovery)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    NackingSensor sensor2;
+    struct i2c_stats_t stats;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    I2c_SetLockstep(false);
+    I2c_SetRetryPolicy(1000, 4000, 4, 20000);
+    I2c_SetAutoRecover(3);
+    I2c_SensorSetup();
+    I2c_TestRun(10);
+    I2c_ResetStats();
+    
+    sensor2.nack_at = 1;
+    I2c_TestRun(100);
+    I2c_GetStats(stats);
+    CHECK(stats.channel[0].samples > 50);
+    CHECK_EQ(stats.channel[0].failures, 0);
+    CHECK(stats.channel[1].samples <= 1);
+    CHECK(stats.channel[1].breaker != I2C_BREAKER_CLOSED);
+    CHECK_EQ(stats.channel[1].trips, 1);
+    CHECK(stats.channel[1].failures >= 4);
+    CHECK(stats.channel[1].failures <= 12);
+    CHECK(stats.bus[1].recoveries > 0);
+    CHECK_EQ(stats.bus[1].recover_failed, 0);
+    CHECK_EQ(stats.bus[0].recoveries, 0);
+    
+    sensor2.nack_at = 0;
+    I2c_TestRun(50);
+    I2c_GetStats(stats);
+    CHECK(stats.channel[1].samples > 0);
+    CHECK_EQ(stats.channel[1].breaker, I2C_BREAKER_CLOSED);
+    CHECK_EQ(stats.channel[1].failures, 0);
+    CHECK_EQ(stats.channel[1].recoveries, 1);
+    CHECK(stats.channel[1].recovery_us >= 90000);
+    CHECK_EQ(stats.channel[1].max_recovery_us, stats.channel[1].recovery_us);
+}
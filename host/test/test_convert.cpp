@@ -0,0 +1,83 @@
+#include "i2c_test.h"
+#include "i2c_convert.h"
+
+static const int type_counts[] = {2048, 1024, 512, 256, 128, 64, 32, 16, 8, 8};
+
+// The fixed-point results stay within one LSB of the float reference
+// over the whole 24-bit range of every type.
+I2C_TEST(convert_matches_float)
+{
+    for (int type = Pos2k5Pa; type <= Pos1000kPa; type++)
+    {
+        PressureScale scale;
+        SensorScale q16;
+        double counts = type_counts[type];
+        
+        scale.setType((enum SensorI2CType)type);
+        scale.scale(q16);
+        for (int32_t raw = -(1 << 23); raw < (1 << 23); raw += 4093)
+        {
+            double pa = raw / counts;
+            
+            CHECK_NEAR(scale.pa(raw), pa, 0.5);
+            CHECK_NEAR(scale.kpaQ16(raw), pa / 1000.0 * 65536.0, 1.0);
+            CHECK_NEAR(scale.kpa(raw), pa / 1000.0, 0.0001);
+            CHECK_EQ(q16.q16(raw), scale.kpaQ16(raw));
+        }
+    }
+}
+
+I2C_TEST(convert_exact_values)
+{
+    PressureScale scale;
+    
+    CHECK_EQ(scale.kpaQ16(512 * 1000), 65536);
+    CHECK_EQ(scale.pa(512 * 1000), 1000);
+    CHECK_EQ(scale.pa(-512 * 1000), -1000);
+    CHECK_EQ(scale.pa(0), 0);
+    
+    scale.setType(Pos700kPa);
+    CHECK_EQ(scale.kpaQ16(-8 * 100000), -100 * 65536);
+    CHECK_EQ(scale.pa(8 * 700000), 700000);
+    
+    // unknown types keep the previous one
+    scale.setType((enum SensorI2CType)100);
+    CHECK_EQ(scale.pa(8 * 700000), 700000);
+}
+
+I2C_TEST(convert_batch_matches_single)
+{
+    PressureScale scale;
+    int32_t raw[64];
+    int32_t kpa_q16[64];
+    int32_t pa[64];
+    float kpa[64];
+    
+    scale.setType(Pos100kPa);
+    for (int i = 0; i < 64; i++) {
+        raw[i] = (i - 32) * 123457;
+    }
+    scale.convert(raw, kpa_q16, 64);
+    scale.convertPa(raw, pa, 64);
+    scale.convert(raw, kpa, 64);
+    for (int i = 0; i < 64; i++)
+    {
+        CHECK_EQ(kpa_q16[i], scale.kpaQ16(raw[i]));
+        CHECK_EQ(pa[i], scale.pa(raw[i]));
+        CHECK(kpa[i] == scale.kpa(raw[i]));
+    }
+}
+
+// Raw values with fractional bits, as the filters produce them.
+I2C_TEST(convert_fractional_raw)
+{
+    PressureScale scale;
+    SensorScale q16;
+    
+    scale.scale(q16);
+    for (int32_t raw = -(1 << 20); raw < (1 << 20); raw += 997)
+    {
+        CHECK_EQ(q16.q16(raw << 8, 8), q16.q16(raw));
+        CHECK_NEAR(q16.q16((raw << 8) + 128, 8), (raw + 0.5) / 512.0 / 1000.0 * 65536.0, 1.0);
+    }
+}
@@ -0,0 +1,91 @@
+#include "i2c_test.h"
+#include "i2c_sensor6d.h"
+#include "i2c_sensors.h"
+
+typedef I2cDriverTable<Sensor6dPressure, Sensor6dTemperature> TestDrivers;
+
+static_assert(TestDrivers::size == 2, "driver count");
+static_assert(TestDrivers::index<Sensor6dPressure>() == 0, "driver number");
+static_assert(TestDrivers::index<Sensor6dTemperature>() == 1, "driver number");
+static_assert(TestDrivers::index<int>() == 2, "unknown driver");
+
+// Driver without a shadowed register block, for the base defaults.
+class PlainDriver : public I2cSensorDriver<PlainDriver>
+{
+};
+
+// The table passes each call to the driver of the number.
+I2C_TEST(driver_table_dispatch)
+{
+    SensorScale s;
+    uint8_t reg = 0;
+    int n = 0;
+    
+    Sensor6d::pressure[1][0] = 0xFF;
+    Sensor6d::pressure[1][1] = 0xFE;
+    Sensor6d::pressure[1][2] = 0x00;
+    Sensor6d::temperature[1][0] = 0xF6;
+    Sensor6d::temperature[1][1] = 0x00;
+    CHECK_EQ(TestDrivers::decode(0, 1), -512);
+    CHECK_EQ(TestDrivers::decode(1, 1), -2560);
+    
+    TestDrivers::scale(0, Pos10kPa, s);
+    CHECK_EQ(s.q16(512 * 1000), 65536);
+    TestDrivers::scale(1, 0, s);
+    CHECK_EQ(s.q16(-2560), -10 * 65536);
+    
+    CHECK(TestDrivers::shadow(0, reg, n));
+    CHECK_EQ(reg, 0xA5);
+    CHECK_EQ(n, 2);
+    CHECK(!PlainDriver::shadow(reg, n));
+    CHECK_EQ(PlainDriver::configure(0, 0x1234), 0);
+    CHECK_EQ(TestDrivers::configure(1, 2, 0xFFFF), 0x7fd);
+    CHECK_EQ(Sensor6d::config[2][0], 0x07);
+    CHECK_EQ(Sensor6d::config[2][1], 0xFD);
+}
+
+// Pressure and temperature of one part on bus 0 and a temperature
+// channel on bus 1; in lockstep the buses only share rounds of the same
+// driver.
+static void checkTemperatureDriver(bool lockstep)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    float value = 0;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    sensor1.setPressure(512 * 1500);
+    sensor1.setTemperature(25 * 256 + 128);
+    sensor2.setTemperature(-40 * 256);
+    CHECK_EQ(I2c_AddSensorDriver(0, 0x6d, I2C_DRIVER_6D_PRESSURE, Pos10kPa, 0), 0);
+    CHECK_EQ(I2c_AddSensorDriver(0, 0x6d, I2C_DRIVER_6D_TEMPERATURE, 0, 0), 1);
+    CHECK_EQ(I2c_AddSensorDriver(1, 0x6d, I2C_DRIVER_6D_TEMPERATURE, 0, 0), 2);
+    CHECK_EQ(I2c_AddSensorDriver(1, 0x6d, I2C_NUM_DRIVERS, 0, 0), -1);
+    I2c_SetLockstep(lockstep);
+    I2c_SensorSetup();
+    CHECK_EQ(I2c_GetNumChannels(), 3);
+    I2c_TestRun(30);
+    
+    CHECK(!I2c_SensorError());
+    CHECK(I2c_Read_Channel(0, value));
+    CHECK_NEAR(value, 1.5, 0.0001);
+    CHECK(I2c_Read_Channel(1, value));
+    CHECK_NEAR(value, 25.5, 0.0001);
+    CHECK(I2c_Read_Channel(2, value));
+    CHECK_NEAR(value, -40.0, 0.0001);
+    CHECK(sensor1.conversions() > 10);
+    CHECK(sensor2.conversions() > 5);
+}
+
+I2C_TEST(sensors_temperature_driver)
+{
+    checkTemperatureDriver(false);
+}
+
+I2C_TEST(sensors_temperature_driver_lockstep)
+{
+    checkTemperatureDriver(true);
+}
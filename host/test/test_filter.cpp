@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include "i2c_test.h"
+#include "i2c_lowlevel.h"
+#include "i2c_filter.h"
+#include "i2c_sensors.h"
+
+static struct filter_config_t filterConfig(int median, int average, int iir_shift, int decimate)
+{
+    struct filter_config_t cfg;
+    
+    cfg.median = median;
+    cfg.average = average;
+    cfg.iir_shift = iir_shift;
+    cfg.decimate = decimate;
+    return cfg;
+}
+
+static int compareInt(const void *a, const void *b)
+{
+    int32_t x = *(const int32_t *)a;
+    int32_t y = *(const int32_t *)b;
+    
+    return (x > y) - (x < y);
+}
+
+// Median and mean of the last n of the first count values, as the
+// filter computes them (I2C_FILTER_FRAC fractional bits).
+static int32_t refMedian(const int32_t *vals, int count, int n)
+{
+    int32_t w[I2C_FILTER_MAX_TAPS];
+    
+    if (n > count) {
+        n = count;
+    }
+    for (int i = 0; i < n; i++) {
+        w[i] = vals[count - n + i] * (1 << I2C_FILTER_FRAC);
+    }
+    qsort(w, n, sizeof(w[0]), compareInt);
+    if (n & 1) {
+        return w[n / 2];
+    }
+    return (int32_t)(((int64_t)w[(n / 2) - 1] + w[n / 2]) / 2);
+}
+
+static int32_t refAverage(const int32_t *vals, int count, int n)
+{
+    int64_t sum = 0;
+    
+    if (n > count) {
+        n = count;
+    }
+    for (int i = 0; i < n; i++) {
+        sum += (int64_t)vals[count - n + i] * (1 << I2C_FILTER_FRAC);
+    }
+    return (int32_t)(sum / n);
+}
+
+I2C_TEST(filter_passthrough)
+{
+    SampleFilter filter;
+    int32_t out = 0;
+    
+    CHECK(filter.push(100, out));
+    CHECK_EQ(out, 100 << I2C_FILTER_FRAC);
+    CHECK(filter.configure(filterConfig(1, 1, 0, 1)));
+    CHECK(filter.push(-7, out));
+    CHECK_EQ(out, -7 * (1 << I2C_FILTER_FRAC));
+}
+
+I2C_TEST(filter_configure_limits)
+{
+    SampleFilter filter;
+    
+    CHECK(filter.configure(filterConfig(I2C_FILTER_MAX_TAPS, I2C_FILTER_MAX_TAPS, 16, 100)));
+    CHECK(!filter.configure(filterConfig(I2C_FILTER_MAX_TAPS + 1, 0, 0, 0)));
+    CHECK(!filter.configure(filterConfig(0, I2C_FILTER_MAX_TAPS + 1, 0, 0)));
+    CHECK(!filter.configure(filterConfig(0, 0, 17, 0)));
+    CHECK(!filter.configure(filterConfig(-1, 0, 0, 0)));
+    CHECK(!filter.configure(filterConfig(0, 0, 0, -1)));
+}
+
+// The sorted window and the running sum against recomputing them, over
+// windows of even and odd size with duplicates and negative values.
+I2C_TEST(filter_median_average_match_reference)
+{
+    int32_t vals[200];
+    
+    srand(1);
+    for (int i = 0; i < 200; i++) {
+        vals[i] = (rand() % 2001) - 1000;
+    }
+    vals[50] = vals[51] = vals[52] = 7;
+    
+    for (int n = 2; n <= I2C_FILTER_MAX_TAPS; n += 3)
+    {
+        SampleFilter med;
+        SampleFilter avg;
+        int32_t out = 0;
+        
+        CHECK(med.configure(filterConfig(n, 0, 0, 0)));
+        CHECK(avg.configure(filterConfig(0, n, 0, 0)));
+        for (int i = 0; i < 200; i++)
+        {
+            CHECK(med.push(vals[i], out));
+            CHECK_EQ(out, refMedian(vals, i + 1, n));
+            CHECK(avg.push(vals[i], out));
+            CHECK_EQ(out, refAverage(vals, i + 1, n));
+        }
+    }
+}
+
+I2C_TEST(filter_median_rejects_spike)
+{
+    SampleFilter filter;
+    const int32_t vals[] = {10, 10, 5000, 10, 10, -5000, 10};
+    int32_t out = 0;
+    
+    CHECK(filter.configure(filterConfig(3, 0, 0, 0)));
+    for (int i = 0; i < 7; i++)
+    {
+        CHECK(filter.push(vals[i], out));
+        if (i >= 2) {
+            CHECK_EQ(out, 10 << I2C_FILTER_FRAC);
+        }
+    }
+}
+
+// A step settles by 1 - 2^-shift per sample and keeps the fractional
+// bits of the input.
+I2C_TEST(filter_iir_step)
+{
+    SampleFilter filter;
+    int32_t out = 0;
+    
+    CHECK(filter.configure(filterConfig(0, 0, 2, 0)));
+    CHECK(filter.push(0, out));
+    CHECK_EQ(out, 0);
+    CHECK(filter.push(1000, out));
+    CHECK_EQ(out, 250 << I2C_FILTER_FRAC);
+    CHECK(filter.push(1000, out));
+    CHECK_EQ(out, 437.5 * (1 << I2C_FILTER_FRAC));
+    for (int i = 0; i < 100; i++) {
+        filter.push(1000, out);
+    }
+    CHECK_NEAR(out, 1000 << I2C_FILTER_FRAC, 4);
+}
+
+I2C_TEST(filter_decimate)
+{
+    SampleFilter filter;
+    int32_t out = 0;
+    int outputs = 0;
+    
+    CHECK(filter.configure(filterConfig(0, 4, 0, 4)));
+    for (int i = 1; i <= 20; i++)
+    {
+        if (filter.push(i, out))
+        {
+            outputs++;
+            CHECK_EQ(i % 4, 0);
+            CHECK_EQ(out, ((4 * i) - 6) * (1 << I2C_FILTER_FRAC) / 4);
+        }
+    }
+    CHECK_EQ(outputs, 5);
+    
+    // configure() restarts the count
+    filter.push(1, out);
+    CHECK(filter.configure(filterConfig(0, 0, 0, 2)));
+    CHECK(!filter.push(1, out));
+    CHECK(filter.push(1, out));
+}
+
+// The filtered stream of a channel next to its raw one.
+I2C_TEST(sensors_filtered_channel)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    struct sample_t raw[I2C_SAMPLE_RING_SIZE];
+    struct sample_t filtered[I2C_SAMPLE_RING_SIZE];
+    float value = 0;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    sensor1.setPressure(512 * 1000);
+    I2c_SensorSetup();
+    CHECK(!I2c_SetChannelFilter(5, filterConfig(0, 4, 0, 2)));
+    CHECK(!I2c_SetChannelFilter(0, filterConfig(0, 0, 0, -1)));
+    CHECK(!I2c_Read_Filtered(5, value));
+    CHECK(I2c_Read_Filtered(0, value));
+    CHECK_EQ(value, 0);
+    
+    CHECK(I2c_SetChannelFilter(0, filterConfig(3, 4, 0, 2)));
+    I2c_DrainChannel(0, raw, I2C_SAMPLE_RING_SIZE);
+    I2c_TestRun(10);
+    int n_raw = I2c_DrainChannel(0, raw, I2C_SAMPLE_RING_SIZE);
+    int n_filtered = I2c_DrainFiltered(0, filtered, I2C_SAMPLE_RING_SIZE);
+    
+    CHECK(n_raw > 4);
+    CHECK_EQ(n_filtered, n_raw / 2);
+    for (int i = 0; i < n_filtered; i++)
+    {
+        CHECK_EQ(filtered[i].status, I2C_ERROR_NONE);
+        CHECK_EQ(filtered[i].raw, 512 * 1000);
+        CHECK_EQ(filtered[i].kpa_q16, 65536);
+        CHECK_EQ(filtered[i].start_us, raw[(2 * i) + 1].start_us);
+    }
+    CHECK(I2c_Read_Filtered(0, value));
+    CHECK_NEAR(value, 1.0, 0.0001);
+    
+    // channel 1 has no filter and queues nothing
+    CHECK_EQ(I2c_DrainFiltered(1, filtered, I2C_SAMPLE_RING_SIZE), 0);
+}
@@ -0,0 +1,370 @@
+#include <string.h>
+#include "i2c_test.h"
+#include "i2c_highlevel.h"
+
+I2C_TEST(highlevel_register_write)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    
+    bus.attach(sensor);
+    CHECK(i2c.write(0xA5, 0x0712, 16));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    CHECK(i2c.ack());
+    CHECK_EQ(sensor.reg(0xA5), 0x07);
+    CHECK_EQ(sensor.reg(0xA6), 0x12);
+}
+
+I2C_TEST(highlevel_register_read)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    
+    bus.attach(sensor);
+    sensor.setReg(0x06, 0x12);
+    sensor.setReg(0x07, 0x34);
+    sensor.setReg(0x08, 0x56);
+    CHECK(i2c.read(0x06, 24));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    CHECK_EQ(i2c.get(), 0x123456);
+}
+
+I2C_TEST(highlevel_nack_wrong_address)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x22);
+    
+    bus.attach(sensor);
+    CHECK(i2c.write(0x40, 0x55, 8));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NACK);
+    CHECK_EQ(sensor.reg(0x40), 0);
+    
+    // a wrong address leaves the bus usable
+    CHECK(i2c.setAddress(0x6d));
+    CHECK(i2c.write(0x40, 0x55, 8));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    CHECK_EQ(sensor.reg(0x40), 0x55);
+}
+
+I2C_TEST(highlevel_stretch_timeout)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    
+    bus.attach(sensor);
+    i2c.bus().setStretchTimeout(100);
+    sensor.setClockStretch(1000000);
+    CHECK(i2c.read(0x06, 24));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_TIMEOUT);
+    CHECK(i2c.bus().timeout());
+    
+    // once the slave lets go the next transfer goes through
+    sensor.setClockStretch(0);
+    wait_us(1000);
+    CHECK(i2c.recover());
+    CHECK(i2c.read(0x06, 24));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+}
+
+// A slave may stretch every ACK for less than the timeout; the transfer
+// goes through and takes that much longer.
+I2C_TEST(highlevel_clock_stretch_within_timeout)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    
+    bus.attach(sensor);
+    sensor.setReg(0x06, 0x5a);
+    
+    uint64_t t0 = Sim_TimeNs();
+    CHECK(i2c.read(0x06, 24));
+    CHECK(I2c_TestFinish(i2c));
+    uint64_t plain_ns = Sim_TimeNs() - t0;
+    
+    i2c.bus().setStretchTimeout(100);
+    sensor.setClockStretch(50000);
+    t0 = Sim_TimeNs();
+    CHECK(i2c.read(0x06, 24));
+    CHECK(I2c_TestFinish(i2c));
+    uint64_t stretched_ns = Sim_TimeNs() - t0;
+    
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    CHECK_EQ(i2c.get() >> 16, 0x5a);
+    CHECK(!i2c.bus().timeout());
+    // address, register, address and the two ACKed data bytes, less the
+    // half period before each SCL release
+    CHECK(stretched_ns >= plain_ns + 5 * 45000);
+    CHECK(stretched_ns <= plain_ns + 5 * 50000);
+}
+
+// The timeout flag of a stretched transfer is cleared by the next START.
+I2C_TEST(highlevel_stretch_timeout_cleared_by_start)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    
+    bus.attach(sensor);
+    i2c.bus().setStretchTimeout(50);
+    sensor.setClockStretch(200000);
+    CHECK(i2c.write(0x40, 0x01, 8));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_TIMEOUT);
+    CHECK(i2c.bus().timeout());
+    
+    sensor.setClockStretch(0);
+    wait_us(500);
+    CHECK(i2c.recover());
+    CHECK(i2c.write(0x40, 0x02, 8));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    CHECK(!i2c.bus().timeout());
+    CHECK_EQ(sensor.reg(0x40), 0x02);
+}
+
+I2C_TEST(highlevel_burst_write_read)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    uint8_t out[20];
+    uint8_t in[20];
+    
+    bus.attach(sensor);
+    for (int i = 0; i < (int)sizeof(out); i++) {
+        out[i] = (uint8_t)(0x80 + 3 * i);
+    }
+    CHECK(i2c.writeBytes(0x40, out, sizeof(out)));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    for (int i = 0; i < (int)sizeof(out); i++) {
+        CHECK_EQ(sensor.reg(0x40 + i), out[i]);
+    }
+    
+    memset(in, 0, sizeof(in));
+    CHECK(i2c.readBytes(0x40, in, sizeof(in)));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    CHECK_EQ(bus.starts(), 3);
+}
+
+I2C_TEST(highlevel_burst_limits)
+{
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    uint8_t buf[8];
+    
+    // the internal buffer holds 4 bytes, get() 32 bits
+    CHECK(!i2c.readBytes(0x40, NULL, 5));
+    CHECK(!i2c.read(0x40, 40));
+    CHECK(!i2c.read(0x40, 12));
+    CHECK(!i2c.readBytes(0x40, buf, 0));
+    CHECK(!i2c.busy());
+    
+    // one transfer at a time
+    CHECK(i2c.readBytes(0x40, buf, 8));
+    CHECK(!i2c.readBytes(0x40, buf, 8));
+}
+
+// Start a conversion, wait for the busy bit and read the result, all
+// from loop().
+I2C_TEST(highlevel_command_list)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    static const uint8_t start[] = {0x0A};
+    uint8_t result[3];
+    const I2cCommand list[] = {
+        I2C_CMD_WRITE_ENTRY(0x30, start, 1),
+        I2C_CMD_DELAY_ENTRY(100),
+        I2C_CMD_POLL_ENTRY(0x30, 0x08, 0),
+        I2C_CMD_READ_ENTRY(0x06, result, 3),
+    };
+    
+    bus.attach(sensor);
+    sensor.setPressure(0x123456);
+    sensor.setConversionTime(400000);
+    
+    uint64_t t0 = Sim_TimeNs();
+    CHECK(i2c.run(list, 4));
+    CHECK(i2c.busy());
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    CHECK_EQ(i2c.position(), 4);
+    CHECK(Sim_TimeNs() - t0 >= 400000);
+    CHECK(i2c.polls() > 1);
+    CHECK_EQ(result[0], 0x12);
+    CHECK_EQ(result[1], 0x34);
+    CHECK_EQ(result[2], 0x56);
+    CHECK_EQ(sensor.conversions(), 1);
+}
+
+I2C_TEST(highlevel_command_list_stops_on_error)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    static const uint8_t start[] = {0x0A};
+    uint8_t result[3] = {0, 0, 0};
+    const I2cCommand list[] = {
+        I2C_CMD_WRITE_ENTRY(0x30, start, 1),
+        I2C_CMD_POLL_ENTRY(0x30, 0x08, 3),
+        I2C_CMD_READ_ENTRY(0x06, result, 3),
+    };
+    
+    bus.attach(sensor);
+    sensor.setPressure(0x123456);
+    sensor.setConversionTime(100000000);
+    
+    // the POLL gives up after 3 reads
+    CHECK(i2c.run(list, 3));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_POLL);
+    CHECK_EQ(i2c.position(), 1);
+    CHECK_EQ(result[0], 0);
+    
+    // a NACK ends the list at its first command
+    CHECK(i2c.setAddress(0x22));
+    CHECK(i2c.run(list, 3));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NACK);
+    CHECK_EQ(i2c.position(), 0);
+    CHECK_EQ(result[0], 0);
+}
+
+I2C_TEST(highlevel_budgeted_loop)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    int total = 0;
+    int calls = 0;
+    
+    bus.attach(sensor);
+    CHECK(i2c.read(0x06, 24));
+    while (i2c.busy() && (calls < 1000))
+    {
+        int bits = i2c.loop(4, I2C_BUDGET_BITS);
+        
+        CHECK(bits <= 4);
+        CHECK((bits == 4) || !i2c.busy());
+        total += bits;
+        calls++;
+    }
+    CHECK(!i2c.busy());
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    CHECK_EQ((uint32_t)total, i2c.bus().slots());
+    CHECK_EQ(calls, (total + 3) / 4);
+    
+    // nothing to clock
+    CHECK_EQ(i2c.loop(4, I2C_BUDGET_BITS), 0);
+}
+
+I2C_TEST(highlevel_state_names)
+{
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    struct latency_t lt;
+    int n = 0;
+    
+    CHECK(strcmp(HighLevelI2C::stateName(0), "STATE_I2C_IDLE") == 0);
+    CHECK(HighLevelI2C::stateName(-1) == NULL);
+    CHECK(HighLevelI2C::stateName(I2C_LATENCY_STATES) == NULL);
+    while (i2c.latency(n, lt))
+    {
+        CHECK(strcmp(HighLevelI2C::stateName(lt.state), lt.state_name) == 0);
+        n++;
+    }
+    CHECK_EQ(n, I2C_LATENCY_STATES);
+    CHECK_EQ(i2c.latencyBuckets(n, NULL), -1);
+}
+
+// A new list starts without the poll results of the previous one.
+I2C_TEST(highlevel_polls_reset_per_list)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    static const uint8_t start[] = {0x0A};
+    uint8_t result[3];
+    const I2cCommand convert[] = {
+        I2C_CMD_WRITE_ENTRY(0x30, start, 1),
+        I2C_CMD_POLL_ENTRY(0x30, 0x08, 0),
+    };
+    const I2cCommand fetch[] = {
+        I2C_CMD_READ_ENTRY(0x06, result, 3),
+    };
+    
+    bus.attach(sensor);
+    sensor.setConversionTime(300000);
+    CHECK(i2c.run(convert, 2));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK(i2c.polls() > 1);
+    CHECK(i2c.polledAt() != 0);
+    
+    CHECK(i2c.run(fetch, 1));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.polls(), 0);
+    CHECK_EQ(i2c.polledAt(), 0);
+}
+
+static uint32_t stateCount(HighLevelI2C &i2c, const char *name)
+{
+    struct latency_t lt;
+    
+    for (int i = 0; i2c.latency(i, lt); i++)
+    {
+        if (strcmp(lt.state_name, name) == 0) {
+            return lt.count;
+        }
+    }
+    return 0;
+}
+
+// One budgeted call runs the whole transfer; every state it passed
+// through gets its own sample.
+I2C_TEST(highlevel_budgeted_loop_timings)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    struct timing_t tm;
+    
+    bus.attach(sensor);
+    CHECK(i2c.read(0x06, 24));
+    CHECK(i2c.loop(1000, I2C_BUDGET_BITS) > 0);
+    CHECK(!i2c.busy());
+    
+    CHECK_EQ(stateCount(i2c, "STATE_I2C_START"), 1);
+    CHECK_EQ(stateCount(i2c, "STATE_I2C_ADDR"), 1);
+    CHECK_EQ(stateCount(i2c, "STATE_I2C_REG"), 1);
+    CHECK_EQ(stateCount(i2c, "STATE_I2C_RESTART"), 1);
+    CHECK_EQ(stateCount(i2c, "STATE_I2C_ADDR2"), 1);
+    CHECK_EQ(stateCount(i2c, "STATE_I2C_READ_VAL"), 1);
+    CHECK_EQ(stateCount(i2c, "STATE_I2C_STOP"), 1);
+    CHECK_EQ(stateCount(i2c, "STATE_I2C_IDLE"), 0);
+    
+    // the longest state is one byte plus ACK, not the whole transfer
+    CHECK(i2c.timings(tm));
+    CHECK(strcmp(tm.state_name, "STATE_I2C_READ_VAL") == 0);
+    CHECK(tm.duration_us < 3 * 9 * 1000000 / i2c.bus().speed() + 20);
+    
+    // a call split inside a state adds one sample per part
+    i2c.resetTimings();
+    CHECK(i2c.read(0x06, 24));
+    while (i2c.busy()) {
+        i2c.loop(4, I2C_BUDGET_BITS);
+    }
+    CHECK(stateCount(i2c, "STATE_I2C_READ_VAL") >= 6);
+}
@@ -0,0 +1,171 @@
+#include "i2c_test.h"
+#include "i2c_lowlevel.h"
+
+// Byte-level helpers: write()/read()/start()/stop() clock one bit slot
+// per call until the byte is done.
+static bool writeByte(LowLevelI2C &i2c, uint8_t val)
+{
+    bool ack;
+    
+    do {
+        ack = i2c.write(val);
+    } while (!i2c.ready());
+    return ack;
+}
+
+static uint8_t readByte(LowLevelI2C &i2c, bool send_ack)
+{
+    uint8_t val;
+    
+    do {
+        val = i2c.read(send_ack);
+    } while (!i2c.ready());
+    return val;
+}
+
+static void startBus(LowLevelI2C &i2c)
+{
+    do {
+        i2c.start();
+    } while (!i2c.ready());
+}
+
+static void stopBus(LowLevelI2C &i2c)
+{
+    do {
+        i2c.stop();
+    } while (!i2c.ready());
+}
+
+I2C_TEST(lowlevel_register_write)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    LowLevelI2C i2c(TEST_SDA, TEST_SCL);
+    
+    bus.attach(sensor);
+    startBus(i2c);
+    CHECK(writeByte(i2c, 0x6d << 1));
+    CHECK(writeByte(i2c, 0x40));
+    CHECK(writeByte(i2c, 0x5a));
+    CHECK(writeByte(i2c, 0xc3));
+    stopBus(i2c);
+    
+    CHECK_EQ(sensor.reg(0x40), 0x5a);
+    CHECK_EQ(sensor.reg(0x41), 0xc3);
+    CHECK_EQ(bus.starts(), 1);
+    CHECK_EQ(bus.stops(), 1);
+    CHECK_EQ(bus.sda(), 1);
+    CHECK_EQ(bus.scl(), 1);
+}
+
+I2C_TEST(lowlevel_register_read)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    LowLevelI2C i2c(TEST_SDA, TEST_SCL);
+    
+    bus.attach(sensor);
+    sensor.setReg(0x50, 0xa5);
+    sensor.setReg(0x51, 0x3c);
+    startBus(i2c);
+    CHECK(writeByte(i2c, 0x6d << 1));
+    CHECK(writeByte(i2c, 0x50));
+    startBus(i2c);
+    CHECK(writeByte(i2c, (0x6d << 1) | 0x01));
+    CHECK_EQ(readByte(i2c, true), 0xa5);
+    CHECK_EQ(readByte(i2c, false), 0x3c);
+    stopBus(i2c);
+    CHECK_EQ(bus.sda(), 1);
+}
+
+I2C_TEST(lowlevel_nack_wrong_address)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    LowLevelI2C i2c(TEST_SDA, TEST_SCL);
+    
+    bus.attach(sensor);
+    startBus(i2c);
+    CHECK(!writeByte(i2c, 0x22 << 1));
+    stopBus(i2c);
+    
+    // the sensor ignores the rest of the transfer
+    startBus(i2c);
+    CHECK(!writeByte(i2c, 0x22 << 1));
+    CHECK(!writeByte(i2c, 0x40));
+    stopBus(i2c);
+    CHECK_EQ(sensor.reg(0x40), 0);
+}
+
+#if I2C_FASTPIN
+
+// Every pin operation is a single access to a port register.
+I2C_TEST(fastpin_single_register_access)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    GpioPin sda(TEST_SDA);
+    
+    CHECK_EQ(bus.sda(), 1);
+    uint32_t w0 = Sim_GpioWrites();
+    sda.drive();
+    CHECK_EQ(Sim_GpioWrites() - w0, 1);
+    CHECK_EQ(bus.sda(), 0);
+    
+    uint32_t r0 = Sim_GpioReads();
+    CHECK_EQ(sda.read(), 0);
+    CHECK_EQ(Sim_GpioReads() - r0, 1);
+    
+    sda.release();
+    CHECK_EQ(Sim_GpioWrites() - w0, 2);
+    CHECK_EQ(sda.read(), 1);
+}
+
+#endif
+
+// A byte slot by slot takes 9 SCL periods at the calibrated speed.
+static void checkByteTime(int hz)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    LowLevelI2C i2c(TEST_SDA, TEST_SCL);
+    
+    bus.attach(sensor);
+    i2c.setSpeed(hz);
+    CHECK_EQ(i2c.speed(), hz);
+    CHECK(i2c.calibrate());
+    CHECK_NEAR(i2c.bitRate(), hz, hz * 0.05);
+    
+    startBus(i2c);
+    uint64_t t0 = Sim_TimeNs();
+    CHECK(writeByte(i2c, 0x6d << 1));
+    double ns = (double)(Sim_TimeNs() - t0);
+    stopBus(i2c);
+    CHECK_NEAR(ns, 9e9 / hz, 9e9 / hz * 0.05);
+}
+
+I2C_TEST(lowlevel_speed_profiles)
+{
+    checkByteTime(I2C_SPEED_100KHZ);
+    checkByteTime(I2C_SPEED_400KHZ);
+    checkByteTime(I2C_SPEED_1MHZ);
+    checkByteTime(250000);
+}
+
+I2C_TEST(lowlevel_calibrate_needs_idle_bus)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    LowLevelI2C i2c(TEST_SDA, TEST_SCL);
+    DigitalInOut other(TEST_SDA);
+    
+    i2c.setSpeed(I2C_SPEED_100KHZ);
+    i2c.setSpeed(0);
+    CHECK_EQ(i2c.speed(), I2C_SPEED_100KHZ);
+    
+    // another master holds SDA low
+    other.output();
+    other = 0;
+    CHECK(!i2c.calibrate());
+    other.input();
+    CHECK(i2c.calibrate());
+}
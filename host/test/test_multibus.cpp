@@ -0,0 +1,199 @@
+#include <string.h>
+#include "i2c_test.h"
+#include "i2c_multibus.h"
+
+// Two buses with a sensor each, clocked in lockstep.
+struct MultiFixture {
+    SimI2CBus bus1;
+    SimI2CBus bus2;
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    LowLevelI2C i2c1;
+    LowLevelI2C i2c2;
+    MultiBusI2C multi;
+    
+    MultiFixture(uint8_t addr2 = 0x6d) :
+        bus1(TEST_SDA, TEST_SCL), bus2(TEST_SDA2, TEST_SCL2), sensor2(addr2),
+        i2c1(TEST_SDA, TEST_SCL), i2c2(TEST_SDA2, TEST_SCL2)
+    {
+        bus1.attach(sensor1);
+        bus2.attach(sensor2);
+        multi.attach(i2c1, 0x6d);
+        multi.attach(i2c2, 0x6d);
+        for (int i = 0; i < 3; i++)
+        {
+            sensor1.setReg(0x06 + i, (uint8_t)(0x10 + i));
+            sensor2.setReg(0x06 + i, (uint8_t)(0x20 + i));
+        }
+    }
+};
+
+I2C_TEST(multibus_lockstep_read)
+{
+    MultiFixture f;
+    uint8_t buf[6];
+    
+    CHECK(f.multi.readBytes(0x06, buf, 3));
+    CHECK(I2c_TestFinish(f.multi));
+    CHECK(!f.multi.error());
+    CHECK_EQ(f.multi.get(0), 0x101112);
+    CHECK_EQ(f.multi.get(1), 0x202122);
+    CHECK_EQ(buf[2], 0x12);
+    CHECK_EQ(buf[3], 0x20);
+    CHECK_EQ(f.bus1.starts(), 2);
+    CHECK_EQ(f.bus2.starts(), 2);
+}
+
+I2C_TEST(multibus_lockstep_write)
+{
+    MultiFixture f;
+    const uint32_t vals[2] = {0x0102, 0x0304};
+    
+    CHECK(f.multi.write(0xA5, vals, 16));
+    CHECK(I2c_TestFinish(f.multi));
+    CHECK(!f.multi.error());
+    CHECK_EQ(f.sensor1.reg(0xA5), 0x01);
+    CHECK_EQ(f.sensor1.reg(0xA6), 0x02);
+    CHECK_EQ(f.sensor2.reg(0xA5), 0x03);
+    CHECK_EQ(f.sensor2.reg(0xA6), 0x04);
+}
+
+// A bus whose slave does not answer drops out; the other one finishes.
+I2C_TEST(multibus_nack_drops_one_bus)
+{
+    MultiFixture f(0x22);
+    
+    CHECK(f.multi.read(0x06, 24));
+    CHECK(I2c_TestFinish(f.multi));
+    CHECK_EQ(f.multi.error(0), I2C_ERROR_NONE);
+    CHECK_EQ(f.multi.error(1), I2C_ERROR_NACK);
+    CHECK_EQ(f.multi.get(0), 0x101112);
+    CHECK_EQ(f.bus2.stops(), 1);
+}
+
+I2C_TEST(multibus_stretch_timeout_one_bus)
+{
+    MultiFixture f;
+    
+    f.i2c2.setStretchTimeout(100);
+    f.sensor2.setClockStretch(1000000);
+    CHECK(f.multi.read(0x06, 24));
+    CHECK(I2c_TestFinish(f.multi));
+    CHECK_EQ(f.multi.error(0), I2C_ERROR_NONE);
+    CHECK_EQ(f.multi.error(1), I2C_ERROR_TIMEOUT);
+    CHECK_EQ(f.multi.get(0), 0x101112);
+}
+
+// Clocking a second bus on the same port costs no extra port writes
+// with I2C_FASTPIN, where an edge is one write for all buses.
+I2C_TEST(multibus_port_writes_per_edge)
+{
+    MultiFixture f;
+    uint32_t one;
+    uint32_t both;
+    
+    CHECK(f.multi.select(0x01));
+    uint32_t w0 = Sim_GpioWrites();
+    CHECK(f.multi.read(0x06, 24));
+    CHECK(I2c_TestFinish(f.multi));
+    one = Sim_GpioWrites() - w0;
+    
+    CHECK(f.multi.select(0x03));
+    w0 = Sim_GpioWrites();
+    CHECK(f.multi.read(0x06, 24));
+    CHECK(I2c_TestFinish(f.multi));
+    both = Sim_GpioWrites() - w0;
+    
+    CHECK(!f.multi.error());
+    CHECK_EQ(f.multi.get(1), 0x202122);
+#if I2C_FASTPIN
+    CHECK_EQ(both, one);
+#else
+    CHECK(both > one);
+#endif
+}
+
+I2C_TEST(multibus_budgeted_loop)
+{
+    MultiFixture f;
+    int total = 0;
+    int calls = 0;
+    
+    CHECK(f.multi.read(0x06, 24));
+    while (f.multi.busy() && (calls < 1000))
+    {
+        int bits = f.multi.loop(8, I2C_BUDGET_BITS);
+        
+        CHECK(bits <= 8);
+        CHECK((bits == 8) || !f.multi.busy());
+        total += bits;
+        calls++;
+    }
+    CHECK(!f.multi.busy());
+    CHECK_EQ((uint32_t)total, f.i2c1.slots());
+    CHECK_EQ((uint32_t)total, f.i2c2.slots());
+    CHECK(strcmp(MultiBusI2C::stateName(0), "STATE_MULTI_IDLE") == 0);
+}
+
+I2C_TEST(multibus_polls_reset_per_list)
+{
+    MultiFixture f;
+    static const uint8_t start[] = {0x0A, 0x0A};
+    uint8_t result[6];
+    const I2cCommand convert[] = {
+        I2C_CMD_WRITE_ENTRY(0x30, start, 1),
+        I2C_CMD_POLL_ENTRY(0x30, 0x08, 0),
+    };
+    const I2cCommand fetch[] = {
+        I2C_CMD_READ_ENTRY(0x06, result, 3),
+    };
+    
+    f.sensor2.setConversionTime(300000);
+    CHECK(f.multi.run(convert, 2));
+    CHECK(I2c_TestFinish(f.multi));
+    CHECK_EQ(f.multi.polls(0), 1);
+    CHECK(f.multi.polls(1) > 1);
+    CHECK(f.multi.polledAt(1) != 0);
+    
+    CHECK(f.multi.run(fetch, 1));
+    CHECK(I2c_TestFinish(f.multi));
+    for (int i = 0; i < 2; i++)
+    {
+        CHECK_EQ(f.multi.polls(i), 0);
+        CHECK_EQ(f.multi.polledAt(i), 0);
+    }
+}
+
+// A list that fails while a POLL still waits for a bus must not leave
+// that bus as the only one the next transfers go to.
+I2C_TEST(multibus_poll_wait_reset_on_failure)
+{
+    MultiFixture f;
+    static const uint8_t start[] = {0x0A};
+    const I2cCommand convert[] = {
+        I2C_CMD_WRITE_ENTRY(0x30, start, 1),
+        I2C_CMD_POLL_ENTRY(0x30, 0x08, 0),
+    };
+    
+    f.sensor1.setConversionTime(1000000000);
+    CHECK(f.multi.select(0x1));
+    CHECK(f.multi.run(convert, 2));
+    while (f.multi.polls(0) < 2) {
+        CHECK(f.multi.loop());
+    }
+    f.i2c1.setStretchTimeout(100);
+    f.sensor1.setClockStretch(1000000);
+    CHECK(I2c_TestFinish(f.multi));
+    CHECK_EQ(f.multi.error(0), I2C_ERROR_TIMEOUT);
+    
+    f.sensor1.setClockStretch(0);
+    wait_us(1000);
+    CHECK(f.multi.recover());
+    CHECK(f.multi.select(0x3));
+    CHECK(f.multi.read(0x06, 24));
+    CHECK(I2c_TestFinish(f.multi));
+    CHECK_EQ(f.multi.error(0), I2C_ERROR_NONE);
+    CHECK_EQ(f.multi.error(1), I2C_ERROR_NONE);
+    CHECK_EQ(f.multi.get(0), 0x101112);
+    CHECK_EQ(f.multi.get(1), 0x202122);
+}
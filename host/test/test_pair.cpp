@@ -0,0 +1,134 @@
+#include "i2c_test.h"
+#include "i2c_sensors.h"
+
+I2C_TEST(pair_registration)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    
+    CHECK_EQ(I2c_AddSensor(0, 0x6d, Pos10kPa, 0), 0);
+    CHECK_EQ(I2c_AddSensor(1, 0x6d, Pos10kPa, 0), 1);
+    CHECK_EQ(I2c_AddSensor(0, 0x6c, Pos10kPa, 0), 2);
+    CHECK_EQ(I2c_AddPair(0, 0, true), -1);
+    CHECK_EQ(I2c_AddPair(0, 3, true), -1);
+    CHECK_EQ(I2c_AddPair(0, 1, true), 0);
+    CHECK_EQ(I2c_AddPair(2, 1, true), -1);
+    CHECK_EQ(I2c_AddPair(2, 0, false), -1);
+}
+
+// Without registrations the two default channels are pair 0.
+I2C_TEST(pair_default)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    struct pair_t p;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    sensor1.setPressure(512 * 1000);
+    sensor2.setPressure(8 * 1000 * 20);
+    I2c_SensorSetup();
+    CHECK(!I2c_ReadPair(1, p));
+    I2c_TestRun(10);
+    
+    CHECK(I2c_ReadPair(0, p));
+    CHECK(p.count > 0);
+    CHECK_EQ(p.value_q16[0], 65536);
+    CHECK_EQ(p.value_q16[1], 20 * 65536);
+    CHECK(p.latch_us[0] >= p.start_us[0]);
+    CHECK(p.latch_us[1] >= p.start_us[1]);
+    CHECK_EQ(p.start_skew_us, (int32_t)(p.start_us[1] - p.start_us[0]));
+    CHECK_EQ(p.latch_skew_us, (int32_t)(p.latch_us[1] - p.latch_us[0]));
+}
+
+// A synced pair on two buses in lockstep starts both conversions with
+// the same transfer and runs at the rate of the slower sensor.
+I2C_TEST(pair_sync_lockstep)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    struct pair_t p;
+    struct pair_stats_t stats;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    sensor1.setConversionTime(2000000);
+    sensor2.setConversionTime(500000);
+    CHECK_EQ(I2c_AddSensor(0, 0x6d, Pos10kPa, 0), 0);
+    CHECK_EQ(I2c_AddSensor(1, 0x6d, Pos10kPa, 0), 1);
+    CHECK_EQ(I2c_AddPair(0, 1, true), 0);
+    I2c_SetLockstep(true);
+    I2c_SensorSetup();
+    I2c_TestRun(50);
+    
+    CHECK(I2c_ReadPair(0, p));
+    CHECK(I2c_GetPairStats(0, stats));
+    CHECK(stats.pairs > 10);
+    CHECK_EQ(stats.missed, 0);
+    CHECK_EQ(stats.start_skew.count, stats.pairs);
+    CHECK(stats.start_skew.max_us <= 10);
+    CHECK(p.start_skew_us >= -10);
+    CHECK(p.start_skew_us <= 10);
+    CHECK(sensor2.conversions() <= sensor1.conversions() + 1);
+}
+
+// Unsynced, the faster channel keeps its rate and the skews grow.
+I2C_TEST(pair_unsynced)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    struct pair_stats_t stats;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    sensor1.setConversionTime(2000000);
+    sensor2.setConversionTime(500000);
+    CHECK_EQ(I2c_AddSensor(0, 0x6d, Pos10kPa, 0), 0);
+    CHECK_EQ(I2c_AddSensor(1, 0x6d, Pos10kPa, 0), 1);
+    CHECK_EQ(I2c_AddPair(0, 1, false), 0);
+    I2c_SetLockstep(false);
+    I2c_SensorSetup();
+    I2c_TestRun(50);
+    
+    CHECK(I2c_GetPairStats(0, stats));
+    CHECK(stats.pairs > 10);
+    CHECK(sensor2.conversions() > 2 * sensor1.conversions());
+    CHECK(stats.latch_skew.max_us > 500);
+    CHECK(!I2c_GetPairStats(1, stats));
+}
+
+// A failed acquisition of either side ends its cycle without a pair.
+I2C_TEST(pair_missed)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    NackingSensor sensor2;
+    struct pair_t p;
+    struct pair_stats_t stats;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    CHECK_EQ(I2c_AddSensor(0, 0x6d, Pos10kPa, 0), 0);
+    CHECK_EQ(I2c_AddSensor(1, 0x6d, Pos10kPa, 0), 1);
+    CHECK_EQ(I2c_AddPair(0, 1, true), 0);
+    I2c_SensorSetup();
+    I2c_TestRun(10);
+    CHECK(I2c_ReadPair(0, p));
+    uint32_t count = p.count;
+    
+    I2c_ResetStats();
+    sensor2.nack_at = 1;
+    I2c_TestRun(20);
+    CHECK(I2c_GetPairStats(0, stats));
+    CHECK(stats.missed > 0);
+    CHECK(stats.pairs <= 1);
+    CHECK(I2c_ReadPair(0, p));
+    CHECK(p.count <= count + 1);
+}
@@ -0,0 +1,102 @@
+#include "i2c_test.h"
+#include "i2c_lowlevel.h"
+#include "i2c_ring.h"
+#include "i2c_sensors.h"
+
+I2C_TEST(ring_order_and_wrap)
+{
+    SampleRing<int, 4> ring;
+    int out[8];
+    int next = 0;
+    int expect = 0;
+    
+    CHECK_EQ(ring.drain(out, 8), 0);
+    
+    // push and drain in uneven steps so the indices wrap many times
+    for (int round = 0; round < 20; round++)
+    {
+        for (int i = 0; i < 3; i++) {
+            CHECK(ring.push(next++));
+        }
+        CHECK_EQ(ring.count(), 3);
+        
+        int n = ring.drain(out, 2);
+        
+        CHECK_EQ(n, 2);
+        n += ring.drain(out + 2, 8);
+        CHECK_EQ(n, 3);
+        for (int i = 0; i < n; i++) {
+            CHECK_EQ(out[i], expect++);
+        }
+    }
+    CHECK_EQ(ring.count(), 0);
+    CHECK_EQ(ring.dropped(), 0);
+}
+
+I2C_TEST(ring_drops_newest_when_full)
+{
+    SampleRing<int, 4> ring;
+    int out[8];
+    
+    for (int i = 0; i < 6; i++) {
+        CHECK_EQ(ring.push(i), i < 4);
+    }
+    CHECK_EQ(ring.count(), 4);
+    CHECK_EQ(ring.dropped(), 2);
+    
+    // the oldest items are kept
+    CHECK_EQ(ring.drain(out, 8), 4);
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(out[i], i);
+    }
+    CHECK(ring.push(10));
+    CHECK_EQ(ring.drain(out, 8), 1);
+    CHECK_EQ(out[0], 10);
+    CHECK_EQ(ring.dropped(), 2);
+}
+
+// Every acquisition of a channel is queued in order; without a consumer
+// the ring fills up and the newer samples are counted as dropped.
+I2C_TEST(sensors_drain_channel)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    struct sample_t samples[I2C_SAMPLE_RING_SIZE];
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    sensor1.setPressure(512 * 1000);
+    I2c_SensorSetup();
+    int setup = I2c_DrainChannel(0, samples, I2C_SAMPLE_RING_SIZE);
+    
+    CHECK_EQ(setup, 1);
+    CHECK_EQ(I2c_GetDroppedSamples(0), 0);
+    
+    I2c_TestRun(5);
+    int n = I2c_DrainChannel(0, samples, I2C_SAMPLE_RING_SIZE);
+    
+    CHECK(n > 2);
+    CHECK(n < I2C_SAMPLE_RING_SIZE);
+    for (int i = 0; i < n; i++)
+    {
+        CHECK_EQ(samples[i].status, I2C_ERROR_NONE);
+        CHECK_EQ(samples[i].raw, 512 * 1000);
+        CHECK_EQ(samples[i].kpa_q16, 65536);
+        if (i > 0) {
+            CHECK((int32_t)(samples[i].timestamp_us - samples[i - 1].timestamp_us) > 0);
+        }
+    }
+    CHECK_EQ(I2c_GetDroppedSamples(0), 0);
+    CHECK_EQ(I2c_DrainChannel(0, samples, I2C_SAMPLE_RING_SIZE), 0);
+    CHECK_EQ(I2c_DrainChannel(8, samples, I2C_SAMPLE_RING_SIZE), 0);
+    
+    I2c_TestRun(50);
+    struct i2c_stats_t stats;
+    
+    I2c_GetStats(stats);
+    CHECK_EQ(I2c_DrainChannel(0, samples, I2C_SAMPLE_RING_SIZE), I2C_SAMPLE_RING_SIZE);
+    CHECK(I2c_GetDroppedSamples(0) > 0);
+    CHECK_EQ(setup + n + I2C_SAMPLE_RING_SIZE + I2c_GetDroppedSamples(0), stats.channel[0].samples);
+}
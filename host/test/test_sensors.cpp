@@ -0,0 +1,172 @@
+#include "i2c_test.h"
+#include "i2c_sensors.h"
+
+// The two default sensors on the board buses: 512 counts per Pa
+// (Pos10kPa) and 8 counts per Pa (Pos700kPa).
+I2C_TEST(sensors_default_scales)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    float p1 = 0;
+    float p2 = 0;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    sensor1.setPressure(512 * 1000);
+    sensor2.setPressure(-8 * 1000 * 100);
+    I2c_SensorSetup();
+    CHECK(!I2c_SensorError());
+    I2c_TestRun(20);
+    
+    CHECK(I2c_Read_Pressure(p1));
+    CHECK(I2c_Read_O2(p2));
+    CHECK_NEAR(p1, 1.0, 0.0001);
+    CHECK_NEAR(p2, -100.0, 0.0001);
+    CHECK(sensor1.conversions() > 10);
+    CHECK(sensor2.conversions() > 10);
+}
+
+// Acquisitions in progress are not errors.
+I2C_TEST(sensors_meas_stats_clean)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    int error = -1;
+    int total = 0;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    I2c_SensorSetup();
+    for (int ms = 0; ms < 10; ms++)
+    {
+        I2c_TestRun(1);
+        I2c_GetMeasStats(error, total);
+        CHECK_EQ(error, 0);
+    }
+    CHECK(total > 10);
+}
+
+// Two sensors share bus 0, one more sits on bus 1; the one at 0x22 on
+// bus 0 is missing.
+I2C_TEST(sensors_registry_shared_bus)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1(0x6d);
+    SimPressureSensor sensor2(0x6c);
+    SimPressureSensor sensor3(0x6d);
+    struct i2c_stats_t stats;
+    float value = 0;
+    int error = 0;
+    int total = 0;
+    
+    bus1.attach(sensor1);
+    bus1.attach(sensor2);
+    bus2.attach(sensor3);
+    sensor1.setPressure(512 * 1000);
+    sensor2.setPressure(512 * 2000);
+    sensor3.setPressure(8 * 1000 * 300);
+    CHECK_EQ(I2c_GetNumBuses(), 2);
+    CHECK_EQ(I2c_AddSensor(0, 0x6d, Pos10kPa, 0), 0);
+    CHECK_EQ(I2c_AddSensor(0, 0x6c, Pos10kPa, 0), 1);
+    CHECK_EQ(I2c_AddSensor(1, 0x6d, Pos700kPa, 0), 2);
+    CHECK_EQ(I2c_AddSensor(0, 0x22, Pos10kPa, 0), 3);
+    CHECK_EQ(I2c_AddSensor(2, 0x6d, Pos10kPa, 0), -1);
+    I2c_SensorSetup();
+    CHECK_EQ(I2c_GetNumChannels(), 4);
+    I2c_TestRun(20);
+    
+    CHECK(I2c_Read_Channel(0, value));
+    CHECK_NEAR(value, 1.0, 0.0001);
+    CHECK(I2c_Read_Channel(1, value));
+    CHECK_NEAR(value, 2.0, 0.0001);
+    CHECK(I2c_Read_Channel(2, value));
+    CHECK_NEAR(value, 300.0, 0.0001);
+    CHECK(I2c_Read_Channel(3, value));
+    CHECK_EQ(value, 0);
+    CHECK(I2c_SensorError());
+    CHECK(sensor1.conversions() > 5);
+    CHECK(sensor2.conversions() > 5);
+    
+    // the failed acquisitions are the errors
+    I2c_GetMeasStats(error, total);
+    I2c_GetStats(stats);
+    CHECK(error > 0);
+    CHECK_EQ(error, stats.channel[3].faults[I2C_FAULT_NACK_ADDR]);
+    CHECK(total > error);
+}
+
+static void checkConversionLearned(bool lockstep)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    sensor1.setConversionTime(2000000);
+    sensor2.setConversionTime(1000000);
+    I2c_SetLockstep(lockstep);
+    I2c_SensorSetup();
+    I2c_TestRun(50);
+    
+    // within a poll read of the real time, and fetched without polling
+    CHECK_NEAR(I2c_GetConversionTime(0), 2000, 150);
+    CHECK_NEAR(I2c_GetConversionTime(1), 1000, 150);
+    uint32_t starts = bus1.starts();
+    uint32_t conversions = sensor1.conversions();
+    
+    I2c_TestRun(50);
+    CHECK((bus1.starts() - starts) < 6 * (sensor1.conversions() - conversions));
+}
+
+I2C_TEST(sensors_learn_conversion_time)
+{
+    checkConversionLearned(false);
+}
+
+I2C_TEST(sensors_learn_conversion_time_lockstep)
+{
+    checkConversionLearned(true);
+}
+
+// A conversion still busy when the POLL gives up raises the estimate
+// past the time already waited; it is not learned from stale polls.
+static void checkPollExpiry(bool lockstep)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    struct i2c_stats_t stats;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    I2c_SetLockstep(lockstep);
+    I2c_SensorSetup();
+    I2c_TestRun(10);
+    CHECK(I2c_GetConversionTime(0) < 100);
+    
+    sensor1.setConversionTime(1000000000);
+    I2c_TestRun(300);
+    I2c_GetStats(stats);
+    CHECK(stats.channel[0].faults[I2C_FAULT_POLL] > 0);
+    CHECK(I2c_GetConversionTime(0) >= 20000);
+    CHECK(I2c_GetConversionTime(0) <= 100000);
+    CHECK(I2c_GetConversionTime(1) < 100);
+}
+
+I2C_TEST(sensors_poll_expiry_raises_estimate)
+{
+    checkPollExpiry(false);
+}
+
+I2C_TEST(sensors_poll_expiry_raises_estimate_lockstep)
+{
+    checkPollExpiry(true);
+}
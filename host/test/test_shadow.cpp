@@ -0,0 +1,96 @@
+#include <string.h>
+#include "i2c_test.h"
+#include "i2c_shadow.h"
+#include "i2c_highlevel.h"
+
+I2C_TEST(shadow_exact_block)
+{
+    I2cShadow shadow;
+    const uint8_t val[2] = {0x12, 0x34};
+    uint8_t out[2];
+    
+    CHECK(shadow.add(0xda, 0xA5, 2));
+    CHECK(!shadow.add(0xda, 0xA5, 5));
+    CHECK(!shadow.read(0xda, 0xA5, out, 2));
+    shadow.update(0xda, 0xA5, val, 2);
+    CHECK(shadow.read(0xda, 0xA5, out, 2));
+    CHECK(memcmp(out, val, 2) == 0);
+    CHECK(shadow.same(0xda, 0xA5, val, 2));
+    CHECK(!shadow.read(0xda, 0xA5, out, 1));
+    CHECK(!shadow.read(0xdc, 0xA5, out, 2));
+    CHECK_EQ(shadow.hits(), 2);
+    
+    shadow.invalidate(0xda);
+    CHECK(!shadow.cached(0xda, 0xA5, 2));
+}
+
+// Transfers that overlap an entry patch the bytes they cover.
+I2C_TEST(shadow_overlapping_update)
+{
+    I2cShadow shadow;
+    const uint8_t block[4] = {0x01, 0x02, 0x03, 0x04};
+    const uint8_t one[1] = {0x55};
+    uint8_t out[2];
+    
+    CHECK(shadow.add(0xda, 0xA5, 2));
+    CHECK(shadow.add(0xdc, 0xA5, 2));
+    
+    // a partly covered entry stays invalid
+    shadow.update(0xda, 0xA6, one, 1);
+    CHECK(!shadow.cached(0xda, 0xA5, 2));
+    
+    // a covering transfer fills it
+    shadow.update(0xda, 0xA4, block, 4);
+    CHECK(shadow.read(0xda, 0xA5, out, 2));
+    CHECK_EQ(out[0], 0x02);
+    CHECK_EQ(out[1], 0x03);
+    
+    // a valid one is patched
+    shadow.update(0xda, 0xA6, one, 1);
+    CHECK(shadow.read(0xda, 0xA5, out, 2));
+    CHECK_EQ(out[0], 0x02);
+    CHECK_EQ(out[1], 0x55);
+    shadow.update(0xda, 0xA4, one, 1);
+    shadow.update(0xda, 0xA7, one, 1);
+    CHECK(shadow.read(0xda, 0xA5, out, 2));
+    CHECK_EQ(out[0], 0x02);
+    CHECK_EQ(out[1], 0x55);
+    
+    // other devices are left alone
+    CHECK(!shadow.cached(0xdc, 0xA5, 2));
+}
+
+// A burst write across a shadowed register must not leave the old value
+// to be served.
+I2C_TEST(shadow_burst_write_over_entry)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    const uint8_t config[2] = {0x11, 0x22};
+    const uint8_t block[3] = {0x33, 0x44, 0x55};
+    uint8_t out[2];
+    
+    bus.attach(sensor);
+    CHECK(i2c.shadow(0x6d, 0x40, 2));
+    CHECK(i2c.writeBytes(0x40, config, 2));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK(i2c.writeBytes(0x41, block, 3));
+    CHECK(I2c_TestFinish(i2c));
+    
+    uint32_t starts = bus.starts();
+    
+    CHECK(i2c.readBytes(0x40, out, 2));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(bus.starts(), starts);
+    CHECK_EQ(i2c.shadowHits(), 1);
+    CHECK_EQ(out[0], sensor.reg(0x40));
+    CHECK_EQ(out[1], sensor.reg(0x41));
+    CHECK_EQ(out[1], 0x33);
+    
+    // writing the value it holds is skipped
+    CHECK(i2c.writeBytes(0x40, out, 2));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(bus.starts(), starts);
+    CHECK_EQ(i2c.shadowHits(), 2);
+}
@@ -0,0 +1,129 @@
+#include "i2c_test.h"
+#include "i2c_highlevel.h"
+#include "i2c_multibus.h"
+#include "i2c_sensors.h"
+
+I2C_TEST(fault_classes_highlevel)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    NackingSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    const uint8_t val[2] = {0x01, 0x02};
+    
+    bus.attach(sensor);
+    CHECK_EQ(i2c.fault(), I2C_FAULT_NONE);
+    
+    sensor.nack_at = 1;
+    CHECK(i2c.writeBytes(0x40, val, 2));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NACK);
+    CHECK_EQ(i2c.fault(), I2C_FAULT_NACK_REG);
+    
+    sensor.nack_at = 3;
+    CHECK(i2c.writeBytes(0x40, val, 2));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.fault(), I2C_FAULT_NACK_DATA);
+    
+    sensor.nack_at = 0;
+    CHECK(i2c.setAddress(0x22));
+    CHECK(i2c.read(0x06, 8));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.fault(), I2C_FAULT_NACK_ADDR);
+    
+    CHECK(i2c.setAddress(0x6d));
+    i2c.bus().setStretchTimeout(100);
+    sensor.setClockStretch(1000000);
+    CHECK(i2c.read(0x06, 8));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_TIMEOUT);
+    CHECK_EQ(i2c.fault(), I2C_FAULT_TIMEOUT);
+    
+    // a success clears it
+    sensor.setClockStretch(0);
+    wait_us(1000);
+    CHECK(i2c.recover());
+    CHECK(i2c.read(0x06, 8));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    CHECK_EQ(i2c.fault(), I2C_FAULT_NONE);
+}
+
+I2C_TEST(fault_classes_multibus)
+{
+    SimI2CBus bus1(TEST_SDA, TEST_SCL);
+    SimI2CBus bus2(TEST_SDA2, TEST_SCL2);
+    NackingSensor sensor1;
+    SimPressureSensor sensor2;
+    LowLevelI2C i2c1(TEST_SDA, TEST_SCL);
+    LowLevelI2C i2c2(TEST_SDA2, TEST_SCL2);
+    MultiBusI2C multi;
+    const uint8_t val[4] = {0x01, 0x02, 0x03, 0x04};
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    multi.attach(i2c1, 0x6d);
+    multi.attach(i2c2, 0x6d);
+    
+    sensor1.nack_at = 2;
+    CHECK(multi.writeBytes(0x40, val, 2));
+    CHECK(I2c_TestFinish(multi));
+    CHECK_EQ(multi.fault(0), I2C_FAULT_NACK_DATA);
+    CHECK_EQ(multi.fault(1), I2C_FAULT_NONE);
+    CHECK_EQ(sensor2.reg(0x41), 0x04);
+    
+    sensor1.nack_at = 1;
+    CHECK(multi.writeBytes(0x40, val, 2));
+    CHECK(I2c_TestFinish(multi));
+    CHECK_EQ(multi.fault(0), I2C_FAULT_NACK_REG);
+    CHECK_EQ(multi.fault(1), I2C_FAULT_NONE);
+}
+
+// Per-channel fault counts and per-bus traffic of the scheduler; the
+// sensor on bus 1 goes missing halfway.
+I2C_TEST(sensors_stats)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    NackingSensor sensor2;
+    struct i2c_stats_t stats;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    I2c_SetLockstep(false);
+    I2c_SensorSetup();
+    I2c_TestRun(20);
+    
+    I2c_GetStats(stats);
+    CHECK_EQ(stats.num_channels, 2);
+    CHECK_EQ(stats.num_buses, 2);
+    CHECK_NEAR(stats.elapsed_us, 20000, 2000);
+    for (int ch = 0; ch < 2; ch++)
+    {
+        CHECK(stats.channel[ch].samples > 10);
+        CHECK(stats.channel[ch].acquisitions >= stats.channel[ch].samples);
+        CHECK(stats.channel[ch].acquisitions <= stats.channel[ch].samples + 1);
+        for (int f = 0; f < I2C_NUM_FAULTS; f++) {
+            CHECK_EQ(stats.channel[ch].faults[f], 0);
+        }
+    }
+    for (int b = 0; b < 2; b++)
+    {
+        CHECK(stats.bus[b].transfers > 3 * stats.channel[b].samples);
+        CHECK(stats.bus[b].slots > 20 * stats.bus[b].transfers);
+        CHECK(stats.bus[b].utilization_pct > 1.0f);
+        CHECK(stats.bus[b].utilization_pct <= 100.0f);
+    }
+    CHECK_NEAR(stats.samples_per_s, (stats.channel[0].samples + stats.channel[1].samples) * 1e6 / stats.elapsed_us, 1.0);
+    
+    I2c_ResetStats();
+    sensor2.nack_at = 1;
+    I2c_TestRun(20);
+    I2c_GetStats(stats);
+    CHECK(stats.channel[0].samples > 10);
+    CHECK_EQ(stats.channel[1].samples, 0);
+    CHECK(stats.channel[1].faults[I2C_FAULT_NACK_REG] > 0);
+    CHECK_EQ(stats.channel[1].faults[I2C_FAULT_NACK_ADDR], 0);
+    CHECK_EQ(stats.channel[0].faults[I2C_FAULT_NACK_REG], 0);
+    CHECK(stats.channel[1].failures > 0);
+}
@@ -0,0 +1,112 @@
+#include "i2c_test.h"
+#include "i2c_ticker.h"
+#include "i2c_sensors.h"
+
+// Two buses read from the Ticker interrupt while the main code only
+// sleeps; loop() is never called from here.
+I2C_TEST(ticker_runs_transfers)
+{
+    SimI2CBus bus1(TEST_SDA, TEST_SCL);
+    SimI2CBus bus2(TEST_SDA2, TEST_SCL2);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    HighLevelI2C i2c1(TEST_SDA, TEST_SCL, 0x6d);
+    HighLevelI2C i2c2(TEST_SDA2, TEST_SCL2, 0x6d);
+    TickerI2C ticker;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    for (int i = 0; i < 3; i++)
+    {
+        sensor1.setReg(0x40 + i, 0x12 + 0x22 * i);
+        sensor2.setReg(0x40 + i, 0x65 - 0x22 * i);
+    }
+    CHECK_EQ(ticker.attach(i2c1), 0);
+    CHECK_EQ(ticker.attach(i2c2), 1);
+    CHECK(ticker.start());
+    CHECK(ticker.running());
+    CHECK(ticker.period() > 0);
+    CHECK_EQ(ticker.attach(i2c1), -1);
+    CHECK(!ticker.busy());
+    
+    CHECK(i2c1.read(0x40, 24));
+    CHECK(i2c2.read(0x40, 24));
+    ticker.submit();
+    CHECK(ticker.busy(0));
+    CHECK(ticker.busy(1));
+    for (int i = 0; (i < 10000) && ticker.busy(); i++) {
+        sleep();
+    }
+    CHECK(!ticker.busy());
+    CHECK_EQ(i2c1.error(), I2C_ERROR_NONE);
+    CHECK_EQ(i2c2.error(), I2C_ERROR_NONE);
+    CHECK_EQ(i2c1.get(), 0x123456);
+    CHECK_EQ(i2c2.get(), 0x654321);
+    
+    // an engine with nothing queued is handed back on the next tick
+    ticker.submit(0);
+    sleep();
+    CHECK(!ticker.busy(0));
+    
+    ticker.stop();
+    CHECK(!ticker.running());
+    CHECK(!ticker.busy());
+}
+
+I2C_TEST(ticker_stop_aborts_transfer)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    TickerI2C ticker;
+    
+    bus.attach(sensor);
+    CHECK(!ticker.start());
+    ticker.attach(i2c);
+    CHECK(ticker.start());
+    CHECK(i2c.read(0x06, 24));
+    ticker.submit(0);
+    sleep();
+    sleep();
+    ticker.stop();
+    CHECK(!ticker.busy());
+    CHECK(i2c.bus().ready());
+    
+    // the engine is back in main loop mode
+    I2c_TestFinish(i2c);
+    CHECK(i2c.read(0x06, 24));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+}
+
+I2C_TEST(sensors_interrupt_mode)
+{
+    SimI2CBus bus1(P1_6, P0_2);
+    SimI2CBus bus2(P1_10, P0_28);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    float p1 = 0;
+    float p2 = 0;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    sensor1.setPressure(512 * 1000);
+    sensor2.setPressure(-8 * 1000 * 100);
+    I2c_SetInterruptMode(true);
+    I2c_SensorSetup();
+    CHECK(!I2c_SensorError());
+    
+    // the application sleeps between scheduler calls
+    uint64_t end = Sim_TimeNs() + 20000000;
+    while (Sim_TimeNs() < end)
+    {
+        I2c_SensorLoop();
+        sleep();
+    }
+    
+    CHECK(I2c_Read_Pressure(p1));
+    CHECK(I2c_Read_O2(p2));
+    CHECK_NEAR(p1, 1.0, 0.0001);
+    CHECK_NEAR(p2, -100.0, 0.0001);
+    CHECK(sensor1.conversions() > 10);
+}
@@ -0,0 +1,106 @@
+#include <string.h>
+#include "i2c_test.h"
+#include "i2c_highlevel.h"
+#include "i2c_trace.h"
+
+// Only in the I2C_TRACE=1 build (i2c_test_trace).
+#if I2C_TRACE
+
+// The newest source of kind; the sensor scheduler has its own engines.
+static uint8_t findSource(const char *kind)
+{
+    for (int i = I2c_TraceNumSources() - 1; i > 0; i--)
+    {
+        if (strcmp(I2c_TraceSourceKind((uint8_t)i), kind) == 0) {
+            return (uint8_t)i;
+        }
+    }
+    return 0;
+}
+
+I2C_TEST(trace_records_transfer)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    static struct trace_event_t events[I2C_TRACE_SIZE];
+    // read() enters STATE_I2C_START itself; the trace has the states
+    // step() moves to
+    static const char *const expect[] = {
+        "STATE_I2C_ADDR", "STATE_I2C_REG", "STATE_I2C_RESTART",
+        "STATE_I2C_ADDR2", "STATE_I2C_READ_VAL", "STATE_I2C_STOP", "STATE_I2C_IDLE",
+    };
+    uint8_t engine = findSource("HighLevelI2C");
+    uint8_t pins = findSource("LowLevelI2C");
+    int states = 0;
+    int begins = 0;
+    int ends = 0;
+    int edges = 0;
+    
+    CHECK(engine != 0);
+    CHECK(pins != 0);
+    bus.attach(sensor);
+    I2c_TraceInit();
+    CHECK(i2c.read(0x06, 8));
+    CHECK(I2c_TestFinish(i2c));
+    I2c_TraceEnable(false);
+    
+    int n = I2c_TraceRead(events, I2C_TRACE_SIZE);
+    
+    CHECK(n > 0);
+    CHECK(n < I2C_TRACE_SIZE);
+    CHECK_EQ(I2c_TraceDropped(), 0);
+    for (int i = 0; i < n; i++)
+    {
+        const struct trace_event_t &ev = events[i];
+        
+        if (i > 0) {
+            CHECK((int32_t)(ev.cycles - events[i - 1].cycles) >= 0);
+        }
+        if ((ev.source == engine) && (ev.type == I2C_TRACE_STATE))
+        {
+            const char *name = I2c_TraceStateName(ev.source, ev.arg);
+            
+            CHECK(name != NULL);
+            if ((name != NULL) && (states < 7)) {
+                CHECK(strcmp(name, expect[states]) == 0);
+            }
+            states++;
+        }
+        begins += (ev.source == engine) && (ev.type == I2C_TRACE_LOOP_BEGIN);
+        ends += (ev.source == engine) && (ev.type == I2C_TRACE_LOOP_END);
+        edges += (ev.source == pins) && (ev.type == I2C_TRACE_PINS);
+    }
+    CHECK_EQ(states, 7);
+    CHECK_EQ(begins, ends);
+    CHECK(begins > 0);
+    
+    // a data and a clock change per bit slot at least
+    CHECK(edges >= 2 * (int)i2c.bus().slots());
+}
+
+// The buffer keeps the newest I2C_TRACE_SIZE events.
+I2C_TEST(trace_keeps_newest)
+{
+    static struct trace_event_t events[I2C_TRACE_SIZE];
+    
+    I2c_TraceInit();
+    for (int i = 0; i < I2C_TRACE_SIZE + 100; i++) {
+        I2C_TRACE_MARK(i);
+    }
+    I2c_TraceEnable(false);
+    I2C_TRACE_MARK(0xffff);
+    
+    CHECK_EQ(I2c_TraceDropped(), 100);
+    CHECK_EQ(I2c_TraceRead(events, I2C_TRACE_SIZE), I2C_TRACE_SIZE);
+    for (int i = 0; i < I2C_TRACE_SIZE; i++)
+    {
+        CHECK_EQ(events[i].source, 0);
+        CHECK_EQ(events[i].type, I2C_TRACE_MARK);
+        CHECK_EQ(events[i].arg, 100 + i);
+    }
+    CHECK_EQ(I2c_TraceRead(events, 10), 10);
+    CHECK_EQ(events[9].arg, I2C_TRACE_SIZE + 99);
+}
+
+#endif
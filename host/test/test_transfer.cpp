@@ -0,0 +1,101 @@
+#include <string.h>
+#include "i2c_test.h"
+#include "i2c_transfer.h"
+#include "i2c_highlevel.h"
+#include "i2c_multibus.h"
+
+typedef I2cReadTransfer<0x06, 3> DataRead;
+typedef I2cWriteTransfer<0x30, 1> StartWrite;
+typedef I2cPollTransfer<0x30, 0x08, 1000> BusyPoll;
+typedef I2cDelayTransfer<50> Settle;
+
+static uint8_t conv_start[] = {0x0A, 0x0A};
+static uint8_t conv_data[6];
+
+// Built from descriptors, the list is a constant table.
+static constexpr I2cCommand conversion[] = {
+    StartWrite::command(conv_start),
+    BusyPoll::command(),
+    Settle::command(),
+    DataRead::command(conv_data),
+};
+
+static_assert(conversion[0].op == I2C_CMD_WRITE, "descriptor op");
+static_assert(conversion[1].mask == 0x08, "descriptor mask");
+static_assert(conversion[3].reg == 0x06, "descriptor register");
+static_assert(DataRead::width == 3, "descriptor width");
+
+I2C_TEST(transfer_commands_match_entries)
+{
+    const I2cCommand entries[] = {
+        I2C_CMD_WRITE_ENTRY(0x30, conv_start, 1),
+        I2C_CMD_POLL_ENTRY(0x30, 0x08, 1000),
+        I2C_CMD_DELAY_ENTRY(50),
+        I2C_CMD_READ_ENTRY(0x06, conv_data, 3),
+    };
+    
+    for (int i = 0; i < 4; i++)
+    {
+        CHECK_EQ(conversion[i].op, entries[i].op);
+        CHECK_EQ(conversion[i].reg, entries[i].reg);
+        CHECK_EQ(conversion[i].mask, entries[i].mask);
+        CHECK_EQ(conversion[i].len, entries[i].len);
+        CHECK(conversion[i].src == entries[i].src);
+        CHECK(conversion[i].dst == entries[i].dst);
+    }
+}
+
+I2C_TEST(transfer_issue_highlevel)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    const uint8_t out[3] = {0x12, 0x34, 0x56};
+    uint8_t in[3];
+    
+    bus.attach(sensor);
+    CHECK((I2cWriteTransfer<0x40, 3>::issue(i2c, out)));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.error(), I2C_ERROR_NONE);
+    CHECK_EQ(sensor.reg(0x42), 0x56);
+    
+    CHECK((I2cReadTransfer<0x40, 3>::issue(i2c)));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(i2c.get(), 0x123456);
+    
+    memset(in, 0, sizeof(in));
+    CHECK((I2cReadTransfer<0x41, 2>::issue(i2c, in)));
+    CHECK(I2c_TestFinish(i2c));
+    CHECK_EQ(in[0], 0x34);
+    CHECK_EQ(in[1], 0x56);
+}
+
+// The descriptor list drives a whole conversion on both buses.
+I2C_TEST(transfer_list_multibus)
+{
+    SimI2CBus bus1(TEST_SDA, TEST_SCL);
+    SimI2CBus bus2(TEST_SDA2, TEST_SCL2);
+    SimPressureSensor sensor1;
+    SimPressureSensor sensor2;
+    LowLevelI2C i2c1(TEST_SDA, TEST_SCL);
+    LowLevelI2C i2c2(TEST_SDA2, TEST_SCL2);
+    MultiBusI2C multi;
+    
+    bus1.attach(sensor1);
+    bus2.attach(sensor2);
+    multi.attach(i2c1, 0x6d);
+    multi.attach(i2c2, 0x6d);
+    sensor1.setPressure(0x010203);
+    sensor2.setPressure(0x0A0B0C);
+    
+    CHECK(multi.run(conversion, 4));
+    CHECK(I2c_TestFinish(multi));
+    CHECK(!multi.error());
+    CHECK_EQ(multi.position(), 4);
+    CHECK_EQ(sensor1.conversions(), 1);
+    CHECK_EQ(sensor2.conversions(), 1);
+    CHECK_EQ(conv_data[0], 0x01);
+    CHECK_EQ(conv_data[2], 0x03);
+    CHECK_EQ(conv_data[3], 0x0A);
+    CHECK_EQ(conv_data[5], 0x0C);
+}
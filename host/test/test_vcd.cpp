@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <string.h>
+#include "i2c_test.h"
+#include "i2c_highlevel.h"
+#include "i2c_vcd.h"
+
+// Output of a writer or recorder, collected in memory.
+struct VcdCapture {
+    char *text;
+    size_t size;
+    FILE *out;
+    
+    VcdCapture(void) : text(NULL), size(0)
+    {
+        out = open_memstream(&text, &size);
+    }
+    ~VcdCapture()
+    {
+        close();
+        free(text);
+    }
+    void close(void)
+    {
+        if (out != NULL) {
+            fclose(out);
+        }
+        out = NULL;
+    }
+};
+
+I2C_TEST(vcd_writer_output)
+{
+    VcdCapture cap;
+    VcdWriter vcd(cap.out);
+    
+    CHECK_EQ(vcd.wire("bus0", "sda"), 0);
+    CHECK_EQ(vcd.text("engine", "state"), 1);
+    CHECK_EQ(vcd.wire("bus0", "scl"), 2);
+    vcd.header();
+    CHECK_EQ(vcd.wire("bus1", "sda"), -1);
+    vcd.change(0, 0, 1);
+    vcd.change(10, 2, 0);
+    vcd.change(10, 1, "IDLE");
+    vcd.change(5, 0, 0);
+    vcd.change(20, 3, 1);
+    vcd.change(20, 1, (const char *)NULL);
+    cap.close();
+    
+    CHECK(strcmp(cap.text,
+                 "$timescale 1 ns $end\n"
+                 "$scope module bus0 $end\n"
+                 "$var wire 1 ! sda $end\n"
+                 "$var wire 1 # scl $end\n"
+                 "$upscope $end\n"
+                 "$scope module engine $end\n"
+                 "$var string 1 \" state $end\n"
+                 "$upscope $end\n"
+                 "$enddefinitions $end\n#0\n$dumpvars\n"
+                 "x!\ns- \"\nx#\n$end\n"
+                 "1!\n"
+                 "#10\n0#\nsIDLE \"\n"
+                 "0!\n"
+                 "#20\ns? \"\n") == 0);
+}
+
+I2C_TEST(vcd_sim_records_transfer)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    VcdCapture cap;
+    
+    bus.attach(sensor);
+#if I2C_TRACE
+    I2c_TraceInit();
+#endif
+    {
+        SimVcd vcd(cap.out);
+        SimVcd other(cap.out);
+        
+        CHECK(vcd.start());
+        CHECK(!other.start());
+        CHECK(i2c.read(0x06, 8));
+        CHECK(I2c_TestFinish(i2c));
+        vcd.stop();
+        CHECK(i2c.read(0x06, 8));
+        CHECK(I2c_TestFinish(i2c));
+    }
+    cap.close();
+    
+    // bus0 is the only bus: sda is '!', scl '"'
+    int rising = 0;
+    int scl = -1;
+    char *line = strstr(cap.text, "$dumpvars");
+    
+    CHECK(line != NULL);
+    CHECK(strstr(cap.text, "$scope module bus0 $end") != NULL);
+    for (; line != NULL; line = strchr(line + 1, '\n'))
+    {
+        if ((line[1] == '1') && (line[2] == '"'))
+        {
+            rising += (scl == 0);
+            scl = 1;
+        }
+        else if ((line[1] == '0') && (line[2] == '"')) {
+            scl = 0;
+        }
+    }
+    // one clock pulse per bit of the first transfer only, plus the
+    // repeated START and the STOP
+    CHECK_EQ(rising, 4 * 9 + 2);
+#if I2C_TRACE
+    CHECK(strstr(cap.text, "sSTATE_I2C_READ_VAL") != NULL);
+#endif
+}
+
+#if I2C_TRACE
+
+// The trace buffer as VCD: pins of the LowLevelI2C and states of the
+// HighLevelI2C, in trace time.
+I2C_TEST(vcd_from_trace)
+{
+    SimI2CBus bus(TEST_SDA, TEST_SCL);
+    SimPressureSensor sensor;
+    HighLevelI2C i2c(TEST_SDA, TEST_SCL, 0x6d);
+    VcdCapture cap;
+    
+    bus.attach(sensor);
+    I2c_TraceInit();
+    CHECK(i2c.read(0x06, 8));
+    CHECK(I2c_TestFinish(i2c));
+    I2c_TraceEnable(false);
+    
+    CHECK(I2c_TraceVcd(cap.out) > 0);
+    cap.close();
+    CHECK(strstr(cap.text, "$var wire 1 ! sda $end") != NULL);
+    CHECK(strstr(cap.text, "$var string 1 # state $end") != NULL);
+    CHECK(strstr(cap.text, "sSTATE_I2C_STOP #") != NULL);
+}
+
+#endif
@@ -0,0 +1,119 @@
+#include "i2c_breaker.h"
+
+I2cBreaker::I2cBreaker(void)
+{
+    configure(1000, 64000, 8, 1000000);
+    reset();
+    resetStats();
+}
+
+// trip_failures 0 never opens the breaker.
+void I2cBreaker::configure(uint32_t base, uint32_t max, int trip, uint32_t probe)
+{
+    base_us = base;
+    max_us = (max > base) ? max : base;
+    trip_failures = trip;
+    probe_us = probe;
+}
+
+// Forgets the failures; the device is tried at the normal rate again.
+void I2cBreaker::reset(void)
+{
+    breaker_state = I2C_BREAKER_CLOSED;
+    num_failures = 0;
+    first_failure = 0;
+}
+
+void I2cBreaker::resetStats(void)
+{
+    num_trips = 0;
+    num_recoveries = 0;
+    recovery_us = 0;
+    max_recovery_us = 0;
+}
+
+// Counts a failed acquisition and returns how long to wait before the
+// next one.
+uint32_t I2cBreaker::failure(uint32_t now)
+{
+    if (num_failures == 0) {
+        first_failure = now;
+    }
+    if (num_failures < 0x7fffffff) {
+        num_failures++;
+    }
+    
+    if ((breaker_state == I2C_BREAKER_CLOSED) &&
+        ((trip_failures <= 0) || (num_failures < trip_failures)))
+    {
+        uint32_t delay = base_us;
+        
+        for (int i = 1; (i < num_failures) && (delay < max_us); i++) {
+            delay <<= 1;
+        }
+        return (delay < max_us) ? delay : max_us;
+    }
+    
+    if (breaker_state == I2C_BREAKER_CLOSED) {
+        num_trips++;
+    }
+    breaker_state = I2C_BREAKER_OPEN;
+    return probe_us;
+}
+
+// Closes the breaker. The time since the first failure in a row is the
+// recovery latency.
+void I2cBreaker::success(uint32_t now)
+{
+    if (num_failures != 0)
+    {
+        recovery_us = now - first_failure;
+        if (recovery_us > max_recovery_us) {
+            max_recovery_us = recovery_us;
+        }
+        num_recoveries++;
+    }
+    reset();
+}
+
+// An acquisition of the device starts; while open it is the probe.
+void I2cBreaker::probe(void)
+{
+    if (breaker_state == I2C_BREAKER_OPEN) {
+        breaker_state = I2C_BREAKER_HALF_OPEN;
+    }
+}
+
+int I2cBreaker::state(void)
+{
+    return breaker_state;
+}
+
+// Failed acquisitions in a row.
+int I2cBreaker::failures(void)
+{
+    return num_failures;
+}
+
+// Times the breaker opened.
+uint32_t I2cBreaker::trips(void)
+{
+    return num_trips;
+}
+
+// Successes after failures, and the latency of the last one and the
+// longest.
+uint32_t I2cBreaker::recoveries(void)
+{
+    return num_recoveries;
+}
+
+uint32_t I2cBreaker::recoveryUs(void)
+{
+    return recovery_us;
+}
+
+uint32_t I2cBreaker::maxRecoveryUs(void)
+{
+    return max_recovery_us;
+}
@@ -0,0 +1,44 @@
+#ifndef _I2C_BREAKER_H_
+#define _I2C_BREAKER_H_
+
+#include <stdint.h>
+#include "i2c_sensors.h"
+
+// Retry policy of one device. After a failed acquisition the next one
+// waits a delay that doubles with every failure in a row, from base_us
+// up to max_us. After trip_failures failures in a row the breaker opens
+// and the device is only probed every probe_us; a failed probe keeps it
+// open and the first success closes it again. Times are us_ticker_read()
+// microseconds.
+class I2cBreaker
+{
+public:
+    I2cBreaker(void);
+    void configure(uint32_t base, uint32_t max, int trip, uint32_t probe);
+    void reset(void);
+    void resetStats(void);
+    uint32_t failure(uint32_t now);
+    void success(uint32_t now);
+    void probe(void);
+    int state(void);
+    int failures(void);
+    uint32_t trips(void);
+    uint32_t recoveries(void);
+    uint32_t recoveryUs(void);
+    uint32_t maxRecoveryUs(void);
+
+private:
+    uint32_t base_us;
+    uint32_t max_us;
+    int trip_failures;
+    uint32_t probe_us;
+    int breaker_state;
+    int num_failures;
+    uint32_t first_failure;
+    uint32_t num_trips;
+    uint32_t num_recoveries;
+    uint32_t recovery_us;
+    uint32_t max_recovery_us;
+};
+
+#endif
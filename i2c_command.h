@@ -0,0 +1,168 @@
+#ifndef _I2C_COMMAND_H_
+#define _I2C_COMMAND_H_
+
+#include "mbed.h"
+
+enum I2cCommandOp {
+    I2C_CMD_READ = 0,
+    I2C_CMD_WRITE,
+    I2C_CMD_POLL,
+    I2C_CMD_DELAY,
+};
+
+// One entry of a command list run by HighLevelI2C::run() or
+// MultiBusI2C::run().
+//   I2C_CMD_READ:  read len bytes from reg into dst
+//   I2C_CMD_WRITE: write len bytes from src to reg
+//   I2C_CMD_POLL:  re-read the byte at reg until (byte & mask) == 0,
+//                  at most len times (0 = no limit)
+//   I2C_CMD_DELAY: let the bus idle for len microseconds
+// With MultiBusI2C, src/dst hold one block of len bytes per bus.
+struct I2cCommand {
+    int op;
+    uint8_t reg;
+    uint8_t mask;
+    int len;
+    const uint8_t *src;
+    uint8_t *dst;
+};
+
+#define I2C_CMD_READ_ENTRY(r, d, n)  {.op = I2C_CMD_READ, .reg = r, .mask = 0, .len = n, .src = NULL, .dst = d}
+#define I2C_CMD_WRITE_ENTRY(r, s, n) {.op = I2C_CMD_WRITE, .reg = r, .mask = 0, .len = n, .src = s, .dst = NULL}
+#define I2C_CMD_POLL_ENTRY(r, m, n)  {.op = I2C_CMD_POLL, .reg = r, .mask = m, .len = n, .src = NULL, .dst = NULL}
+#define I2C_CMD_DELAY_ENTRY(us)      {.op = I2C_CMD_DELAY, .reg = 0, .mask = 0, .len = us, .src = NULL, .dst = NULL}
+
+// Walks a command list on behalf of a transaction engine. step() is
+// called from the engine's loop() whenever it has no transfer in
+// progress: it checks the result of the previous command and starts the
+// next one. The engine provides readBytes()/writeBytes() plus the
+// failed() (stop the list) and pollPending()/pollExpired() hooks.
+class I2cScript
+{
+public:
+    I2cScript(void)
+    {
+        stop();
+        poll_count = 0;
+        poll_time = 0;
+    }
+    void start(const I2cCommand *list, int n)
+    {
+        cmds = list;
+        num = n;
+        index = 0;
+        retries = 0;
+        issued = false;
+        poll_count = 0;
+        poll_time = 0;
+    }
+    void stop(void)
+    {
+        cmds = NULL;
+        num = 0;
+        index = 0;
+        retries = 0;
+        issued = false;
+    }
+    bool active(void)
+    {
+        return (index < num);
+    }
+    int position(void)
+    {
+        return index;
+    }
+    // Reads the last finished POLL command of the current list took, and
+    // the us_ticker_read() time it found the bits clear; 0 until one
+    // finished.
+    int polls(void)
+    {
+        return poll_count;
+    }
+    uint32_t polledAt(void)
+    {
+        return poll_time;
+    }
+    
+    template <class Engine>
+    void step(Engine &engine)
+    {
+        if (index >= num) {
+            return;
+        }
+        
+        if (issued)
+        {
+            const I2cCommand &cmd = cmds[index];
+            
+            if (engine.failed())
+            {
+                num = index;
+                return;
+            }
+            if (cmd.op == I2C_CMD_DELAY)
+            {
+                if ((us_ticker_read() - delay_start) < (uint32_t)cmd.len) {
+                    return;
+                }
+            }
+            else if ((cmd.op == I2C_CMD_POLL) && engine.pollPending(cmd.mask))
+            {
+                retries++;
+                if ((cmd.len != 0) && (retries >= cmd.len))
+                {
+                    engine.pollExpired(cmd.mask);
+                    num = index;
+                    return;
+                }
+                engine.readBytes(cmd.reg, NULL, 1);
+                return;
+            }
+            else if (cmd.op == I2C_CMD_POLL)
+            {
+                poll_count = retries + 1;
+                poll_time = us_ticker_read();
+            }
+            issued = false;
+            retries = 0;
+            index++;
+            if (index >= num) {
+                return;
+            }
+        }
+        
+        const I2cCommand &cmd = cmds[index];
+        
+        switch (cmd.op)
+        {
+        case I2C_CMD_READ:
+            engine.readBytes(cmd.reg, cmd.dst, cmd.len);
+            break;
+            
+        case I2C_CMD_WRITE:
+            engine.writeBytes(cmd.reg, cmd.src, cmd.len);
+            break;
+            
+        case I2C_CMD_POLL:
+            engine.readBytes(cmd.reg, NULL, 1);
+            break;
+            
+        case I2C_CMD_DELAY:
+            delay_start = us_ticker_read();
+            break;
+        }
+        issued = true;
+    }
+
+private:
+    const I2cCommand *cmds;
+    int num;
+    int index;
+    int retries;
+    bool issued;
+    uint32_t delay_start;
+    int poll_count;
+    uint32_t poll_time;
+};
+
+#endif
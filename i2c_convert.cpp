@@ -0,0 +1,70 @@
+#include "i2c_convert.h"
+
+// Counts per Pa as a power of two, indexed by SensorI2CType.
+static const uint8_t type_shift[] = {
+    11,     // Pos2k5Pa: 2^23 / 2^11 = 4096 Pa full scale
+    10,     // Pos5kPa
+    9,      // Pos10kPa
+    8,      // Pos20kPa
+    7,      // Pos40kPa
+    6,      // Pos100kPa
+    5,      // Pos200kPa
+    4,      // Pos500kPa
+    3,      // Pos700kPa
+    3,      // Pos1000kPa
+};
+
+SensorScale::SensorScale(void)
+{
+    set(65536, 0);
+}
+
+void SensorScale::set(int64_t m, int sh)
+{
+    mult = m;
+    shift = sh;
+    round = (sh > 0) ? ((int64_t)1 << (sh - 1)) : 0;
+}
+
+PressureScale::PressureScale(void)
+{
+    setType(Pos10kPa);
+}
+
+void PressureScale::setType(enum SensorI2CType type)
+{
+    if ((type < 0) || (type >= (int)sizeof(type_shift))) {
+        return;
+    }
+    shift = type_shift[type];
+    pa_round = (int32_t)1 << (shift - 1);
+    q16_round = (int64_t)1 << (23 + shift);
+}
+
+// Batch conversions for buffered samples.
+void PressureScale::convert(const int32_t *raw, int32_t *kpa_q16, int n) const
+{
+    for (int i = 0; i < n; i++) {
+        kpa_q16[i] = kpaQ16(raw[i]);
+    }
+}
+
+void PressureScale::convertPa(const int32_t *raw, int32_t *pa, int n) const
+{
+    for (int i = 0; i < n; i++) {
+        pa[i] = this->pa(raw[i]);
+    }
+}
+
+void PressureScale::convert(const int32_t *raw, float *kpa, int n) const
+{
+    for (int i = 0; i < n; i++) {
+        kpa[i] = this->kpa(raw[i]);
+    }
+}
+
+// The kpaQ16() conversion as a SensorScale.
+void PressureScale::scale(SensorScale &s) const
+{
+    s.set(KPA_Q16_MULT, 24 + shift);
+}
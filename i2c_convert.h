@@ -0,0 +1,69 @@
+#ifndef _I2C_CONVERT_H_
+#define _I2C_CONVERT_H_
+
+#include <stdint.h>
+#include "i2c_sensors.h"
+
+// Linear conversion of raw readings to Q16.16 values in the unit of a
+// sensor driver: (raw * mult) >> shift, rounded to nearest. Set up once
+// per channel (I2cSensorDriver::scale()), then one multiply per sample.
+class SensorScale
+{
+public:
+    SensorScale(void);
+    void set(int64_t mult, int shift);
+    
+    int32_t q16(int32_t raw) const
+    {
+        return (int32_t)((((int64_t)raw * mult) + round) >> shift);
+    }
+    // raw with frac fractional bits
+    int32_t q16(int32_t raw, int frac) const
+    {
+        return (int32_t)((((int64_t)raw * mult) + (((int64_t)1 << (shift + frac)) >> 1)) >> (shift + frac));
+    }
+
+private:
+    int64_t mult;
+    int64_t round;
+    int shift;
+};
+
+// Integer conversion of raw 24-bit readings of the 0x6d sensor family.
+// The type is resolved to a shift once (setType()), so converting a
+// sample is a shift or one 32x32->64 bit multiply, no division and no
+// float. Results are Pa as int32 or kPa in Q16.16 (65536 = 1 kPa).
+class PressureScale
+{
+public:
+    PressureScale(void);
+    void setType(enum SensorI2CType type);
+    
+    int32_t pa(int32_t raw) const
+    {
+        return (raw + pa_round) >> shift;
+    }
+    int32_t kpaQ16(int32_t raw) const
+    {
+        return (int32_t)((((int64_t)raw * KPA_Q16_MULT) + q16_round) >> (24 + shift));
+    }
+    float kpa(int32_t raw) const
+    {
+        return kpaQ16(raw) * (1.0f / 65536.0f);
+    }
+    
+    void convert(const int32_t *raw, int32_t *kpa_q16, int n) const;
+    void convertPa(const int32_t *raw, int32_t *pa, int n) const;
+    void convert(const int32_t *raw, float *kpa, int n) const;
+    void scale(SensorScale &s) const;
+
+private:
+    // round(2^40 / 1000): raw / 2^shift is in Pa
+    static const int64_t KPA_Q16_MULT = 1099511628;
+    
+    int shift;
+    int32_t pa_round;
+    int64_t q16_round;
+};
+
+#endif
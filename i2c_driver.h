@@ -0,0 +1,207 @@
+#ifndef _I2C_DRIVER_H_
+#define _I2C_DRIVER_H_
+
+#include <type_traits>
+#include "i2c_command.h"
+#include "i2c_convert.h"
+#include "i2c_sensors.h"
+
+// Per-bus command lists are tables of I2C_MAX_BUSES rows; the row of bus
+// i uses block i of the driver's buffers, so MultiBusI2C runs row 0 on
+// every selected bus. I2C_PER_BUS(M) expands to the rows M(0) .. M(3).
+static_assert(I2C_MAX_BUSES == 4, "I2C_PER_BUS does not cover I2C_MAX_BUSES");
+#define I2C_PER_BUS(M) {M(0), M(1), M(2), M(3)}
+
+// Base of the sensor drivers run by the acquisition scheduler. A driver
+// is a class of static members deriving from I2cSensorDriver<itself>;
+// the scheduler reaches it through an I2cDriverTable, so every call is
+// resolved at compile time. An acquisition is:
+//
+//   prepare(engine)        optional transfer before the start, e.g. a
+//                          configuration read (default: none)
+//   configure(bus, value)  gets the value prepare() read (get()), fills
+//                          the start buffers of bus and returns a key of
+//                          the settings the conversion time depends on
+//   startScript(bus)       START_LEN commands that start a conversion
+//   fetchScript(bus)       FETCH_LEN commands that wait for the end of
+//                          the conversion (a POLL) and read the result
+//   decode(bus)            the raw reading from the fetch buffers
+//   scale(param, scale)    conversion of raw readings to Q16.16 in the
+//                          driver's unit; param comes from registration
+//
+// SHADOW_REG/SHADOW_LEN name a register block that only changes when
+// the driver writes it (-1: none), see I2cShadow.
+template <class Derived>
+class I2cSensorDriver
+{
+public:
+    static constexpr int SHADOW_REG = -1;
+    static constexpr int SHADOW_LEN = 0;
+    
+    // An empty list completes at once, without touching the bus.
+    template <class Engine>
+    static bool prepare(Engine &engine)
+    {
+        return engine.run(NULL, 0);
+    }
+    
+    static uint32_t configure(int bus, uint32_t value)
+    {
+        (void)bus;
+        (void)value;
+        return 0;
+    }
+    
+    template <class Engine>
+    static bool start(Engine &engine, int bus)
+    {
+        return engine.run(Derived::startScript(bus), Derived::START_LEN);
+    }
+    
+    template <class Engine>
+    static bool fetch(Engine &engine, int bus)
+    {
+        return engine.run(Derived::fetchScript(bus), Derived::FETCH_LEN);
+    }
+    
+    static bool shadow(uint8_t &reg, int &n)
+    {
+        reg = (uint8_t)Derived::SHADOW_REG;
+        n = Derived::SHADOW_LEN;
+        return (Derived::SHADOW_REG >= 0) && (Derived::SHADOW_LEN > 0);
+    }
+};
+
+// The drivers of a build, numbered in list order. Each call takes the
+// driver number and passes on to that driver; with the number known the
+// chain folds to a direct call, otherwise it is a row of compares.
+template <class... Drivers>
+struct I2cDriverTable;
+
+template <>
+struct I2cDriverTable<>
+{
+    static constexpr int size = 0;
+    
+    template <class Driver>
+    static constexpr int index(void)
+    {
+        return 0;
+    }
+    
+    template <class Engine>
+    static bool prepare(int d, Engine &engine)
+    {
+        (void)d;
+        (void)engine;
+        return false;
+    }
+    
+    template <class Engine>
+    static bool start(int d, Engine &engine, int bus)
+    {
+        (void)d;
+        (void)engine;
+        (void)bus;
+        return false;
+    }
+    
+    template <class Engine>
+    static bool fetch(int d, Engine &engine, int bus)
+    {
+        (void)d;
+        (void)engine;
+        (void)bus;
+        return false;
+    }
+    
+    static uint32_t configure(int d, int bus, uint32_t value)
+    {
+        (void)d;
+        (void)bus;
+        (void)value;
+        return 0;
+    }
+    
+    static int32_t decode(int d, int bus)
+    {
+        (void)d;
+        (void)bus;
+        return 0;
+    }
+    
+    static void scale(int d, int param, SensorScale &s)
+    {
+        (void)d;
+        (void)param;
+        (void)s;
+    }
+    
+    static bool shadow(int d, uint8_t &reg, int &n)
+    {
+        (void)d;
+        (void)reg;
+        (void)n;
+        return false;
+    }
+};
+
+template <class First, class... Rest>
+struct I2cDriverTable<First, Rest...>
+{
+    typedef I2cDriverTable<Rest...> Next;
+    
+    static constexpr int size = 1 + Next::size;
+    
+    // Number of Driver; size when it is not in the table.
+    template <class Driver>
+    static constexpr int index(void)
+    {
+        return std::is_same<Driver, First>::value ? 0 : (1 + Next::template index<Driver>());
+    }
+    
+    template <class Engine>
+    static bool prepare(int d, Engine &engine)
+    {
+        return (d == 0) ? First::prepare(engine) : Next::prepare(d - 1, engine);
+    }
+    
+    template <class Engine>
+    static bool start(int d, Engine &engine, int bus)
+    {
+        return (d == 0) ? First::start(engine, bus) : Next::start(d - 1, engine, bus);
+    }
+    
+    template <class Engine>
+    static bool fetch(int d, Engine &engine, int bus)
+    {
+        return (d == 0) ? First::fetch(engine, bus) : Next::fetch(d - 1, engine, bus);
+    }
+    
+    static uint32_t configure(int d, int bus, uint32_t value)
+    {
+        return (d == 0) ? First::configure(bus, value) : Next::configure(d - 1, bus, value);
+    }
+    
+    static int32_t decode(int d, int bus)
+    {
+        return (d == 0) ? First::decode(bus) : Next::decode(d - 1, bus);
+    }
+    
+    static void scale(int d, int param, SensorScale &s)
+    {
+        if (d == 0) {
+            First::scale(param, s);
+        }
+        else {
+            Next::scale(d - 1, param, s);
+        }
+    }
+    
+    static bool shadow(int d, uint8_t &reg, int &n)
+    {
+        return (d == 0) ? First::shadow(reg, n) : Next::shadow(d - 1, reg, n);
+    }
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef _I2C_FASTPIN_H_
+#define _I2C_FASTPIN_H_
+
+#include "mbed.h"
+
+// Open-drain pin layer used by LowLevelI2C. A line is driven low by
+// making the pin an output (its OUT bit is kept cleared) and released by
+// making it an input again, so the external pull-up sets the high level.
+
+// Pin on top of the mbed HAL.
+class DigitalPin
+{
+public:
+    DigitalPin(PinName pin) : io(pin)
+    {
+        io.input();
+        io.mode(PullNone);
+    }
+    void drive(void)
+    {
+        io.output();
+        io = 0;
+    }
+    void release(void)
+    {
+        io.input();
+    }
+    int read(void)
+    {
+        return io;
+    }
+
+private:
+    DigitalInOut io;
+};
+
+#if I2C_FASTPIN
+
+class GpioBatch;
+
+// Register-level pin with the port and mask held at run time, so
+// LowLevelI2C instances on different pins can share one type and
+// MultiBusI2C can drive them through a shared GpioBatch. Each access is
+// one store to (or load from) a GPIO register.
+class GpioPin
+{
+public:
+    GpioPin(PinName pin) : port((pin < 32) ? NRF_P0 : NRF_P1), mask(1u << (pin & 31))
+    {
+        config(port, pin & 31);
+    }
+    inline void drive(void)
+    {
+        port->DIRSET = mask;
+    }
+    inline void release(void)
+    {
+        port->DIRCLR = mask;
+    }
+    inline int read(void)
+    {
+        return (port->IN & mask) ? 1 : 0;
+    }
+
+    // Released, OUT bit cleared for driving low, input buffer connected.
+    static void config(NRF_GPIO_Type *port, int index)
+    {
+        port->DIRCLR = 1u << index;
+        port->OUTCLR = 1u << index;
+        port->PIN_CNF[index] =
+            (GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos) |
+            (GPIO_PIN_CNF_INPUT_Connect << GPIO_PIN_CNF_INPUT_Pos) |
+            (GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
+            (GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
+            (GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos);
+    }
+
+private:
+    friend class GpioBatch;
+    
+    NRF_GPIO_Type *port;
+    uint32_t mask;
+};
+
+#define GPIO_BATCH_PORTS 2
+
+// Pin changes of several GpioPins collected over one edge and applied
+// with one DIRCLR and one DIRSET write per port, and one IN read per
+// port for the lines sampled after it (see MultiBusI2C).
+class GpioBatch
+{
+public:
+    GpioBatch(void) : used(0)
+    {
+        for (int p = 0; p < GPIO_BATCH_PORTS; p++)
+        {
+            drive_mask[p] = 0;
+            release_mask[p] = 0;
+            in[p] = 0;
+        }
+    }
+    // Ports to sample() are those of the pins used here.
+    void use(const GpioPin &pin)
+    {
+        used |= 1u << index(pin);
+    }
+    inline void drive(const GpioPin &pin)
+    {
+        drive_mask[index(pin)] |= pin.mask;
+    }
+    inline void release(const GpioPin &pin)
+    {
+        release_mask[index(pin)] |= pin.mask;
+    }
+    void apply(void)
+    {
+        for (int p = 0; p < GPIO_BATCH_PORTS; p++)
+        {
+            if (release_mask[p] != 0)
+            {
+                port(p)->DIRCLR = release_mask[p];
+                release_mask[p] = 0;
+            }
+            if (drive_mask[p] != 0)
+            {
+                port(p)->DIRSET = drive_mask[p];
+                drive_mask[p] = 0;
+            }
+        }
+    }
+    void sample(void)
+    {
+        for (int p = 0; p < GPIO_BATCH_PORTS; p++)
+        {
+            if (used & (1u << p)) {
+                in[p] = port(p)->IN;
+            }
+        }
+    }
+    // Level at the last sample().
+    inline int read(const GpioPin &pin)
+    {
+        return (in[index(pin)] & pin.mask) ? 1 : 0;
+    }
+
+private:
+    static inline int index(const GpioPin &pin)
+    {
+        return (pin.port == NRF_P0) ? 0 : 1;
+    }
+    static inline NRF_GPIO_Type *port(int p)
+    {
+        return (p == 0) ? NRF_P0 : NRF_P1;
+    }
+    
+    uint32_t used;
+    uint32_t drive_mask[GPIO_BATCH_PORTS];
+    uint32_t release_mask[GPIO_BATCH_PORTS];
+    uint32_t in[GPIO_BATCH_PORTS];
+};
+
+typedef GpioPin I2cPin;
+
+#else
+
+typedef DigitalPin I2cPin;
+
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+#include "i2c_filter.h"
+
+SampleFilter::SampleFilter(void)
+{
+    config.median = 0;
+    config.average = 0;
+    config.iir_shift = 0;
+    config.decimate = 0;
+    reset();
+}
+
+// Stages set to 0 or 1 (iir_shift 0) pass samples through. Windows hold
+// up to I2C_FILTER_MAX_TAPS samples, IIR shifts go up to 16.
+bool SampleFilter::configure(const struct filter_config_t &cfg)
+{
+    if ((cfg.median < 0) || (cfg.median > I2C_FILTER_MAX_TAPS) ||
+        (cfg.average < 0) || (cfg.average > I2C_FILTER_MAX_TAPS) ||
+        (cfg.iir_shift < 0) || (cfg.iir_shift > 16) || (cfg.decimate < 0)) {
+        return false;
+    }
+    config = cfg;
+    reset();
+    return true;
+}
+
+void SampleFilter::reset(void)
+{
+    med_count = 0;
+    med_pos = 0;
+    avg_sum = 0;
+    avg_count = 0;
+    avg_pos = 0;
+    iir_acc = 0;
+    iir_valid = false;
+    dec_count = 0;
+}
+
+// Runs one raw reading through the stages. Returns true with the result
+// in out (I2C_FILTER_FRAC fractional bits) when the decimation lets a
+// sample through.
+bool SampleFilter::push(int32_t raw, int32_t &out)
+{
+    int32_t x = raw * (1 << I2C_FILTER_FRAC);
+    
+    if (config.median > 1) {
+        x = median(x);
+    }
+    if (config.average > 1) {
+        x = average(x);
+    }
+    if (config.iir_shift > 0) {
+        x = iir(x);
+    }
+    
+    if (config.decimate > 1)
+    {
+        if (++dec_count < config.decimate) {
+            return false;
+        }
+        dec_count = 0;
+    }
+    out = x;
+    return true;
+}
+
+// The oldest sample leaves the sorted window and the new one is inserted
+// in its place, shifting the entries in between by one.
+int32_t SampleFilter::median(int32_t x)
+{
+    int n = med_count;
+    int i;
+    
+    if (med_count == config.median)
+    {
+        int32_t old = med_window[med_pos];
+        
+        i = 0;
+        while (med_sorted[i] != old) {
+            i++;
+        }
+        for (; i < (n - 1); i++) {
+            med_sorted[i] = med_sorted[i + 1];
+        }
+        n--;
+    }
+    else {
+        med_count++;
+    }
+    med_window[med_pos] = x;
+    med_pos = (med_pos + 1) % config.median;
+    
+    for (i = n; (i > 0) && (med_sorted[i - 1] > x); i--) {
+        med_sorted[i] = med_sorted[i - 1];
+    }
+    med_sorted[i] = x;
+    
+    // even windows take the mean of the middle pair
+    n = med_count;
+    if (n & 1) {
+        return med_sorted[n / 2];
+    }
+    return (int32_t)(((int64_t)med_sorted[(n / 2) - 1] + med_sorted[n / 2]) / 2);
+}
+
+int32_t SampleFilter::average(int32_t x)
+{
+    if (avg_count == config.average) {
+        avg_sum -= avg_window[avg_pos];
+    }
+    else {
+        avg_count++;
+    }
+    avg_window[avg_pos] = x;
+    avg_pos = (avg_pos + 1) % config.average;
+    avg_sum += x;
+    
+    return (int32_t)(avg_sum / avg_count);
+}
+
+// y += (x - y) / 2^shift, kept with shift extra bits so small steps
+// are not lost; starts at the first sample.
+int32_t SampleFilter::iir(int32_t x)
+{
+    if (!iir_valid)
+    {
+        iir_acc = (int64_t)x << config.iir_shift;
+        iir_valid = true;
+    }
+    else {
+        iir_acc += x - (iir_acc >> config.iir_shift);
+    }
+    return (int32_t)(iir_acc >> config.iir_shift);
+}
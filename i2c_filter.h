@@ -0,0 +1,50 @@
+#ifndef _I2C_FILTER_H_
+#define _I2C_FILTER_H_
+
+#include <stdint.h>
+#include "i2c_sensors.h"
+
+// Fractional bits of the filter values; raw readings of up to 24 bits
+// keep 8 bits of the resolution oversampling adds.
+#define I2C_FILTER_FRAC 8
+
+// Filter pipeline of one channel, fed with every good raw reading as it
+// is acquired (see filter_config_t): median, moving average, first-order
+// IIR, decimation. Every stage costs O(1) per sample but the median,
+// which keeps its window sorted (O(window)). Values are raw counts with
+// I2C_FILTER_FRAC fractional bits; until a window is full it works on
+// the samples it has.
+class SampleFilter
+{
+public:
+    SampleFilter(void);
+    bool configure(const struct filter_config_t &cfg);
+    void reset(void);
+    bool push(int32_t raw, int32_t &out);
+    
+private:
+    int32_t median(int32_t x);
+    int32_t average(int32_t x);
+    int32_t iir(int32_t x);
+    
+    struct filter_config_t config;
+    
+    // median: the window in arrival order and sorted
+    int32_t med_window[I2C_FILTER_MAX_TAPS];
+    int32_t med_sorted[I2C_FILTER_MAX_TAPS];
+    int med_count;
+    int med_pos;
+    
+    int32_t avg_window[I2C_FILTER_MAX_TAPS];
+    int64_t avg_sum;
+    int avg_count;
+    int avg_pos;
+    
+    // output << iir_shift
+    int64_t iir_acc;
+    bool iir_valid;
+    
+    int dec_count;
+};
+
+#endif
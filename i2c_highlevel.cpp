@@ -2,184 +2,245 @@
 
 enum {
     STATE_I2C_IDLE = 0,
-    STATE_I2C_WRITE8_START,
-    STATE_I2C_WRITE8_STOP,
-    STATE_I2C_WRITE8_ADDR,
-    STATE_I2C_WRITE8_REG,
-    STATE_I2C_WRITE8_VAL,
-    STATE_I2C_WRITE16_START,
-    STATE_I2C_WRITE16_STOP,
-    STATE_I2C_WRITE16_ADDR,
-    STATE_I2C_WRITE16_REG,
-    STATE_I2C_WRITE16_VAL_MSB,
-    STATE_I2C_WRITE16_VAL_LSB,
-    STATE_I2C_READ8_START,
-    STATE_I2C_READ8_STOP,
-    STATE_I2C_READ8_ADDR,
-    STATE_I2C_READ8_REG,
-    STATE_I2C_READ8_RESTART,
-    STATE_I2C_READ8_ADDR2,
-    STATE_I2C_READ8_VAL,
-    STATE_I2C_READ16_START,
-    STATE_I2C_READ16_STOP,
-    STATE_I2C_READ16_ADDR,
-    STATE_I2C_READ16_REG,
-    STATE_I2C_READ16_RESTART,
-    STATE_I2C_READ16_ADDR2,
-    STATE_I2C_READ16_VAL_MSB,
-    STATE_I2C_READ16_VAL_LSB,
-    STATE_I2C_READ24_START,
-    STATE_I2C_READ24_STOP,
-    STATE_I2C_READ24_ADDR,
-    STATE_I2C_READ24_REG,
-    STATE_I2C_READ24_RESTART,
-    STATE_I2C_READ24_ADDR2,
-    STATE_I2C_READ24_VAL_MSB,
-    STATE_I2C_READ24_VAL_CSB,
-    STATE_I2C_READ24_VAL_LSB,
+    STATE_I2C_START,
+    STATE_I2C_STOP,
+    STATE_I2C_ADDR,
+    STATE_I2C_REG,
+    STATE_I2C_RESTART,
+    STATE_I2C_ADDR2,
+    STATE_I2C_WRITE_VAL,
+    STATE_I2C_READ_VAL,
 };
 
-struct StateName {
-    int state;
-    const char *name;
-};
-
-#define STATE_NAME_ENTRY(x) {.state = x, .name = #x}
-#define STATE_NAME_ENTRY_SENTINEL {.name = NULL}
-
-static StateName stateNames[] = {
+static const StateName stateNames[] = {
     STATE_NAME_ENTRY(STATE_I2C_IDLE),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE8_START),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE8_STOP),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE8_ADDR),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE8_REG),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE8_VAL),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE16_START),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE16_STOP),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE16_ADDR),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE16_REG),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE16_VAL_MSB),
-    STATE_NAME_ENTRY(STATE_I2C_WRITE16_VAL_LSB),
-    STATE_NAME_ENTRY(STATE_I2C_READ8_START),
-    STATE_NAME_ENTRY(STATE_I2C_READ8_STOP),
-    STATE_NAME_ENTRY(STATE_I2C_READ8_ADDR),
-    STATE_NAME_ENTRY(STATE_I2C_READ8_REG),
-    STATE_NAME_ENTRY(STATE_I2C_READ8_RESTART),
-    STATE_NAME_ENTRY(STATE_I2C_READ8_ADDR2),
-    STATE_NAME_ENTRY(STATE_I2C_READ8_VAL),
-    STATE_NAME_ENTRY(STATE_I2C_READ16_START),
-    STATE_NAME_ENTRY(STATE_I2C_READ16_STOP),
-    STATE_NAME_ENTRY(STATE_I2C_READ16_ADDR),
-    STATE_NAME_ENTRY(STATE_I2C_READ16_REG),
-    STATE_NAME_ENTRY(STATE_I2C_READ16_RESTART),
-    STATE_NAME_ENTRY(STATE_I2C_READ16_ADDR2),
-    STATE_NAME_ENTRY(STATE_I2C_READ16_VAL_MSB),
-    STATE_NAME_ENTRY(STATE_I2C_READ16_VAL_LSB),
-    STATE_NAME_ENTRY(STATE_I2C_READ24_START),
-    STATE_NAME_ENTRY(STATE_I2C_READ24_STOP),
-    STATE_NAME_ENTRY(STATE_I2C_READ24_ADDR),
-    STATE_NAME_ENTRY(STATE_I2C_READ24_REG),
-    STATE_NAME_ENTRY(STATE_I2C_READ24_RESTART),
-    STATE_NAME_ENTRY(STATE_I2C_READ24_ADDR2),
-    STATE_NAME_ENTRY(STATE_I2C_READ24_VAL_MSB),
-    STATE_NAME_ENTRY(STATE_I2C_READ24_VAL_CSB),
-    STATE_NAME_ENTRY(STATE_I2C_READ24_VAL_LSB),
+    STATE_NAME_ENTRY(STATE_I2C_START),
+    STATE_NAME_ENTRY(STATE_I2C_STOP),
+    STATE_NAME_ENTRY(STATE_I2C_ADDR),
+    STATE_NAME_ENTRY(STATE_I2C_REG),
+    STATE_NAME_ENTRY(STATE_I2C_RESTART),
+    STATE_NAME_ENTRY(STATE_I2C_ADDR2),
+    STATE_NAME_ENTRY(STATE_I2C_WRITE_VAL),
+    STATE_NAME_ENTRY(STATE_I2C_READ_VAL),
     STATE_NAME_ENTRY_SENTINEL,
 };
 
+static_assert(sizeof(stateNames) / sizeof(stateNames[0]) - 1 <= I2C_LATENCY_STATES,
+              "latency histograms do not cover all states");
+
 void HighLevelI2C::resetTimings(void)
 {
-    max_state_duration.state = 0;
-    max_state_duration.duration_us = 0;
-    max_state_duration.state_name = NULL;
+    state_timer.reset();
 }
 
 bool HighLevelI2C::timings(struct timing_t &tm)
 {
-    int i = 0;
-    
-    while(stateNames[i].name != NULL)
-    {
-        if (stateNames[i].state == max_state_duration.state)
-        {
-            tm = max_state_duration;
-            tm.state_name = stateNames[i].name;
-            return true;
-        }
-        i++;
-    }
-    
-    tm.duration_us = 0;
-    tm.state = -1;
-    tm.state_name = NULL;
-    return false;
+    return state_timer.timings(tm);
+}
+
+const char *HighLevelI2C::stateName(int state)
+{
+    return I2cStateTimer::name(stateNames, state);
+}
+
+bool HighLevelI2C::latency(int index, struct latency_t &lt)
+{
+    return state_timer.latency(index, lt);
+}
+
+int HighLevelI2C::latencyBuckets(int index, uint32_t *counts)
+{
+    return state_timer.buckets(index, counts);
 }
 
-HighLevelI2C::HighLevelI2C(PinName sda, PinName scl, int addr) : i2c(sda, scl)
+HighLevelI2C::HighLevelI2C(PinName sda, PinName scl, int addr) : i2c(sda, scl), state_timer(stateNames)
 {
     i2c_addr  = (uint8_t)((addr << 1) & 0xFE);
     i2c_val   = 0x0;
     i2c_reg   = 0x0;
-    i2c_error = false;
+    i2c_error = I2C_ERROR_NONE;
+    i2c_fault = I2C_FAULT_NONE;
     i2c_ack   = false;
     i2c_state = STATE_I2C_IDLE;
-    resetTimings();
+    num_transfers = 0;
+    i2c_write = false;
+    i2c_src   = NULL;
+    i2c_dst   = NULL;
+    i2c_len   = 0;
+    i2c_pos   = 0;
+    I2C_TRACE_INIT_SOURCE(trace_source, "HighLevelI2C", stateName);
 }
 
-bool HighLevelI2C::read(uint8_t reg, int len)
+// Slave address of the following transfers; only while idle, so several
+// devices can share one bus.
+bool HighLevelI2C::setAddress(int addr)
 {
-    if (i2c_state != STATE_I2C_IDLE) {
+    if ((i2c_state != STATE_I2C_IDLE) || script.active()) {
         return false;
     }
-    switch (len)
-    {
-    case 8:
-        i2c_state = STATE_I2C_READ8_START;
-        break;
-        
-    case 16:
-        i2c_state = STATE_I2C_READ16_START;
-        break;
-        
-    case 24:
-        i2c_state = STATE_I2C_READ24_START;
-        break;
-        
-    default:
+    i2c_addr = (uint8_t)((addr << 1) & 0xFE);
+    return true;
+}
+
+bool HighLevelI2C::setup(uint8_t reg, int n, bool wr)
+{
+    if ((i2c_state != STATE_I2C_IDLE) || (n <= 0)) {
         return false;
     }
     i2c_val   = 0x0;
     i2c_reg   = reg;
-    i2c_error = false;
+    i2c_error = I2C_ERROR_NONE;
+    i2c_fault = I2C_FAULT_NONE;
     i2c_ack   = false;
+    i2c_write = wr;
+    i2c_len   = n;
+    i2c_pos   = 0;
+    i2c_state = STATE_I2C_START;
     return true;
 }
 
-bool HighLevelI2C::write(uint8_t reg, uint8_t val, int len)
+// A NULL dst keeps up to 4 bytes in the internal buffer, see get().
+bool HighLevelI2C::readBytes(uint8_t reg, uint8_t *dst, int n)
 {
-    if (i2c_state != STATE_I2C_IDLE) {
+    if ((dst == NULL) && (n > (int)sizeof(i2c_buf))) {
         return false;
     }
-    switch (len)
+    if (!setup(reg, n, false)) {
+        return false;
+    }
+    i2c_dst = (dst != NULL) ? dst : i2c_buf;
+    
+    // served from the shadow: done without touching the bus
+    if (i2c_shadow.read(i2c_addr, reg, i2c_dst, n))
     {
-    case 8:
-        i2c_state = STATE_I2C_WRITE8_START;
-        break;
-        
-    case 16:
-        i2c_state = STATE_I2C_WRITE16_START;
-        break;
-        
-    default:
+        for (int i = 0; i < n; i++) {
+            i2c_val = (i2c_val << 8) | i2c_dst[i];
+        }
+        i2c_state = STATE_I2C_IDLE;
+    }
+    return true;
+}
+
+bool HighLevelI2C::writeBytes(uint8_t reg, const uint8_t *src, int n)
+{
+    if (!setup(reg, n, true)) {
         return false;
     }
-    i2c_val   = val;
-    i2c_reg   = reg;
-    i2c_error = false;
-    i2c_ack   = false;
+    i2c_src = src;
+    
+    // the device already holds these bytes
+    if (i2c_shadow.same(i2c_addr, reg, src, n))
+    {
+        i2c_ack = true;
+        i2c_state = STATE_I2C_IDLE;
+    }
     return true;
 }
 
+// Caches n bytes from reg of the device at addr, see I2cShadow.
+bool HighLevelI2C::shadow(int addr, uint8_t reg, int n)
+{
+    return i2c_shadow.add((uint8_t)((addr << 1) & 0xFE), reg, n);
+}
+
+void HighLevelI2C::invalidate(void)
+{
+    i2c_shadow.invalidate();
+}
+
+uint32_t HighLevelI2C::shadowHits(void)
+{
+    return i2c_shadow.hits();
+}
+
+// Keeps the shadow in step with the device after a transfer.
+void HighLevelI2C::finish(void)
+{
+    num_transfers++;
+    if (i2c_error) {
+        i2c_shadow.invalidate(i2c_addr);
+    }
+    else if (i2c_write) {
+        i2c_shadow.update(i2c_addr, i2c_reg, i2c_src, i2c_len);
+    }
+    else {
+        i2c_shadow.update(i2c_addr, i2c_reg, i2c_dst, i2c_len);
+    }
+}
+
+// len is in bits (8, 16, 24 or 32); the value is sent MSB first.
+bool HighLevelI2C::read(uint8_t reg, int len)
+{
+    if ((len <= 0) || (len > 32) || (len % 8)) {
+        return false;
+    }
+    return readBytes(reg, NULL, len / 8);
+}
+
+bool HighLevelI2C::write(uint8_t reg, uint32_t val, int len)
+{
+    if ((i2c_state != STATE_I2C_IDLE) || (len <= 0) || (len > 32) || (len % 8)) {
+        return false;
+    }
+    int n = len / 8;
+    
+    for (int i = 0; i < n; i++) {
+        i2c_buf[i] = (uint8_t)(val >> (8 * (n - 1 - i)));
+    }
+    return writeBytes(reg, i2c_buf, n);
+}
+
+// Runs the commands back to back from loop() until the list is done or a
+// command fails; the list and its buffers must stay valid until then.
+bool HighLevelI2C::run(const I2cCommand *list, int n)
+{
+    if ((i2c_state != STATE_I2C_IDLE) || script.active()) {
+        return false;
+    }
+    i2c_error = I2C_ERROR_NONE;
+    i2c_fault = I2C_FAULT_NONE;
+    script.start(list, n);
+    script.step(*this);
+    return true;
+}
+
+// Index of the command being run, or of the one that failed.
+int HighLevelI2C::position(void)
+{
+    return script.position();
+}
+
+// Reads needed by the last finished POLL command of the current list (1
+// when the bits were already clear, 0 before one finished) and the
+// us_ticker_read() time they cleared.
+int HighLevelI2C::polls(void)
+{
+    return script.polls();
+}
+
+uint32_t HighLevelI2C::polledAt(void)
+{
+    return script.polledAt();
+}
+
+bool HighLevelI2C::failed(void)
+{
+    return (i2c_error != I2C_ERROR_NONE);
+}
+
+bool HighLevelI2C::pollPending(uint8_t mask)
+{
+    return (i2c_val & mask);
+}
+
+void HighLevelI2C::pollExpired(uint8_t mask)
+{
+    (void)mask;
+    i2c_error = I2C_ERROR_POLL;
+    i2c_fault = I2C_FAULT_POLL;
+    i2c_shadow.invalidate(i2c_addr);
+}
+
 uint32_t HighLevelI2C::get(void)
 {
     return i2c_val;
@@ -190,378 +251,169 @@ bool HighLevelI2C::ack(void)
     return i2c_ack;
 }
 
-bool HighLevelI2C::error(void)
+int HighLevelI2C::error(void)
 {
     return i2c_error;
 }
 
+// I2cFault of the last failed transfer or command list, I2C_FAULT_NONE
+// after a success.
+int HighLevelI2C::fault(void)
+{
+    return i2c_fault;
+}
+
+// Transfers that reached the bus (not served from the shadow), failed
+// ones included.
+uint32_t HighLevelI2C::transfers(void)
+{
+    return num_transfers;
+}
+
 bool HighLevelI2C::recover(void)
 {
     return i2c.recover();
 }
 
+// Moves on after a byte was sent, or ends the transfer with a STOP when
+// the slave did not acknowledge it.
+void HighLevelI2C::next(bool ack, int state)
+{
+    if (ack) {
+        i2c_state = state;
+    }
+    else
+    {
+        i2c_fault = I2c_NackFault(i2c_state, STATE_I2C_REG, STATE_I2C_WRITE_VAL);
+        i2c_state = STATE_I2C_STOP;
+        i2c_error = I2C_ERROR_NACK;
+    }
+}
+
+LowLevelI2C &HighLevelI2C::bus(void)
+{
+    return i2c;
+}
+
+bool HighLevelI2C::busy(void)
+{
+    return ((i2c_state != STATE_I2C_IDLE) || script.active());
+}
+
 bool HighLevelI2C::loop(void)
+{
+    return state_timer.loop(*this);
+}
+
+// See I2cStateTimer::loop(Engine &, int, int).
+int HighLevelI2C::loop(int budget, int unit)
+{
+    return state_timer.loop(*this, budget, unit);
+}
+
+// One state machine step; returns 1 when it clocked a bit slot, 0 when
+// it only loaded the next byte or had nothing to do.
+int HighLevelI2C::step(void)
 {
     int old_state = i2c_state;
-    uint32_t aux;
+    int bits = 1;
+    uint8_t aux;
     bool ret;
     
-    timer.reset();
-    timer.start();
+    if ((i2c_state == STATE_I2C_IDLE) ||
+        (i2c.ready() && (i2c_state != STATE_I2C_START) &&
+         (i2c_state != STATE_I2C_RESTART) && (i2c_state != STATE_I2C_STOP))) {
+        bits = 0;
+    }
     
     switch(i2c_state)
     {
-    case STATE_I2C_WRITE8_START:
+    case STATE_I2C_START:
         i2c.start();
-        i2c_state = STATE_I2C_WRITE8_ADDR;
-        break;
-        
-    case STATE_I2C_WRITE8_STOP:
-        i2c.stop();
-        i2c_state = STATE_I2C_IDLE;
-        break;
-        
-    case STATE_I2C_WRITE8_ADDR:
-        ret = i2c.write(i2c_addr);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_WRITE8_REG;
-            }
-            else {
-                i2c_state = STATE_I2C_WRITE8_STOP;
-                i2c_error = true;
-            }
-        }
-        break;
-        
-    case STATE_I2C_WRITE8_REG:
-        ret = i2c.write(i2c_reg);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_WRITE8_VAL;
-            }
-            else {
-                i2c_state = STATE_I2C_WRITE8_STOP;
-                i2c_error = true;
-            }
-        }
-        break;
-        
-    case STATE_I2C_WRITE8_VAL:
-        ret = i2c.write(i2c_val & 0xFF);
-        if (i2c.ready())
-        {
-            i2c_ack = ret;
-            
-            if (!i2c_ack) {
-                i2c_error = true;
-            }
-            
-            i2c_state = STATE_I2C_WRITE8_STOP;
+        if (i2c.ready()) {
+            i2c_state = STATE_I2C_ADDR;
         }
         break;
         
-    case STATE_I2C_WRITE16_START:
+    case STATE_I2C_RESTART:
         i2c.start();
-        i2c_state = STATE_I2C_WRITE16_ADDR;
-        break;
-        
-    case STATE_I2C_WRITE16_STOP:
-        i2c.stop();
-        i2c_state = STATE_I2C_IDLE;
-        break;
-        
-    case STATE_I2C_WRITE16_ADDR:
-        ret = i2c.write(i2c_addr);
-        if (i2c.ready())
-        {
-            if (ret){
-                i2c_state = STATE_I2C_WRITE16_REG;
-            }
-            else {
-                i2c_state = STATE_I2C_WRITE16_STOP;
-                i2c_error = true;
-            }
-        }
-        break;
-        
-    case STATE_I2C_WRITE16_REG:
-        ret = i2c.write(i2c_reg);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_WRITE16_VAL_MSB;
-            }
-            else {
-                i2c_state = STATE_I2C_WRITE16_STOP;
-                i2c_error = true;
-            }
-        }
-        break;
-    
-    case STATE_I2C_WRITE16_VAL_MSB:
-        ret = i2c.write((i2c_val >> 8) & 0xFF);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_WRITE16_VAL_LSB;
-            }
-            else {
-                i2c_state = STATE_I2C_WRITE16_STOP;
-                i2c_error = true;
-            }
+        if (i2c.ready()) {
+            i2c_state = STATE_I2C_ADDR2;
         }
         break;
         
-    case STATE_I2C_WRITE16_VAL_LSB:
-        ret = i2c.write(i2c_val & 0xFF);
-        if (i2c.ready())
-        {
-            i2c_ack = ret;
-            
-            if (!i2c_ack) {
-                i2c_error = true;
-            }
-            
-            i2c_state = STATE_I2C_WRITE16_STOP;
-        }
-        break;
-    
-    case STATE_I2C_READ8_START:
-        i2c.start();
-        i2c_state = STATE_I2C_READ8_ADDR;
-        break;
-        
-    case STATE_I2C_READ8_STOP:
+    case STATE_I2C_STOP:
         i2c.stop();
-        i2c_state = STATE_I2C_IDLE;
-        break;
-        
-    case STATE_I2C_READ8_ADDR:
-        ret = i2c.write(i2c_addr);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_READ8_REG;
-            }
-            else {
-                i2c_state = STATE_I2C_READ8_STOP;
-                i2c_error = true;
-            }
-        }
-        break;
-        
-    case STATE_I2C_READ8_REG:
-        ret = i2c.write(i2c_reg);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_READ8_RESTART;
-            }
-            else {
-                i2c_state = STATE_I2C_READ8_STOP;
-                i2c_error = true;
-            }
+        if (i2c.ready()) {
+            i2c_state = STATE_I2C_IDLE;
         }
         break;
         
-    case STATE_I2C_READ8_RESTART:
-        i2c.start();
-        i2c_state = STATE_I2C_READ8_ADDR2;
-        break;
-        
-    case STATE_I2C_READ8_ADDR2:
-        ret = i2c.write(i2c_addr | 0x01);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_READ8_VAL;
-            }
-            else {
-                i2c_state = STATE_I2C_READ8_STOP;
-                i2c_error = true;
-            }
-        }
-        break;
-        
-    case STATE_I2C_READ8_VAL:
-        aux = ((uint32_t)(i2c.read(false))) & 0xFF;
-        if (i2c.ready())
-        {
-            i2c_val = aux;
-            i2c_state = STATE_I2C_READ8_STOP;
-        }
-        break;
-    
-    case STATE_I2C_READ16_START:
-        i2c.start();
-        i2c_state = STATE_I2C_READ16_ADDR;
-        break;
-        
-    case STATE_I2C_READ16_STOP:
-        i2c.stop();
-        i2c_state = STATE_I2C_IDLE;
-        break;
-        
-    case STATE_I2C_READ16_ADDR:
+    case STATE_I2C_ADDR:
         ret = i2c.write(i2c_addr);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_READ16_REG;
-            }
-            else {
-                i2c_state = STATE_I2C_READ16_STOP;
-                i2c_error = true;
-            }
+        if (i2c.ready()) {
+            next(ret, STATE_I2C_REG);
         }
         break;
         
-    case STATE_I2C_READ16_REG:
+    case STATE_I2C_REG:
         ret = i2c.write(i2c_reg);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_READ16_RESTART;
-            }
-            else {
-                i2c_state = STATE_I2C_READ16_STOP;
-                i2c_error = true;
-            }
+        if (i2c.ready()) {
+            next(ret, i2c_write ? STATE_I2C_WRITE_VAL : STATE_I2C_RESTART);
         }
         break;
         
-    case STATE_I2C_READ16_RESTART:
-        i2c.start();
-        i2c_state = STATE_I2C_READ16_ADDR2;
-        break;
-        
-    case STATE_I2C_READ16_ADDR2:
+    case STATE_I2C_ADDR2:
         ret = i2c.write(i2c_addr | 0x01);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_READ16_VAL_MSB;
-            }
-            else {
-                i2c_state = STATE_I2C_READ16_STOP;
-                i2c_error = true;
-            }
-        }
-        break;
-    
-    case STATE_I2C_READ16_VAL_MSB:
-        aux = ((uint32_t)(i2c.read(true))) & 0xFF;
-        if (i2c.ready())
-        {
-            i2c_val = (aux << 8) & 0xFF00;
-            i2c_state = STATE_I2C_READ16_VAL_LSB;
-        }
-        break;
-    
-    case STATE_I2C_READ16_VAL_LSB:
-        aux = ((uint32_t)(i2c.read(false))) & 0xFF;
-        if (i2c.ready())
-        {
-            i2c_val |= aux & 0xFF;
-            i2c_state = STATE_I2C_READ16_STOP;
-        }
-        break;
-        
-    case STATE_I2C_READ24_START:
-        i2c.start();
-        i2c_state = STATE_I2C_READ24_ADDR;
-        break;
-        
-    case STATE_I2C_READ24_STOP:
-        i2c.stop();
-        i2c_state = STATE_I2C_IDLE;
-        break;
-        
-    case STATE_I2C_READ24_ADDR:
-        ret = i2c.write(i2c_addr);
-        if (i2c.ready())
-        {
-            if (ret) {
-                i2c_state = STATE_I2C_READ24_REG;
-            }
-            else {
-                i2c_state = STATE_I2C_READ24_STOP;
-                i2c_error = true;
-            }
+        if (i2c.ready()) {
+            next(ret, STATE_I2C_READ_VAL);
         }
         break;
         
-    case STATE_I2C_READ24_REG:
-        ret = i2c.write(i2c_reg);
+    case STATE_I2C_WRITE_VAL:
+        ret = i2c.write(i2c_src[i2c_pos]);
         if (i2c.ready())
         {
-            if (ret) {
-                i2c_state = STATE_I2C_READ24_RESTART;
-            }
-            else {
-                i2c_state = STATE_I2C_READ24_STOP;
-                i2c_error = true;
-            }
+            i2c_ack = ret;
+            i2c_pos++;
+            next(ret, (i2c_pos < i2c_len) ? STATE_I2C_WRITE_VAL : STATE_I2C_STOP);
         }
         break;
         
-    case STATE_I2C_READ24_RESTART:
-        i2c.start();
-        i2c_state = STATE_I2C_READ24_ADDR2;
-        break;
-        
-    case STATE_I2C_READ24_ADDR2:
-        ret = i2c.write(i2c_addr | 0x01);
+    case STATE_I2C_READ_VAL:
+        // ACK every byte but the last one
+        aux = i2c.read(i2c_pos < (i2c_len - 1));
         if (i2c.ready())
         {
-            if (ret) {
-                i2c_state = STATE_I2C_READ24_VAL_MSB;
-            }
-            else {
-                i2c_state = STATE_I2C_READ24_STOP;
-                i2c_error = true;
+            i2c_dst[i2c_pos++] = aux;
+            i2c_val = (i2c_val << 8) | aux;
+            if (i2c_pos >= i2c_len) {
+                i2c_state = STATE_I2C_STOP;
             }
         }
         break;
-        
-    case STATE_I2C_READ24_VAL_MSB:
-        aux = ((uint32_t)(i2c.read(true))) & 0xFF;
-        if (i2c.ready())
-        {
-            i2c_val = (aux << 16) & 0xFF0000;
-            i2c_state = STATE_I2C_READ24_VAL_CSB;
-        }
-        break;
-    
-    case STATE_I2C_READ24_VAL_CSB:
-        aux = ((uint32_t)(i2c.read(true))) & 0xFF;
-        if (i2c.ready())
-        {
-            i2c_val |= (aux << 8) & 0xFF00;
-            i2c_state = STATE_I2C_READ24_VAL_LSB;
-        }
-        break;
+    }
     
-    case STATE_I2C_READ24_VAL_LSB:
-        aux = ((uint32_t)(i2c.read(false))) & 0xFF;
-        if (i2c.ready())
-        {
-            i2c_val |= aux;
-            i2c_state = STATE_I2C_READ24_STOP;
-        }
-        break;
+    // A slave holding SCL past the stretch timeout aborts the transfer;
+    // no STOP can be clocked while SCL is stuck low.
+    if (i2c.timeout() && (old_state != STATE_I2C_IDLE))
+    {
+        i2c.abort();
+        i2c_error = I2C_ERROR_TIMEOUT;
+        i2c_fault = I2C_FAULT_TIMEOUT;
+        i2c_state = STATE_I2C_IDLE;
     }
     
-    timer.stop();
+    if ((old_state != STATE_I2C_IDLE) && (i2c_state == STATE_I2C_IDLE)) {
+        finish();
+    }
     
-    if (timer.read_us() > max_state_duration.duration_us)
-    {
-        max_state_duration.duration_us = timer.read_us();
-        max_state_duration.state = old_state;
+    if (i2c_state == STATE_I2C_IDLE) {
+        script.step(*this);
+    }
+    if (i2c_state != old_state) {
+        I2C_TRACE_EVENT(trace_source, I2C_TRACE_STATE, i2c_state);
     }
     
-    return (i2c_state != STATE_I2C_IDLE);
+    return bits;
 }
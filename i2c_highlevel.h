@@ -2,6 +2,10 @@
 #define _I2C_HIGHLEVEL_H_
 
 #include "i2c_lowlevel.h"
+#include "i2c_command.h"
+#include "i2c_shadow.h"
+#include "i2c_state.h"
+#include "i2c_trace.h"
 #include "i2c_sensors.h"
 
 class HighLevelI2C
@@ -9,26 +13,65 @@ class HighLevelI2C
 public:
     bool timings(struct timing_t &tm);
     void resetTimings(void);
+    bool latency(int index, struct latency_t &lt);
+    int latencyBuckets(int index, uint32_t *counts);
+    static const char *stateName(int state);
 
     HighLevelI2C(PinName sda, PinName scl, int addr);
-    bool write(uint8_t reg, uint8_t val, int len);
+    bool setAddress(int addr);
+    bool write(uint8_t reg, uint32_t val, int len);
     bool read(uint8_t reg, int len);
+    bool writeBytes(uint8_t reg, const uint8_t *src, int n);
+    bool readBytes(uint8_t reg, uint8_t *dst, int n);
+    bool run(const I2cCommand *list, int n);
+    int position(void);
+    int polls(void);
+    uint32_t polledAt(void);
     uint32_t get(void);
     bool loop(void);
+    int loop(int budget, int unit);
+    bool busy(void);
     bool ack(void);
-    bool error(void);
+    int error(void);
+    int fault(void);
+    uint32_t transfers(void);
     bool recover(void);
+    bool shadow(int addr, uint8_t reg, int n);
+    void invalidate(void);
+    uint32_t shadowHits(void);
+    LowLevelI2C &bus(void);
     
 private:
+    friend class I2cScript;
+    friend class I2cStateTimer;
+    
+    bool setup(uint8_t reg, int n, bool wr);
+    bool failed(void);
+    bool pollPending(uint8_t mask);
+    void pollExpired(uint8_t mask);
+    void next(bool ack, int state);
+    int step(void);
+    void finish(void);
+    
     LowLevelI2C i2c;
-    Timer timer;
     int i2c_state;
     uint32_t i2c_val;
     uint8_t i2c_reg;
     uint8_t i2c_addr;
-    bool i2c_error;
+    int i2c_error;
+    int i2c_fault;
+    uint32_t num_transfers;
     bool i2c_ack;
-    struct timing_t max_state_duration;
+    bool i2c_write;
+    const uint8_t *i2c_src;
+    uint8_t *i2c_dst;
+    int i2c_len;
+    int i2c_pos;
+    uint8_t i2c_buf[4];
+    I2cScript script;
+    I2cShadow i2c_shadow;
+    I2cStateTimer state_timer;
+    I2C_TRACE_SOURCE(trace_source);
 };
 
 #endif
@@ -0,0 +1,114 @@
+#include "i2c_latency.h"
+
+LatencyHistogram::LatencyHistogram(void)
+{
+    seq = 0;
+    reset();
+}
+
+void LatencyHistogram::reset(void)
+{
+    seq++;
+    count = 0;
+    min_us = 0;
+    max_us = 0;
+    for (int k = 0; k < I2C_LATENCY_BUCKETS; k++) {
+        counts[k] = 0;
+    }
+    seq++;
+}
+
+// seq is odd while an update is under way, so a reader that overlapped
+// one sees it changed and copies again.
+void LatencyHistogram::record(uint32_t us)
+{
+    int k = (us == 0) ? 0 : (32 - __builtin_clz(us));
+    
+    if (k >= I2C_LATENCY_BUCKETS) {
+        k = I2C_LATENCY_BUCKETS - 1;
+    }
+    
+    seq++;
+    if ((count == 0) || (us < min_us)) {
+        min_us = us;
+    }
+    if (us > max_us) {
+        max_us = us;
+    }
+    counts[k]++;
+    count++;
+    seq++;
+}
+
+void LatencyHistogram::snapshot(Copy &c)
+{
+    uint32_t s;
+    
+    do {
+        s = seq;
+        c.count = count;
+        c.min_us = min_us;
+        c.max_us = max_us;
+        for (int k = 0; k < I2C_LATENCY_BUCKETS; k++) {
+            c.counts[k] = counts[k];
+        }
+    } while ((s & 1) || (seq != s));
+}
+
+// Largest duration bucket k holds.
+uint32_t LatencyHistogram::bucketLimit(int k)
+{
+    return (k == 0) ? 0 : ((1u << k) - 1);
+}
+
+// Upper limit of the bucket holding the pct-th percentile, clamped to
+// the observed range: exact at min and max, within a factor of 2 between.
+uint32_t LatencyHistogram::percentile(const Copy &c, int pct)
+{
+    uint32_t rank = (uint32_t)(((uint64_t)c.count * pct + 99) / 100);
+    uint32_t seen = 0;
+    
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (int k = 0; k < I2C_LATENCY_BUCKETS; k++)
+    {
+        seen += c.counts[k];
+        if (seen >= rank)
+        {
+            uint32_t us = bucketLimit(k);
+            
+            if ((k == I2C_LATENCY_BUCKETS - 1) || (us > c.max_us)) {
+                us = c.max_us;
+            }
+            return (us < c.min_us) ? c.min_us : us;
+        }
+    }
+    return c.max_us;
+}
+
+// Fills the counters of lt; false when nothing was recorded yet.
+bool LatencyHistogram::stats(struct latency_t &lt)
+{
+    Copy c;
+    
+    snapshot(c);
+    lt.count = c.count;
+    lt.min_us = c.min_us;
+    lt.max_us = c.max_us;
+    lt.p50_us = (c.count != 0) ? percentile(c, 50) : 0;
+    lt.p99_us = (c.count != 0) ? percentile(c, 99) : 0;
+    return (c.count != 0);
+}
+
+// Copies the I2C_LATENCY_BUCKETS bucket counts and returns the total.
+int LatencyHistogram::buckets(uint32_t *out)
+{
+    Copy c;
+    
+    snapshot(c);
+    for (int k = 0; k < I2C_LATENCY_BUCKETS; k++) {
+        out[k] = c.counts[k];
+    }
+    return (int)c.count;
+}
@@ -0,0 +1,45 @@
+#ifndef _I2C_LATENCY_H_
+#define _I2C_LATENCY_H_
+
+#include <stdint.h>
+#include "i2c_sensors.h"
+
+// Bucket 0 counts 0 us, bucket k (k >= 1) counts 2^(k-1) .. 2^k - 1 us;
+// the last bucket also takes everything longer.
+#define I2C_LATENCY_BUCKETS 24
+
+// Highest state number + 1 of the bus engines.
+#define I2C_LATENCY_STATES 9
+
+// Log2-bucketed histogram of durations in us. record() may run in an
+// interrupt; stats() and buckets() take a consistent copy from any
+// context without stopping or resetting the collection.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram(void);
+    void reset(void);
+    void record(uint32_t us);
+    bool stats(struct latency_t &lt);
+    int buckets(uint32_t *counts);
+    static uint32_t bucketLimit(int k);
+
+private:
+    struct Copy {
+        uint32_t count;
+        uint32_t min_us;
+        uint32_t max_us;
+        uint32_t counts[I2C_LATENCY_BUCKETS];
+    };
+    
+    void snapshot(Copy &c);
+    static uint32_t percentile(const Copy &c, int pct);
+    
+    volatile uint32_t seq;
+    volatile uint32_t count;
+    volatile uint32_t min_us;
+    volatile uint32_t max_us;
+    volatile uint32_t counts[I2C_LATENCY_BUCKETS];
+};
+
+#endif
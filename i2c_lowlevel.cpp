@@ -1,21 +1,38 @@
 #include "i2c_lowlevel.h"
 
-enum {
-    CMD_IDLE = 0,
-    CMD_WRITE,
-    CMD_READ,
-};
+#define CALIBRATION_SLOTS 256
+#define STRETCH_TIMEOUT_US 1000
+
+// Lines as driven by us for I2C_TRACE_PINS: 1 = released.
+#define TRACE_PINS ((sda_input ? 0x01 : 0x00) | (scl_input ? 0x02 : 0x00))
 
 LowLevelI2C::LowLevelI2C(PinName sda, PinName scl) : pin_sda(sda), pin_scl(scl)
 {
-    pin_scl.input();
-    pin_scl.mode(PullNone);
-    pin_sda.input();
-    pin_sda.mode(PullNone);
+    init();
+}
+
+void LowLevelI2C::init(void)
+{
+    pin_scl.release();
+    pin_sda.release();
     scl_input = true;
     sda_input = true;
     command = CMD_IDLE;
     step = 0;
+    overhead_ns = 0;
+    setSpeed(I2C_SPEED_400KHZ);
+    setStretchTimeout(STRETCH_TIMEOUT_US);
+    scl_timeout = false;
+    tick_mode = false;
+    phase = PHASE_DATA;
+    stretching = false;
+    stretch_start = 0;
+    num_slots = 0;
+#if I2C_FASTPIN
+    batch = NULL;
+    scl_wait = false;
+#endif
+    I2C_TRACE_INIT_SOURCE(trace_source, "LowLevelI2C", NULL);
 }
 
 bool LowLevelI2C::ready(void)
@@ -27,35 +44,13 @@ bool LowLevelI2C::write(uint8_t val)
 {
     if (command == CMD_IDLE)
     {
-        command = CMD_WRITE;
-        i2c_value = val;
-        i2c_ack = false;
-        step = 0;
-    }
-    else if (step < 8)
-    {
-        if (i2c_value & 0x80) {
-            setSDA();
-        }
-        else {
-            clearSDA();
+        begin(CMD_WRITE, val, false);
+        if (tick_mode) {
+            halfStep();
         }
-        delay();
-        setSCL();
-        delay();
-        clearSCL();
-        i2c_value <<= 1;
-        step++;
     }
-    else
-    {
-        setSDA();
-        delay();
-        setSCL();
-        delay();
-        i2c_ack = (getSDA() != 1);
-        clearSCL();
-        command = CMD_IDLE;
+    else {
+        slot();
     }
     return i2c_ack;
 }
@@ -64,116 +59,443 @@ uint8_t LowLevelI2C::read(bool send_ack)
 {
     if (command == CMD_IDLE)
     {
-        command = CMD_READ;
-        i2c_value = 0x0;
-        i2c_ack = send_ack;
-        step = 0;
+        begin(CMD_READ, 0x0, send_ack);
+        if (tick_mode) {
+            halfStep();
+        }
+    }
+    else {
+        slot();
+    }
+    return i2c_value;
+}
+
+// In ticked mode START and STOP take several calls as well; they are
+// done once ready() is true again.
+void LowLevelI2C::stop(void)
+{
+    if (command == CMD_IDLE) {
+        begin(CMD_STOP, 0x0, false);
+    }
+    slot();
+    if (!tick_mode) {
+        delay();
+    }
+}
+
+void LowLevelI2C::start(void)
+{
+    if (command == CMD_IDLE) {
+        begin(CMD_START, 0x0, false);
+    }
+    slot();
+}
+
+void LowLevelI2C::begin(int cmd, uint8_t val, bool send_ack)
+{
+    command = cmd;
+    i2c_value = val;
+    i2c_ack = send_ack;
+    step = 0;
+
+    if (cmd == CMD_START) {
+        scl_timeout = false;
+    }
+    if (cmd == CMD_READ) {
         setSDA();
     }
-    else if (step < 8)
+}
+
+void LowLevelI2C::slot(void)
+{
+    if (tick_mode)
     {
-        i2c_value <<= 1;
-        delay();
-        setSCL();
-        delay();
-        
-        if (getSDA() == 1) {
-            i2c_value |= 0x01;
-        }
-        else {
-            i2c_value &= 0xFE;
+        halfStep();
+        return;
+    }
+    edgeData();
+    delay();
+    edgeClock();
+    delay();
+    edgeLatch();
+}
+
+// Ticked mode: every call is one half SCL period, timed by the caller.
+// The low half latches the previous bit and sets up the next one, the
+// high half raises SCL. Nothing here waits, so it can run from a timer
+// interrupt.
+void LowLevelI2C::halfStep(void)
+{
+    if (stretched()) {
+        return;
+    }
+    if (phase == PHASE_CLOCK)
+    {
+        edgeClock();
+        phase = PHASE_LATCH;
+        return;
+    }
+    if (phase == PHASE_LATCH)
+    {
+        edgeLatch();
+        phase = PHASE_DATA;
+        if (command == CMD_IDLE) {
+            return;
         }
-        clearSCL();
-        step++;
     }
-    else
+    edgeData();
+    phase = PHASE_CLOCK;
+}
+
+// Ticked mode replacement for waitSCL(): while a slave holds the
+// released SCL low the half steps are skipped, until the stretch timeout
+// expires.
+bool LowLevelI2C::stretched(void)
+{
+    if (!scl_input || (pin_scl.read() != 0))
+    {
+        stretching = false;
+        return false;
+    }
+    if (!stretching)
     {
-        if (i2c_ack) {
+        stretching = true;
+        stretch_start = us_ticker_read();
+    }
+    else if ((us_ticker_read() - stretch_start) >= (uint32_t)(stretch_timeout_ns / 1000)) {
+        scl_timeout = true;
+    }
+    return true;
+}
+
+// A bit slot is split in three edges so several buses can share the
+// delays between them (see MultiBusI2C): data is set up while SCL is
+// low, SCL is raised, then SDA is sampled and SCL dropped again.
+void LowLevelI2C::edgeData(void)
+{
+    switch (command)
+    {
+    case CMD_WRITE:
+        if ((step < 8) && !(i2c_value & 0x80)) {
             clearSDA();
         }
         else {
             setSDA();
         }
-        delay();
+        break;
+
+    case CMD_READ:
+        if ((step == 8) && i2c_ack) {
+            clearSDA();
+        }
+        else if (step == 8) {
+            setSDA();
+        }
+        break;
+
+    case CMD_START:
         setSCL();
-        delay();
+        setSDA();
+        break;
+
+    case CMD_STOP:
+        clearSDA();
+        break;
+    }
+}
+
+void LowLevelI2C::edgeClock(void)
+{
+    num_slots++;
+    if (command == CMD_START) {
+        clearSDA();
+    }
+    else {
+        setSCL();
+    }
+}
+
+void LowLevelI2C::edgeLatch(void)
+{
+    switch (command)
+    {
+    case CMD_WRITE:
+        if (step < 8)
+        {
+            clearSCL();
+            i2c_value <<= 1;
+            step++;
+        }
+        else
+        {
+            i2c_ack = (getSDA() != 1);
+            clearSCL();
+            command = CMD_IDLE;
+        }
+        break;
+
+    case CMD_READ:
+        if (step < 8)
+        {
+            i2c_value <<= 1;
+            if (getSDA() == 1) {
+                i2c_value |= 0x01;
+            }
+            clearSCL();
+            step++;
+        }
+        else
+        {
+            clearSCL();
+            command = CMD_IDLE;
+        }
+        break;
+
+    case CMD_START:
         clearSCL();
         command = CMD_IDLE;
+        break;
+
+    case CMD_STOP:
+        setSDA();
+        command = CMD_IDLE;
+        break;
     }
-    return i2c_value;
 }
 
-void LowLevelI2C::stop(void)
+void LowLevelI2C::setSpeed(int hz)
 {
-    clearSDA();
-    delay();
-    setSCL();
-    delay();
-    setSDA();
-    delay();
+    if (hz <= 0) {
+        return;
+    }
+    int half_period_ns = 500000000 / hz;
+    
+    frequency = hz;
+    delay_ns = half_period_ns - (overhead_ns / 2);
+    if (delay_ns < 0) {
+        delay_ns = 0;
+    }
+    bit_rate = ((delay_ns + overhead_ns) > 0) ? (1000000000 / ((2 * delay_ns) + overhead_ns)) : 0;
 }
 
-void LowLevelI2C::start(void)
+int LowLevelI2C::speed(void)
 {
-    setSCL();
-    setSDA();
+    return frequency;
+}
+
+int LowLevelI2C::bitRate(void)
+{
+    return bit_rate;
+}
+
+// Measures how long the pin accesses of one bit slot take and removes
+// that time from the delays, then measures the bit rate actually
+// reached. The dummy slots keep SDA released, so without a START the
+// slaves ignore them. The bus must be idle.
+bool LowLevelI2C::calibrate(void)
+{
+    Timer timer;
+    
+    if (!ready() || (getSCL() == 0) || (getSDA() == 0)) {
+        return false;
+    }
+    
+    delay_ns = 0;
+    timer.start();
+    for (int i = 0; i < CALIBRATION_SLOTS; i++) {
+        idleSlot();
+    }
+    timer.stop();
+    overhead_ns = (int)(((int64_t)timer.read_us() * 1000) / CALIBRATION_SLOTS);
+    setSpeed(frequency);
+    
+    timer.reset();
+    timer.start();
+    for (int i = 0; i < CALIBRATION_SLOTS; i++) {
+        idleSlot();
+    }
+    timer.stop();
+    if (timer.read_us() > 0) {
+        bit_rate = (int)(((int64_t)CALIBRATION_SLOTS * 1000000) / timer.read_us());
+    }
+    
+    pin_scl.release();
+    scl_input = true;
+    return true;
+}
+
+void LowLevelI2C::idleSlot(void)
+{
+    pin_sda.release();
     delay();
-    clearSDA();
+    pin_scl.release();
+    pin_scl.read();
     delay();
-    clearSCL();
+    pin_sda.read();
+    pin_scl.drive();
 }
 
 void LowLevelI2C::delay(void)
 {
-    wait_ns(1250);
+    wait_ns(delay_ns);
 }
 
-void LowLevelI2C::setSCL(void)
+void LowLevelI2C::setStretchTimeout(int us)
 {
-    if (!scl_input) {
-        pin_scl.input();
+    stretch_timeout_ns = us * 1000;
+}
+
+// Set when a slave held SCL low for longer than the stretch timeout.
+// Cleared by the next START.
+bool LowLevelI2C::timeout(void)
+{
+    return scl_timeout;
+}
+
+// Ticked mode: write()/read()/start()/stop() advance half an SCL period
+// per call and never wait, the caller paces them (see TickerI2C). Only
+// switch while the bus is idle; MultiBusI2C needs the default mode.
+void LowLevelI2C::setTicked(bool enable)
+{
+    if (!ready()) {
+        return;
     }
+    tick_mode = enable;
+    phase = PHASE_DATA;
+    stretching = false;
+}
+
+// Bit slots (including START and STOP) clocked since construction, for
+// bus utilization.
+uint32_t LowLevelI2C::slots(void)
+{
+    return num_slots;
+}
+
+bool LowLevelI2C::ticked(void)
+{
+    return tick_mode;
+}
+
+// Drops the byte in progress and releases both lines.
+void LowLevelI2C::abort(void)
+{
+    command = CMD_IDLE;
+    phase = PHASE_DATA;
+    stretching = false;
+    pin_sda.release();
+    pin_scl.release();
+    sda_input = true;
     scl_input = true;
+    I2C_TRACE_EVENT(trace_source, I2C_TRACE_PINS, TRACE_PINS);
+}
+
+// A slave may hold SCL low after we release it (clock stretching); the
+// next edge has to wait until the line is really high.
+void LowLevelI2C::waitSCL(void)
+{
+    int waited_ns = 0;
+    
+    while (pin_scl.read() == 0)
+    {
+        if (waited_ns >= stretch_timeout_ns)
+        {
+            scl_timeout = true;
+            return;
+        }
+        wait_ns(I2C_STRETCH_POLL_NS);
+        waited_ns += I2C_STRETCH_POLL_NS;
+    }
+}
+
+void LowLevelI2C::drivePin(I2cPin &pin)
+{
+#if I2C_FASTPIN
+    if (batch != NULL)
+    {
+        batch->drive(pin);
+        return;
+    }
+#endif
+    pin.drive();
+}
+
+void LowLevelI2C::releasePin(I2cPin &pin)
+{
+#if I2C_FASTPIN
+    if (batch != NULL)
+    {
+        batch->release(pin);
+        return;
+    }
+#endif
+    pin.release();
+}
+
+void LowLevelI2C::setSCL(void)
+{
+    if (!scl_input)
+    {
+        releasePin(pin_scl);
+        scl_input = true;
+#if I2C_FASTPIN
+        if (batch != NULL) {
+            scl_wait = true;
+        }
+        else
+#endif
+        if (!tick_mode) {
+            waitSCL();
+        }
+        I2C_TRACE_EVENT(trace_source, I2C_TRACE_PINS, TRACE_PINS);
+    }
 }
 
 void LowLevelI2C::setSDA(void)
 {
-    if (!sda_input) {
-        pin_sda.input();
+    if (!sda_input)
+    {
+        releasePin(pin_sda);
+        sda_input = true;
+        I2C_TRACE_EVENT(trace_source, I2C_TRACE_PINS, TRACE_PINS);
     }
-    sda_input = true;
 }
 
 void LowLevelI2C::clearSCL(void)
 {
     if (scl_input)
     {
-        pin_scl.output();
-        pin_scl = 0;
+        drivePin(pin_scl);
+        scl_input = false;
+        I2C_TRACE_EVENT(trace_source, I2C_TRACE_PINS, TRACE_PINS);
     }
-    scl_input = false;
 }
 
 void LowLevelI2C::clearSDA(void)
 {
     if (sda_input)
     {
-        pin_sda.output();
-        pin_sda = 0;
+        drivePin(pin_sda);
+        sda_input = false;
+        I2C_TRACE_EVENT(trace_source, I2C_TRACE_PINS, TRACE_PINS);
     }
-    sda_input = false;
 }
 
 int LowLevelI2C::getSCL(void)
 {
     setSCL();
-    return pin_scl;
+    return pin_scl.read();
 }
 
 int LowLevelI2C::getSDA(void)
 {
     setSDA();
-    return pin_sda;
+#if I2C_FASTPIN
+    if (batch != NULL) {
+        return batch->read(pin_sda);
+    }
+#endif
+    return pin_sda.read();
 }
 
 bool LowLevelI2C::recover(void)
@@ -198,7 +520,13 @@ bool LowLevelI2C::recover(void)
         setSCL();
         delay();
     }
+    // in ticked mode the STOP takes several calls
     stop();
+    while (!ready())
+    {
+        delay();
+        stop();
+    }
     
     if ((getSCL() == 0) || (getSDA() == 0)) {
         // Return as SCL is low and no access to become master.
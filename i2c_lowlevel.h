@@ -2,6 +2,35 @@
 #define _I2C_LOWLEVEL_H_
 
 #include "mbed.h"
+#include "i2c_fastpin.h"
+#include "i2c_trace.h"
+
+// Interval of the SCL reads while a slave stretches the clock.
+#define I2C_STRETCH_POLL_NS 250
+
+// SCL frequency profiles; any other frequency in Hz may be used as well.
+enum I2cSpeed {
+    I2C_SPEED_100KHZ = 100000,
+    I2C_SPEED_400KHZ = 400000,
+    I2C_SPEED_1MHZ   = 1000000,
+};
+
+// Transaction errors reported by HighLevelI2C::error() and
+// MultiBusI2C::error(). I2C_ERROR_NONE is zero so results can be tested
+// as booleans.
+enum I2cError {
+    I2C_ERROR_NONE = 0,
+    I2C_ERROR_NACK,
+    I2C_ERROR_TIMEOUT,
+    I2C_ERROR_POLL,
+};
+
+// Units of the budget passed to HighLevelI2C::loop() and
+// MultiBusI2C::loop().
+enum I2cBudget {
+    I2C_BUDGET_BITS = 0,
+    I2C_BUDGET_US,
+};
 
 class LowLevelI2C
 {
@@ -13,25 +42,82 @@ public:
     uint8_t read(bool send_ack);
     bool recover(void);
     bool ready(void);
+    void setSpeed(int hz);
+    int speed(void);
+    bool calibrate(void);
+    int bitRate(void);
+    void setStretchTimeout(int us);
+    bool timeout(void);
+    void abort(void);
+    void setTicked(bool enable);
+    bool ticked(void);
+    uint32_t slots(void);
     
 protected:
-    DigitalInOut pin_sda;
-    DigitalInOut pin_scl;
+    I2cPin pin_sda;
+    I2cPin pin_scl;
     bool scl_input;
     bool sda_input;
     bool i2c_ack;
     uint8_t i2c_value;
     int command;
     int step;
+    int frequency;
+    int delay_ns;
+    int overhead_ns;
+    int bit_rate;
+    int stretch_timeout_ns;
+    bool scl_timeout;
+    bool tick_mode;
+    int phase;
+    bool stretching;
+    uint32_t stretch_start;
+    volatile uint32_t num_slots;
+#if I2C_FASTPIN
+    // Set by MultiBusI2C while it clocks a slot: pin changes go to the
+    // batch, SDA is read from its last sample and a released SCL is
+    // left for the batch owner to wait on (scl_wait).
+    GpioBatch *batch;
+    bool scl_wait;
+#endif
+    I2C_TRACE_SOURCE(trace_source);
     
 private:
+    friend class MultiBusI2C;
+
+    enum {
+        CMD_IDLE = 0,
+        CMD_WRITE,
+        CMD_READ,
+        CMD_START,
+        CMD_STOP,
+    };
+
+    enum {
+        PHASE_DATA = 0,
+        PHASE_CLOCK,
+        PHASE_LATCH,
+    };
+
+    void init(void);
+    void begin(int cmd, uint8_t val, bool send_ack);
+    void slot(void);
+    void halfStep(void);
+    bool stretched(void);
+    void edgeData(void);
+    void edgeClock(void);
+    void edgeLatch(void);
     void delay(void);
+    void idleSlot(void);
+    void waitSCL(void);
     void setSCL(void);
     void setSDA(void);
     void clearSCL(void);
     void clearSDA(void);
     int getSCL(void);
     int getSDA(void);
+    void drivePin(I2cPin &pin);
+    void releasePin(I2cPin &pin);
 };
 
 #endif
@@ -0,0 +1,806 @@
+#include "i2c_multibus.h"
+
+enum {
+    STATE_MULTI_IDLE = 0,
+    STATE_MULTI_START,
+    STATE_MULTI_STOP,
+    STATE_MULTI_ADDR,
+    STATE_MULTI_REG,
+    STATE_MULTI_RESTART,
+    STATE_MULTI_ADDR2,
+    STATE_MULTI_WRITE_VAL,
+    STATE_MULTI_READ_VAL,
+};
+
+static const StateName stateNames[] = {
+    STATE_NAME_ENTRY(STATE_MULTI_IDLE),
+    STATE_NAME_ENTRY(STATE_MULTI_START),
+    STATE_NAME_ENTRY(STATE_MULTI_STOP),
+    STATE_NAME_ENTRY(STATE_MULTI_ADDR),
+    STATE_NAME_ENTRY(STATE_MULTI_REG),
+    STATE_NAME_ENTRY(STATE_MULTI_RESTART),
+    STATE_NAME_ENTRY(STATE_MULTI_ADDR2),
+    STATE_NAME_ENTRY(STATE_MULTI_WRITE_VAL),
+    STATE_NAME_ENTRY(STATE_MULTI_READ_VAL),
+    STATE_NAME_ENTRY_SENTINEL,
+};
+
+static_assert(sizeof(stateNames) / sizeof(stateNames[0]) - 1 <= I2C_LATENCY_STATES,
+              "latency histograms do not cover all states");
+
+void MultiBusI2C::resetTimings(void)
+{
+    state_timer.reset();
+}
+
+bool MultiBusI2C::timings(struct timing_t &tm)
+{
+    return state_timer.timings(tm);
+}
+
+const char *MultiBusI2C::stateName(int state)
+{
+    return I2cStateTimer::name(stateNames, state);
+}
+
+bool MultiBusI2C::latency(int index, struct latency_t &lt)
+{
+    return state_timer.latency(index, lt);
+}
+
+int MultiBusI2C::latencyBuckets(int index, uint32_t *counts)
+{
+    return state_timer.buckets(index, counts);
+}
+
+MultiBusI2C::MultiBusI2C(void) : state_timer(stateNames)
+{
+    num_buses = 0;
+    i2c_select = ~0u;
+    i2c_used = 0;
+    i2c_poll_wait = ~0u;
+    i2c_state = STATE_MULTI_IDLE;
+    i2c_reg   = 0x0;
+    i2c_len   = 0;
+    i2c_byte  = 0;
+    i2c_write = false;
+    i2c_src   = NULL;
+    i2c_dst   = NULL;
+    i2c_busy  = false;
+    i2c_delay_ns = 0;
+    I2C_TRACE_INIT_SOURCE(trace_source, "MultiBusI2C", stateName);
+}
+
+int MultiBusI2C::attach(LowLevelI2C &bus, int addr)
+{
+    if ((num_buses >= MULTIBUS_I2C_MAX_BUSES) || (i2c_state != STATE_MULTI_IDLE)) {
+        return -1;
+    }
+    i2c[num_buses]        = &bus;
+    i2c_addr[num_buses]   = (uint8_t)((addr << 1) & 0xFE);
+    i2c_val[num_buses]    = 0x0;
+    i2c_error[num_buses]  = I2C_ERROR_NONE;
+    i2c_fault[num_buses]  = I2C_FAULT_NONE;
+    i2c_transfers[num_buses] = 0;
+    i2c_polls[num_buses] = 0;
+    i2c_polled_at[num_buses] = 0;
+    i2c_ack[num_buses]    = false;
+    i2c_active[num_buses] = false;
+#if I2C_FASTPIN
+    pins.use(bus.pin_sda);
+    pins.use(bus.pin_scl);
+#endif
+    return num_buses++;
+}
+
+int MultiBusI2C::buses(void)
+{
+    return num_buses;
+}
+
+bool MultiBusI2C::setAddress(int bus, int addr)
+{
+    if ((i2c_state != STATE_MULTI_IDLE) || script.active() || (bus < 0) || (bus >= num_buses)) {
+        return false;
+    }
+    i2c_addr[bus] = (uint8_t)((addr << 1) & 0xFE);
+    return true;
+}
+
+// Bit mask of the buses (attach order) that take part in the following
+// transactions; the others are left alone. All buses by default.
+bool MultiBusI2C::select(uint32_t mask)
+{
+    if ((i2c_state != STATE_MULTI_IDLE) || script.active()) {
+        return false;
+    }
+    i2c_select = mask;
+    return true;
+}
+
+bool MultiBusI2C::setup(uint8_t reg, int n, bool wr)
+{
+    if ((i2c_state != STATE_MULTI_IDLE) || (num_buses == 0) || (n <= 0)) {
+        return false;
+    }
+    // Within a command list a bus that failed sits out the remaining
+    // commands, and a POLL only re-reads the buses still waiting.
+    i2c_used = 0;
+    for (int i = 0; i < num_buses; i++)
+    {
+        bool failed = script.active() && i2c_error[i];
+        
+        if (!failed)
+        {
+            i2c_error[i] = I2C_ERROR_NONE;
+            i2c_fault[i] = I2C_FAULT_NONE;
+        }
+        i2c_val[i]    = 0x0;
+        i2c_ack[i]    = false;
+        i2c_active[i] = !failed && (i2c_select & i2c_poll_wait & (1u << i));
+        if (i2c_active[i]) {
+            i2c_used |= (1u << i);
+        }
+    }
+    
+    // The slowest bus sets the pace; the pin accesses of all buses add up
+    // within one shared half period.
+    int half_ns = 0;
+    int overhead_ns = 0;
+    
+    for (int i = 0; i < num_buses; i++)
+    {
+        int bus_half_ns = i2c[i]->delay_ns + (i2c[i]->overhead_ns / 2);
+        
+        if (bus_half_ns > half_ns) {
+            half_ns = bus_half_ns;
+        }
+        overhead_ns += i2c[i]->overhead_ns / 2;
+    }
+    i2c_delay_ns = (half_ns > overhead_ns) ? (half_ns - overhead_ns) : 0;
+    
+    i2c_reg   = reg;
+    i2c_len   = n;
+    i2c_byte  = 0;
+    i2c_write = wr;
+    i2c_busy  = false;
+    i2c_state = STATE_MULTI_START;
+    return true;
+}
+
+// A NULL dst keeps up to 4 bytes per bus in the internal buffer, see get().
+bool MultiBusI2C::readBytes(uint8_t reg, uint8_t *dst, int n)
+{
+    if ((dst == NULL) && (n > 4)) {
+        return false;
+    }
+    if (!setup(reg, n, false)) {
+        return false;
+    }
+    i2c_dst = (dst != NULL) ? dst : i2c_buf;
+    
+    // served from the shadows only when every selected bus hits
+    if (shadowed())
+    {
+        for (int i = 0; i < num_buses; i++)
+        {
+            if (!i2c_active[i]) {
+                continue;
+            }
+            i2c_shadow[i].read(i2c_addr[i], reg, &i2c_dst[i * n], n);
+            for (int j = 0; j < n; j++) {
+                i2c_val[i] = (i2c_val[i] << 8) | i2c_dst[(i * n) + j];
+            }
+        }
+        i2c_state = STATE_MULTI_IDLE;
+    }
+    return true;
+}
+
+bool MultiBusI2C::writeBytes(uint8_t reg, const uint8_t *src, int n)
+{
+    if (!setup(reg, n, true)) {
+        return false;
+    }
+    i2c_src = src;
+    
+    if (shadowed())
+    {
+        for (int i = 0; i < num_buses; i++)
+        {
+            if (i2c_active[i])
+            {
+                i2c_shadow[i].same(i2c_addr[i], reg, &src[i * n], n);
+                i2c_ack[i] = true;
+            }
+        }
+        i2c_state = STATE_MULTI_IDLE;
+    }
+    return true;
+}
+
+// Caches n bytes from reg of the device at addr on one bus, see I2cShadow.
+bool MultiBusI2C::shadow(int bus, int addr, uint8_t reg, int n)
+{
+    if ((bus < 0) || (bus >= num_buses)) {
+        return false;
+    }
+    return i2c_shadow[bus].add((uint8_t)((addr << 1) & 0xFE), reg, n);
+}
+
+void MultiBusI2C::invalidate(void)
+{
+    for (int i = 0; i < MULTIBUS_I2C_MAX_BUSES; i++) {
+        i2c_shadow[i].invalidate();
+    }
+}
+
+// True when every selected bus can skip the transfer just set up.
+bool MultiBusI2C::shadowed(void)
+{
+    bool any = false;
+    
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (!i2c_active[i]) {
+            continue;
+        }
+        const uint8_t *src = i2c_write ? &i2c_src[i * i2c_len] : NULL;
+        
+        if (!i2c_shadow[i].cached(i2c_addr[i], i2c_reg, i2c_len, src)) {
+            return false;
+        }
+        any = true;
+    }
+    return any;
+}
+
+// Keeps the shadows in step with the devices after a transfer.
+void MultiBusI2C::finish(void)
+{
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (!(i2c_used & (1u << i))) {
+            continue;
+        }
+        i2c_transfers[i]++;
+        if (i2c_error[i]) {
+            i2c_shadow[i].invalidate(i2c_addr[i]);
+        }
+        else if (i2c_write) {
+            i2c_shadow[i].update(i2c_addr[i], i2c_reg, &i2c_src[i * i2c_len], i2c_len);
+        }
+        else {
+            i2c_shadow[i].update(i2c_addr[i], i2c_reg, &i2c_dst[i * i2c_len], i2c_len);
+        }
+    }
+}
+
+// len is in bits (8, 16, 24 or 32); write() takes one value per bus.
+bool MultiBusI2C::read(uint8_t reg, int len)
+{
+    if ((len <= 0) || (len > 32) || (len % 8)) {
+        return false;
+    }
+    return readBytes(reg, NULL, len / 8);
+}
+
+bool MultiBusI2C::write(uint8_t reg, const uint32_t *vals, int len)
+{
+    if ((i2c_state != STATE_MULTI_IDLE) || (len <= 0) || (len > 32) || (len % 8)) {
+        return false;
+    }
+    int n = len / 8;
+    
+    for (int i = 0; i < num_buses; i++)
+    {
+        for (int j = 0; j < n; j++) {
+            i2c_buf[(i * n) + j] = (uint8_t)(vals[i] >> (8 * (n - 1 - j)));
+        }
+    }
+    return writeBytes(reg, i2c_buf, n);
+}
+
+// Runs the commands back to back on all selected buses from loop(). A
+// bus that fails skips the rest of the list while the others go on;
+// error(bus) tells which failed.
+bool MultiBusI2C::run(const I2cCommand *list, int n)
+{
+    if ((i2c_state != STATE_MULTI_IDLE) || script.active() || (num_buses == 0)) {
+        return false;
+    }
+    for (int i = 0; i < num_buses; i++)
+    {
+        i2c_error[i] = I2C_ERROR_NONE;
+        i2c_fault[i] = I2C_FAULT_NONE;
+        i2c_polls[i] = 0;
+        i2c_polled_at[i] = 0;
+    }
+    i2c_poll_wait = ~0u;
+    script.start(list, n);
+    script.step(*this);
+    return true;
+}
+
+int MultiBusI2C::position(void)
+{
+    return script.position();
+}
+
+// Reads needed by the last finished POLL command of the current list (1
+// when the bits were already clear, 0 before one finished) and the
+// us_ticker_read() time they cleared, for the slowest bus or per bus.
+int MultiBusI2C::polls(void)
+{
+    return script.polls();
+}
+
+uint32_t MultiBusI2C::polledAt(void)
+{
+    return script.polledAt();
+}
+
+int MultiBusI2C::polls(int bus)
+{
+    return i2c_polls[bus];
+}
+
+uint32_t MultiBusI2C::polledAt(int bus)
+{
+    return i2c_polled_at[bus];
+}
+
+// Called after every read of a POLL; i2c_poll_wait is ~0u before the
+// first one. A bus whose bits are clear records its own count and time
+// and is left out of the next reads.
+bool MultiBusI2C::pollPending(uint8_t mask)
+{
+    bool first = (i2c_poll_wait == ~0u);
+    uint32_t wait = 0;
+    uint32_t now = 0;
+    
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (!(i2c_used & (1u << i)) || i2c_error[i]) {
+            continue;
+        }
+        if (first) {
+            i2c_polls[i] = 0;
+        }
+        i2c_polls[i]++;
+        
+        if (i2c_val[i] & mask) {
+            wait |= (1u << i);
+        }
+        else
+        {
+            if (now == 0) {
+                now = us_ticker_read();
+            }
+            i2c_polled_at[i] = now;
+        }
+    }
+    i2c_poll_wait = (wait != 0) ? wait : ~0u;
+    return (wait != 0);
+}
+
+void MultiBusI2C::pollExpired(uint8_t mask)
+{
+    i2c_poll_wait = ~0u;
+    for (int i = 0; i < num_buses; i++)
+    {
+        if ((i2c_used & (1u << i)) && (i2c_val[i] & mask))
+        {
+            i2c_error[i] = I2C_ERROR_POLL;
+            i2c_fault[i] = I2C_FAULT_POLL;
+            i2c_shadow[i].invalidate(i2c_addr[i]);
+        }
+    }
+}
+
+uint32_t MultiBusI2C::get(int bus)
+{
+    return i2c_val[bus];
+}
+
+bool MultiBusI2C::ack(int bus)
+{
+    return i2c_ack[bus];
+}
+
+int MultiBusI2C::error(int bus)
+{
+    return i2c_error[bus];
+}
+
+// I2cFault of the last failed transfer or command list on a bus,
+// I2C_FAULT_NONE after a success.
+int MultiBusI2C::fault(int bus)
+{
+    return i2c_fault[bus];
+}
+
+// Transfers that reached a bus (not served from its shadow), failed
+// ones included.
+uint32_t MultiBusI2C::transfers(int bus)
+{
+    return i2c_transfers[bus];
+}
+
+// True once every bus of the running command list has failed; the list
+// goes on as long as one bus is left.
+bool MultiBusI2C::failed(void)
+{
+    for (int i = 0; i < num_buses; i++)
+    {
+        if ((i2c_select & (1u << i)) && !i2c_error[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MultiBusI2C::error(void)
+{
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (i2c_error[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MultiBusI2C::recover(void)
+{
+    bool ok = true;
+    
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (!i2c[i]->recover()) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void MultiBusI2C::delay(void)
+{
+    wait_ns(i2c_delay_ns);
+}
+
+enum {
+    EDGE_DATA = 0,
+    EDGE_CLOCK,
+    EDGE_LATCH,
+};
+
+// With I2C_FASTPIN the pin changes of the buses between batchBegin()
+// and batchEnd() are written together.
+void MultiBusI2C::batchBegin(void)
+{
+#if I2C_FASTPIN
+    for (int i = 0; i < num_buses; i++) {
+        i2c[i]->batch = &pins;
+    }
+#endif
+}
+
+void MultiBusI2C::batchEnd(void)
+{
+#if I2C_FASTPIN
+    pins.apply();
+    for (int i = 0; i < num_buses; i++) {
+        i2c[i]->batch = NULL;
+    }
+    waitSCL();
+#endif
+}
+
+// Applies one edge of the slot to every bus that has a command in
+// progress.
+void MultiBusI2C::edges(int edge)
+{
+    batchBegin();
+#if I2C_FASTPIN
+    if (edge == EDGE_LATCH) {
+        pins.sample();
+    }
+#endif
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (i2c[i]->ready()) {
+            continue;
+        }
+        if (edge == EDGE_DATA) {
+            i2c[i]->edgeData();
+        }
+        else if (edge == EDGE_CLOCK) {
+            i2c[i]->edgeClock();
+        }
+        else {
+            i2c[i]->edgeLatch();
+        }
+    }
+    batchEnd();
+}
+
+// Clocks one bit slot on every bus that has a command in progress,
+// sharing the two delays of the slot between all of them.
+void MultiBusI2C::slot(void)
+{
+    edges(EDGE_DATA);
+    delay();
+    edges(EDGE_CLOCK);
+    delay();
+    edges(EDGE_LATCH);
+}
+
+// LowLevelI2C::waitSCL() for the buses that released SCL in the last
+// batch, all polled with the same port reads.
+void MultiBusI2C::waitSCL(void)
+{
+#if I2C_FASTPIN
+    int waited_ns = 0;
+    bool waiting = false;
+    
+    for (int i = 0; (i < num_buses) && !waiting; i++) {
+        waiting = i2c[i]->scl_wait;
+    }
+    while (waiting)
+    {
+        waiting = false;
+        pins.sample();
+        for (int i = 0; i < num_buses; i++)
+        {
+            LowLevelI2C &bus = *i2c[i];
+            
+            if (!bus.scl_wait) {
+                continue;
+            }
+            if (pins.read(bus.pin_scl) != 0) {
+                bus.scl_wait = false;
+            }
+            else if (waited_ns >= bus.stretch_timeout_ns)
+            {
+                bus.scl_timeout = true;
+                bus.scl_wait = false;
+            }
+            else {
+                waiting = true;
+            }
+        }
+        if (!waiting) {
+            break;
+        }
+        wait_ns(I2C_STRETCH_POLL_NS);
+        waited_ns += I2C_STRETCH_POLL_NS;
+    }
+#endif
+}
+
+// Takes buses whose slave held SCL past the stretch timeout out of the
+// transaction. Returns false when no bus is left.
+bool MultiBusI2C::checkTimeouts(void)
+{
+    bool any_active = false;
+    
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (i2c_active[i] && i2c[i]->timeout())
+        {
+            i2c[i]->abort();
+            i2c_error[i] = I2C_ERROR_TIMEOUT;
+            i2c_fault[i] = I2C_FAULT_TIMEOUT;
+            i2c_active[i] = false;
+        }
+        if (i2c_active[i]) {
+            any_active = true;
+        }
+    }
+    return any_active;
+}
+
+// Same calling pattern as LowLevelI2C::write()/read(): the first call
+// loads the byte on every active bus, each following call clocks one bit
+// and the call that clocks the ACK bit returns true.
+bool MultiBusI2C::byteStep(void)
+{
+    if (!i2c_busy)
+    {
+        // loading a read releases SDA
+        batchBegin();
+        for (int i = 0; i < num_buses; i++)
+        {
+            if (!i2c_active[i]) {
+                continue;
+            }
+            switch (i2c_state)
+            {
+            case STATE_MULTI_ADDR:
+                i2c[i]->begin(LowLevelI2C::CMD_WRITE, i2c_addr[i], false);
+                break;
+                
+            case STATE_MULTI_REG:
+                i2c[i]->begin(LowLevelI2C::CMD_WRITE, i2c_reg, false);
+                break;
+                
+            case STATE_MULTI_ADDR2:
+                i2c[i]->begin(LowLevelI2C::CMD_WRITE, i2c_addr[i] | 0x01, false);
+                break;
+                
+            case STATE_MULTI_WRITE_VAL:
+                i2c[i]->begin(LowLevelI2C::CMD_WRITE, i2c_src[(i * i2c_len) + i2c_byte], false);
+                break;
+                
+            case STATE_MULTI_READ_VAL:
+                i2c[i]->begin(LowLevelI2C::CMD_READ, 0x0, (i2c_byte < (i2c_len - 1)));
+                break;
+            }
+        }
+        batchEnd();
+        i2c_busy = true;
+        return false;
+    }
+    
+    slot();
+    
+    if (!checkTimeouts())
+    {
+        i2c_busy = false;
+        i2c_state = STATE_MULTI_STOP;
+        return false;
+    }
+    
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (i2c_active[i] && !i2c[i]->ready()) {
+            return false;
+        }
+    }
+    i2c_busy = false;
+    
+    // Collect the ACK of every bus; a NACK takes that bus out of the
+    // remaining bytes of the transaction.
+    bool any_active = false;
+    bool last = (i2c_byte == (i2c_len - 1));
+    
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (!i2c_active[i]) {
+            continue;
+        }
+        if (i2c_state == STATE_MULTI_READ_VAL)
+        {
+            i2c_dst[(i * i2c_len) + i2c_byte] = i2c[i]->i2c_value;
+            i2c_val[i] = (i2c_val[i] << 8) | i2c[i]->i2c_value;
+        }
+        else
+        {
+            if ((i2c_state == STATE_MULTI_WRITE_VAL) && last) {
+                i2c_ack[i] = i2c[i]->i2c_ack;
+            }
+            if (!i2c[i]->i2c_ack)
+            {
+                i2c_error[i] = I2C_ERROR_NACK;
+                i2c_fault[i] = I2c_NackFault(i2c_state, STATE_MULTI_REG, STATE_MULTI_WRITE_VAL);
+                i2c_active[i] = false;
+            }
+        }
+        if (i2c_active[i]) {
+            any_active = true;
+        }
+    }
+    
+    if (!any_active) {
+        i2c_state = STATE_MULTI_STOP;
+        return false;
+    }
+    return true;
+}
+
+bool MultiBusI2C::busy(void)
+{
+    return ((i2c_state != STATE_MULTI_IDLE) || script.active());
+}
+
+bool MultiBusI2C::loop(void)
+{
+    return state_timer.loop(*this);
+}
+
+// See I2cStateTimer::loop(Engine &, int, int).
+int MultiBusI2C::loop(int budget, int unit)
+{
+    return state_timer.loop(*this, budget, unit);
+}
+
+// One state machine step; returns 1 when it clocked a bit slot (on all
+// buses at once), 0 when it only loaded the next byte or had nothing to do.
+int MultiBusI2C::step(void)
+{
+    int old_state = i2c_state;
+    int bits = 1;
+    
+    if ((i2c_state == STATE_MULTI_IDLE) ||
+        (!i2c_busy && (i2c_state != STATE_MULTI_START) &&
+         (i2c_state != STATE_MULTI_RESTART) && (i2c_state != STATE_MULTI_STOP))) {
+        bits = 0;
+    }
+    
+    switch (i2c_state)
+    {
+    case STATE_MULTI_START:
+    case STATE_MULTI_RESTART:
+        for (int i = 0; i < num_buses; i++)
+        {
+            if (i2c_active[i]) {
+                i2c[i]->begin(LowLevelI2C::CMD_START, 0x0, false);
+            }
+        }
+        slot();
+        if (checkTimeouts()) {
+            i2c_state = (i2c_state == STATE_MULTI_START) ? STATE_MULTI_ADDR : STATE_MULTI_ADDR2;
+        }
+        else {
+            i2c_state = STATE_MULTI_STOP;
+        }
+        break;
+        
+    case STATE_MULTI_STOP:
+        for (int i = 0; i < num_buses; i++)
+        {
+            if ((i2c_used & (1u << i)) && (i2c_error[i] != I2C_ERROR_TIMEOUT)) {
+                i2c[i]->begin(LowLevelI2C::CMD_STOP, 0x0, false);
+            }
+        }
+        slot();
+        delay();
+        i2c_state = STATE_MULTI_IDLE;
+        finish();
+        break;
+        
+    case STATE_MULTI_ADDR:
+        if (byteStep()) {
+            i2c_state = STATE_MULTI_REG;
+        }
+        break;
+        
+    case STATE_MULTI_REG:
+        if (byteStep()) {
+            i2c_state = i2c_write ? STATE_MULTI_WRITE_VAL : STATE_MULTI_RESTART;
+        }
+        break;
+        
+    case STATE_MULTI_ADDR2:
+        if (byteStep()) {
+            i2c_state = STATE_MULTI_READ_VAL;
+        }
+        break;
+        
+    case STATE_MULTI_WRITE_VAL:
+    case STATE_MULTI_READ_VAL:
+        if (byteStep())
+        {
+            i2c_byte++;
+            if (i2c_byte >= i2c_len) {
+                i2c_state = STATE_MULTI_STOP;
+            }
+        }
+        break;
+    }
+    
+    if (i2c_state == STATE_MULTI_IDLE)
+    {
+        script.step(*this);
+        // a list that ended, even on a failure, waits for no bus
+        if (!script.active()) {
+            i2c_poll_wait = ~0u;
+        }
+    }
+    if (i2c_state != old_state) {
+        I2C_TRACE_EVENT(trace_source, I2C_TRACE_STATE, i2c_state);
+    }
+    
+    return bits;
+}
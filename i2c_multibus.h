@@ -0,0 +1,112 @@
+#ifndef _I2C_MULTIBUS_H_
+#define _I2C_MULTIBUS_H_
+
+#include "i2c_lowlevel.h"
+#include "i2c_command.h"
+#include "i2c_shadow.h"
+#include "i2c_state.h"
+#include "i2c_trace.h"
+#include "i2c_sensors.h"
+
+#define MULTIBUS_I2C_MAX_BUSES 4
+
+// Runs the same register transaction on several bit-banged buses in
+// lockstep: every edge is applied to all buses before the shared delay,
+// so N buses cost about as much bus time as one. With I2C_FASTPIN the
+// pin changes of an edge go out as one DIRSET/DIRCLR write per port and
+// the lines are sampled with one IN read per port. A bus that NACKs drops
+// out of the transaction and only takes part in the final STOP.
+// Byte buffers hold one block of n bytes per attached bus, in attach order.
+// select() limits the following transactions to some of the buses.
+// Shadowed registers are skipped only when every selected bus hits.
+class MultiBusI2C
+{
+public:
+    bool timings(struct timing_t &tm);
+    void resetTimings(void);
+    bool latency(int index, struct latency_t &lt);
+    int latencyBuckets(int index, uint32_t *counts);
+    static const char *stateName(int state);
+
+    MultiBusI2C(void);
+    int attach(LowLevelI2C &bus, int addr);
+    int buses(void);
+    bool setAddress(int bus, int addr);
+    bool select(uint32_t mask);
+    bool write(uint8_t reg, const uint32_t *vals, int len);
+    bool read(uint8_t reg, int len);
+    bool writeBytes(uint8_t reg, const uint8_t *src, int n);
+    bool readBytes(uint8_t reg, uint8_t *dst, int n);
+    bool run(const I2cCommand *list, int n);
+    int position(void);
+    int polls(void);
+    uint32_t polledAt(void);
+    int polls(int bus);
+    uint32_t polledAt(int bus);
+    uint32_t get(int bus);
+    bool loop(void);
+    int loop(int budget, int unit);
+    bool busy(void);
+    bool ack(int bus);
+    int error(int bus);
+    int fault(int bus);
+    uint32_t transfers(int bus);
+    bool error(void);
+    bool recover(void);
+    bool shadow(int bus, int addr, uint8_t reg, int n);
+    void invalidate(void);
+
+private:
+    friend class I2cScript;
+    friend class I2cStateTimer;
+    
+    bool setup(uint8_t reg, int n, bool wr);
+    bool failed(void);
+    bool pollPending(uint8_t mask);
+    void pollExpired(uint8_t mask);
+    int step(void);
+    bool byteStep(void);
+    void slot(void);
+    void batchBegin(void);
+    void batchEnd(void);
+    void edges(int edge);
+    void waitSCL(void);
+    void delay(void);
+    bool checkTimeouts(void);
+    bool shadowed(void);
+    void finish(void);
+
+    LowLevelI2C *i2c[MULTIBUS_I2C_MAX_BUSES];
+    uint8_t i2c_addr[MULTIBUS_I2C_MAX_BUSES];
+    uint32_t i2c_val[MULTIBUS_I2C_MAX_BUSES];
+    int i2c_error[MULTIBUS_I2C_MAX_BUSES];
+    int i2c_fault[MULTIBUS_I2C_MAX_BUSES];
+    uint32_t i2c_transfers[MULTIBUS_I2C_MAX_BUSES];
+    bool i2c_ack[MULTIBUS_I2C_MAX_BUSES];
+    bool i2c_active[MULTIBUS_I2C_MAX_BUSES];
+    int num_buses;
+    uint32_t i2c_select;
+    uint32_t i2c_used;
+    uint32_t i2c_poll_wait;
+    int i2c_polls[MULTIBUS_I2C_MAX_BUSES];
+    uint32_t i2c_polled_at[MULTIBUS_I2C_MAX_BUSES];
+    int i2c_state;
+    uint8_t i2c_reg;
+    int i2c_len;
+    int i2c_byte;
+    bool i2c_write;
+    const uint8_t *i2c_src;
+    uint8_t *i2c_dst;
+    uint8_t i2c_buf[MULTIBUS_I2C_MAX_BUSES * 4];
+    I2cScript script;
+    I2cShadow i2c_shadow[MULTIBUS_I2C_MAX_BUSES];
+    bool i2c_busy;
+    int i2c_delay_ns;
+    I2cStateTimer state_timer;
+#if I2C_FASTPIN
+    GpioBatch pins;
+#endif
+    I2C_TRACE_SOURCE(trace_source);
+};
+
+#endif
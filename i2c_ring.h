@@ -0,0 +1,69 @@
+#ifndef _I2C_RING_H_
+#define _I2C_RING_H_
+
+#include <atomic>
+#include "mbed.h"
+
+// Single-producer/single-consumer ring of N items (N a power of two).
+// The producer only writes head and the consumer only writes tail, so
+// push() may run in an interrupt while the main loop drains, without
+// locks. When the ring is full new items are dropped and counted.
+template <typename T, int N>
+class SampleRing
+{
+public:
+    SampleRing(void) : items(), head(0), tail(0), overruns(0) {}
+    
+    // Producer side.
+    bool push(const T &item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        
+        if ((h - tail.load(std::memory_order_acquire)) >= (uint32_t)N)
+        {
+            overruns++;
+            return false;
+        }
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Consumer side: copies up to max of the oldest items to out and
+    // returns how many.
+    int drain(T *out, int max)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t n = head.load(std::memory_order_acquire) - t;
+        
+        if (n > (uint32_t)max) {
+            n = max;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            out[i] = items[(t + i) & (N - 1)];
+        }
+        tail.store(t + n, std::memory_order_release);
+        return (int)n;
+    }
+    
+    int count(void)
+    {
+        return (int)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+    }
+    
+    // Items dropped because the consumer fell behind.
+    uint32_t dropped(void)
+    {
+        return overruns;
+    }
+
+private:
+    static_assert((N > 0) && ((N & (N - 1)) == 0), "ring size must be a power of two");
+    
+    T items[N];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    volatile uint32_t overruns;
+};
+
+#endif
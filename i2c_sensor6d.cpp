@@ -0,0 +1,66 @@
+#include "i2c_sensor6d.h"
+
+uint8_t Sensor6d::config[I2C_MAX_BUSES][ConfigWrite::width];
+uint8_t Sensor6d::pressure[I2C_MAX_BUSES][PressureRead::width];
+uint8_t Sensor6d::temperature[I2C_MAX_BUSES][TemperatureRead::width];
+
+// Combined conversion (measurement control 010) with the busy bit set.
+#define SENSOR6D_START(i) {0x0A}
+
+const uint8_t Sensor6d::start[I2C_MAX_BUSES][StartWrite::width] = I2C_PER_BUS(SENSOR6D_START);
+
+// Writes back the configuration and starts a conversion.
+#define SENSOR6D_START_SCRIPT(i) {                            \
+    ConfigWrite::command(config[i]),                            \
+    StartWrite::command(start[i]),                              \
+}
+
+// Checks that the busy bit is clear (polling only when the conversion
+// takes longer than predicted) and reads the result.
+#define SENSOR6D_PRESSURE_SCRIPT(i) {                         \
+    BusyPoll::command(),                                        \
+    PressureRead::command(pressure[i]),                         \
+}
+
+#define SENSOR6D_TEMPERATURE_SCRIPT(i) {                      \
+    BusyPoll::command(),                                        \
+    TemperatureRead::command(temperature[i]),                   \
+}
+
+const I2cCommand Sensor6d::start_script[I2C_MAX_BUSES][START_LEN] = I2C_PER_BUS(SENSOR6D_START_SCRIPT);
+const I2cCommand Sensor6d::pressure_script[I2C_MAX_BUSES][FETCH_LEN] = I2C_PER_BUS(SENSOR6D_PRESSURE_SCRIPT);
+const I2cCommand Sensor6d::temperature_script[I2C_MAX_BUSES][FETCH_LEN] = I2C_PER_BUS(SENSOR6D_TEMPERATURE_SCRIPT);
+
+// 24-bit two's complement.
+int32_t Sensor6dPressure::decode(int bus)
+{
+    const uint8_t *b = Sensor6d::pressure[bus];
+    int32_t raw = (b[0] << 16) | (b[1] << 8) | b[2];
+    
+    if (raw >= 0x0800000) {
+        raw -= 0x1000000;
+    }
+    return raw;
+}
+
+void Sensor6dPressure::scale(int type, SensorScale &s)
+{
+    PressureScale p;
+    
+    p.setType((enum SensorI2CType)type);
+    p.scale(s);
+}
+
+int32_t Sensor6dTemperature::decode(int bus)
+{
+    const uint8_t *b = Sensor6d::temperature[bus];
+    
+    return (int16_t)((b[0] << 8) | b[1]);
+}
+
+// Counts are 1/256 degree, Q16.16 is 1/65536.
+void Sensor6dTemperature::scale(int param, SensorScale &s)
+{
+    (void)param;
+    s.set(256, 0);
+}
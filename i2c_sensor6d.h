@@ -0,0 +1,94 @@
+#ifndef _I2C_SENSOR6D_H_
+#define _I2C_SENSOR6D_H_
+
+#include "i2c_driver.h"
+#include "i2c_transfer.h"
+
+// Conversion polls before a measurement is given up (~100 us each)
+#define SENSOR6D_POLL_RETRIES 1000
+
+// Registers and per-bus buffers of the 0x6d pressure sensor family:
+// configuration (0xA5), command and busy bit 0x08 (0x30), the 24-bit
+// pressure (0x06) and the 16-bit temperature (0x09).
+struct Sensor6d
+{
+    typedef I2cReadTransfer<0xA5, 2> ConfigRead;
+    typedef I2cWriteTransfer<0xA5, 2> ConfigWrite;
+    typedef I2cWriteTransfer<0x30, 1> StartWrite;
+    typedef I2cPollTransfer<0x30, 0x08, SENSOR6D_POLL_RETRIES> BusyPoll;
+    typedef I2cReadTransfer<0x06, 3> PressureRead;
+    typedef I2cReadTransfer<0x09, 2> TemperatureRead;
+    
+    static const int START_LEN = 2;
+    static const int FETCH_LEN = 2;
+    
+    static uint8_t config[I2C_MAX_BUSES][ConfigWrite::width];
+    static const uint8_t start[I2C_MAX_BUSES][StartWrite::width];
+    static uint8_t pressure[I2C_MAX_BUSES][PressureRead::width];
+    static uint8_t temperature[I2C_MAX_BUSES][TemperatureRead::width];
+    
+    static const I2cCommand start_script[I2C_MAX_BUSES][START_LEN];
+    static const I2cCommand pressure_script[I2C_MAX_BUSES][FETCH_LEN];
+    static const I2cCommand temperature_script[I2C_MAX_BUSES][FETCH_LEN];
+};
+
+// Common part of the 0x6d drivers: every acquisition reads the
+// configuration (served from the shadow after the first), writes it
+// back and starts a combined pressure and temperature conversion.
+template <class Derived>
+class Sensor6dDriver : public I2cSensorDriver<Derived>
+{
+public:
+    static constexpr int SHADOW_REG = Sensor6d::ConfigRead::reg;
+    static constexpr int SHADOW_LEN = Sensor6d::ConfigRead::width;
+    static const int START_LEN = Sensor6d::START_LEN;
+    static const int FETCH_LEN = Sensor6d::FETCH_LEN;
+    
+    template <class Engine>
+    static bool prepare(Engine &engine)
+    {
+        return Sensor6d::ConfigRead::issue(engine);
+    }
+    
+    // Keeps the configuration bits, the conversion time depends on all
+    // of them.
+    static uint32_t configure(int bus, uint32_t value)
+    {
+        uint32_t config = value & 0x7fd;
+        
+        Sensor6d::config[bus][0] = (uint8_t)(config >> 8);
+        Sensor6d::config[bus][1] = (uint8_t)config;
+        return config;
+    }
+    
+    static const I2cCommand *startScript(int bus)
+    {
+        return Sensor6d::start_script[bus];
+    }
+};
+
+// Pressure in kPa; the registration parameter is the SensorI2CType.
+class Sensor6dPressure : public Sensor6dDriver<Sensor6dPressure>
+{
+public:
+    static const I2cCommand *fetchScript(int bus)
+    {
+        return Sensor6d::pressure_script[bus];
+    }
+    static int32_t decode(int bus);
+    static void scale(int type, SensorScale &s);
+};
+
+// Temperature of the same part in degrees Celsius (1/256 per count).
+class Sensor6dTemperature : public Sensor6dDriver<Sensor6dTemperature>
+{
+public:
+    static const I2cCommand *fetchScript(int bus)
+    {
+        return Sensor6d::temperature_script[bus];
+    }
+    static int32_t decode(int bus);
+    static void scale(int param, SensorScale &s);
+};
+
+#endif
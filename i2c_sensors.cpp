@@ -1,235 +1,1050 @@
 #include "mbed.h"
 #include "i2c_sensors.h"
 #include "i2c_highlevel.h"
+#include "i2c_multibus.h"
+#include "i2c_ticker.h"
+#include "i2c_ring.h"
+#include "i2c_convert.h"
+#include "i2c_breaker.h"
+#include "i2c_filter.h"
+#include "i2c_latency.h"
+#include "i2c_sensor6d.h"
 
-extern Serial pc;
-
-static Timer timer;
-
-enum SensorI2CType {
-    Pos2k5Pa,
-    Pos5kPa,
-    Pos10kPa,
-    Pos20kPa,
-    Pos40kPa,
-    Pos100kPa,
-    Pos200kPa,
-    Pos500kPa,
-    Pos700kPa,
-    Pos1000kPa,
+#define SENSOR_I2C_ADDR 0x6d
+
+// Upper limit of a learned conversion time.
+#define SENSOR_CONVERSION_MAX_US 100000
+
+// Bit-banged buses of the board, one engine each. The slave address is
+// set per acquisition from the sensor registry, so a bus may carry
+// several sensors.
+static HighLevelI2C buses[] = {
+    {P1_6, P0_2, SENSOR_I2C_ADDR},      // sda1, scl1
+    {P1_10, P0_28, SENSOR_I2C_ADDR},    // sda2, scl2
 };
 
-static HighLevelI2C sensor1(P1_6, P0_2, 0x6d); // sda1, scl1
-static HighLevelI2C sensor2(P1_10, P0_28, 0x6d); // sda2, scl2
+#define NUM_BUSES ((int)(sizeof(buses) / sizeof(buses[0])))
+
+static_assert(NUM_BUSES <= I2C_MAX_BUSES, "I2C_MAX_BUSES too small");
+
+// All buses run the same sequence, so by default they are clocked
+// together through one MultiBusI2C instead of one after the other.
+static MultiBusI2C sensors;
+static bool lockstep = true;
+
+// Optionally the buses are clocked from a timer interrupt instead; the
+// sensor loop then only hands over transfers and checks for completion.
+// Lockstep does not apply in this mode.
+static TickerI2C ticker;
+static bool interrupt_mode = false;
+static bool multibus = true;
+
+static int bus_speed = I2C_SPEED_400KHZ;
+
+// Work done per I2c_SensorLoop() call, see I2c_SetLoopBudget().
+static int loop_budget = 1;
+static int loop_unit = I2C_BUDGET_BITS;
 
-static float pressure1 = 0.0;
-static float pressure2 = 0.0;
+// Retry policy of the channels, see I2c_SetRetryPolicy().
+static uint32_t retry_base_us = 1000;
+static uint32_t retry_max_us = 64000;
+static int retry_trip = 8;
+static uint32_t retry_probe_us = 1000000;
 
-static int numMeas = 0;
-static int numOK = 0;
+// Failed acquisitions in a row after which a bus is recovered, and the
+// count so far per bus.
+static int recover_errors = 3;
+static int bus_errors[NUM_BUSES];
+static uint32_t bus_recoveries[NUM_BUSES];
+static uint32_t bus_recover_failed[NUM_BUSES];
+static uint32_t bus_recover_us[NUM_BUSES];
+
+// Set while I2c_SensorSetup() waits for one acquisition of every channel;
+// channels that have theirs are not started again, so the buses drain.
+static bool initializing = false;
+
+// Start of the I2c_GetStats() interval and the bus counters at that time.
+static uint32_t stats_start = 0;
+static uint32_t stats_transfers[I2C_MAX_BUSES];
+static uint32_t stats_slots[I2C_MAX_BUSES];
 static int duration = 0;
 
-static enum SensorI2CType sensor_type1 = Pos10kPa;
-static enum SensorI2CType sensor_type2 = Pos700kPa;
+// One registered sensor. due is the us_ticker_read() time of its next
+// acquisition, held back by breaker after failures; every finished
+// acquisition is queued in samples, and the outputs of filter in
+// filtered. While a conversion runs the bus is free for other channels
+// until ready_at. A channel of a pair is held back after its
+// acquisition until the partner has one too.
+struct SensorChannel {
+    int bus;
+    int addr;
+    int driver;
+    SensorScale scale;
+    uint32_t period_us;
+    uint32_t due;
+    uint32_t started;
+    bool converting;
+    uint32_t converted;
+    uint32_t ready_at;
+    uint32_t conversion_us;
+    uint32_t conversion_config;
+    int32_t kpa_q16;
+    bool error;
+    bool done;
+    uint32_t acquisitions;
+    uint32_t completed;
+    uint32_t faults[I2C_NUM_FAULTS];
+    I2cBreaker breaker;
+    SampleRing<struct sample_t, I2C_SAMPLE_RING_SIZE> samples;
+    bool filtering;
+    SampleFilter filter;
+    int32_t filtered_q16;
+    SampleRing<struct sample_t, I2C_SAMPLE_RING_SIZE> filtered;
+    int pair;
+    bool held;
+};
+
+static SensorChannel channels[I2C_MAX_CHANNELS];
+static int num_channels = 0;
+
+// Two channels sampled together, see I2c_AddPair(). pending marks the
+// side whose acquisition of the current cycle is in sample; sync holds
+// the first side back until the second one is done. latest is
+// published under the seqlock seq (odd while it is written).
+struct SensorPair {
+    int channel[2];
+    bool sync;
+    bool pending[2];
+    struct sample_t sample[2];
+    volatile uint32_t seq;
+    struct pair_t latest;
+    uint32_t missed;
+    LatencyHistogram start_skew;
+    LatencyHistogram latch_skew;
+};
+
+static SensorPair pairs[I2C_MAX_PAIRS];
+static int num_pairs = 0;
 
-static void convert(const enum SensorI2CType type, float &pressure);
+// Drivers the scheduler runs, numbered as SensorDriver. A new part needs
+// a driver class (see I2cSensorDriver), an entry here and one in
+// SensorDriver.
+typedef I2cDriverTable<Sensor6dPressure, Sensor6dTemperature> SensorDrivers;
 
-static bool sensor_error = false;
+static_assert(SensorDrivers::size == I2C_NUM_DRIVERS, "SensorDriver does not match the driver table");
+static_assert(SensorDrivers::index<Sensor6dTemperature>() == I2C_DRIVER_6D_TEMPERATURE,
+              "SensorDriver does not match the driver table");
 
 enum SensorStep {
     SENSOR_STEP0,
     SENSOR_STEP1,
     SENSOR_STEP2,
     SENSOR_STEP3,
-    SENSOR_STEP4,
-    SENSOR_STEP5,
 };
 
-static enum SensorStep sensorStep = SENSOR_STEP0;
+// Every bus walks its own steps for the channel it is serving: STEP1
+// runs the driver's prepare transfer (the configuration read), STEP2
+// starts a conversion, STEP3 fetches the result once it is expected to
+// be ready. Between STEP2 and STEP3 the
+// bus goes back to STEP0 and serves other channels. In lockstep mode the
+// buses step together.
+static enum SensorStep bus_step[NUM_BUSES];
+static int bus_channel[NUM_BUSES];
 
-bool I2c_GetComTimings(struct timing_t &tm)
+// Driver of the jobs of the current lockstep round.
+static int round_driver;
+
+static bool busBusy(int bus)
 {
-    struct timing_t tm1, tm2;
+    if (interrupt_mode) {
+        return ticker.busy(bus);
+    }
+    return buses[bus].busy();
+}
+
+static uint32_t busGet(int bus)
+{
+    if (multibus) {
+        return sensors.get(bus);
+    }
+    return buses[bus].get();
+}
+
+static int busError(int bus)
+{
+    if (multibus) {
+        return sensors.error(bus);
+    }
+    return buses[bus].error();
+}
+
+static int busFault(int bus)
+{
+    if (multibus) {
+        return sensors.fault(bus);
+    }
+    return buses[bus].fault();
+}
+
+// Both engines count, as the mode may change at every setup.
+static uint32_t busTransfers(int bus)
+{
+    uint32_t transfers = buses[bus].transfers();
     
-    bool ok1 = sensor1.timings(tm1);
-    bool ok2 = sensor2.timings(tm2);
+    if (bus < sensors.buses()) {
+        transfers += sensors.transfers(bus);
+    }
+    return transfers;
+}
+
+static int busPolls(int bus)
+{
+    if (multibus) {
+        return sensors.polls(bus);
+    }
+    return buses[bus].polls();
+}
+
+static uint32_t busPolledAt(int bus)
+{
+    if (multibus) {
+        return sensors.polledAt(bus);
+    }
+    return buses[bus].polledAt();
+}
+
+// Picks the next job of a bus: fetching a conversion that should be
+// ready (fetch set) or else starting the most overdue acquisition.
+// Returns -1 when there is nothing to do yet. Continuous channels
+// (rate 0) are due again right after they complete, so they take turns.
+static int nextChannel(int bus, uint32_t now, bool &fetch)
+{
+    int next = -1;
+    int32_t late = 0;
     
-    if (ok1 && ok2)
+    fetch = false;
+    for (int i = 0; i < num_channels; i++)
     {
-        if (tm1.duration_us > tm2.duration_us) {
-            tm = tm1;
+        SensorChannel &ch = channels[i];
+        
+        if (ch.bus != bus) {
+            continue;
         }
-        else {
-            tm = tm2;
+        bool ready = ch.converting && ((int32_t)(now - ch.ready_at) >= 0);
+        int32_t overdue = (int32_t)(now - (ch.converting ? ch.ready_at : ch.due));
+        
+        if ((ch.converting && !ready) || (!ch.converting && (ch.held || (initializing && ch.done)))) {
+            continue;
+        }
+        if ((overdue >= 0) && ((next < 0) || (ready && !fetch) ||
+            ((ready == fetch) && (overdue > late))))
+        {
+            next = i;
+            late = overdue;
+            fetch = ready;
         }
     }
-    else if (ok1)
+    return next;
+}
+
+static void channelStart(int bus, int ch)
+{
+    channels[ch].acquisitions++;
+    channels[ch].started = us_ticker_read();
+    channels[ch].breaker.probe();
+    bus_channel[bus] = ch;
+    bus_step[bus] = SENSOR_STEP1;
+}
+
+static void channelFetch(int bus, int ch)
+{
+    bus_channel[bus] = ch;
+    bus_step[bus] = SENSOR_STEP3;
+}
+
+static void channelConfig(int bus)
+{
+    SensorChannel &ch = channels[bus_channel[bus]];
+    uint32_t config = SensorDrivers::configure(ch.driver, bus, busGet(bus));
+    
+    // the learned conversion time only holds for one configuration
+    if (config != ch.conversion_config)
     {
-        tm = tm1;
+        ch.conversion_config = config;
+        ch.conversion_us = 0;
     }
-    else if (ok2)
-    {
-        tm = tm2;
+    bus_step[bus] = SENSOR_STEP2;
+}
+
+// The conversion was started; the bus is released until the predicted
+// completion.
+static void channelConverting(int bus)
+{
+    SensorChannel &ch = channels[bus_channel[bus]];
+    
+    ch.converting = true;
+    ch.converted = us_ticker_read();
+    ch.ready_at = ch.converted + ch.conversion_us;
+    bus_channel[bus] = -1;
+    bus_step[bus] = SENSOR_STEP0;
+}
+
+// Adjusts the conversion time estimate from the result of the fetch. If
+// the busy bit had to be polled the estimate jumps to the time it was
+// seen clear; if the first check found it clear the estimate is lowered
+// slightly, so it keeps tracking a conversion that got shorter.
+static void channelLearn(SensorChannel &ch, int polls, uint32_t polled_at)
+{
+    if (polls > 1) {
+        ch.conversion_us = polled_at - ch.converted;
     }
     else {
-        return false;
+        ch.conversion_us -= (ch.conversion_us + 127) / 128;
     }
-    return true;
 }
 
-void I2c_GetMeasStats(int &error, int &total)
+// The busy bit was still set when the poll gave up: the conversion takes
+// longer than it has run so far, so the estimate at least doubles.
+static void channelExpired(SensorChannel &ch, uint32_t now)
 {
-    error = numMeas - numOK;
-    total = numMeas;
+    uint32_t us = 2 * ch.conversion_us;
+    
+    if (us < now - ch.converted) {
+        us = now - ch.converted;
+    }
+    ch.conversion_us = (us < SENSOR_CONVERSION_MAX_US) ? us : SENSOR_CONVERSION_MAX_US;
 }
 
-int I2c_GetMeasDuration(void)
+// Runs a good reading through the channel's filters and queues what
+// comes out, with the times of the latest reading.
+static void channelFilter(SensorChannel &ch, const struct sample_t &in)
 {
-    return duration;
+    struct sample_t sample = in;
+    int32_t value;
+    
+    if (!ch.filtering || !ch.filter.push(in.raw, value)) {
+        return;
+    }
+    ch.filtered_q16 = ch.scale.q16(value, I2C_FILTER_FRAC);
+    sample.raw = (value + (1 << (I2C_FILTER_FRAC - 1))) >> I2C_FILTER_FRAC;
+    sample.kpa_q16 = ch.filtered_q16;
+    ch.filtered.push(sample);
 }
 
-void I2c_SensorLoop(void)
+static void pairPublish(SensorPair &p)
+{
+    uint32_t start_skew;
+    uint32_t latch_skew;
+    
+    p.seq++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (int k = 0; k < 2; k++)
+    {
+        p.latest.value_q16[k] = p.sample[k].kpa_q16;
+        p.latest.start_us[k] = p.sample[k].start_us;
+        p.latest.latch_us[k] = p.sample[k].latch_us;
+    }
+    p.latest.start_skew_us = (int32_t)(p.sample[1].start_us - p.sample[0].start_us);
+    p.latest.latch_skew_us = (int32_t)(p.sample[1].latch_us - p.sample[0].latch_us);
+    p.latest.count++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    p.seq++;
+    
+    start_skew = (p.latest.start_skew_us < 0) ? -p.latest.start_skew_us : p.latest.start_skew_us;
+    latch_skew = (p.latest.latch_skew_us < 0) ? -p.latest.latch_skew_us : p.latest.latch_skew_us;
+    p.start_skew.record(start_skew);
+    p.latch_skew.record(latch_skew);
+}
+
+// Matches the acquisitions of a paired channel with its partner's. The
+// second side of a cycle publishes the pair. With sync the first one
+// waits (held) unless the partner is failing, and both are due again at
+// the later of their times. A failure ends the cycle.
+static void channelPair(int c, const struct sample_t &sample)
+{
+    SensorChannel &ch = channels[c];
+    
+    if (ch.pair < 0) {
+        return;
+    }
+    SensorPair &p = pairs[ch.pair];
+    int k = (p.channel[0] == c) ? 0 : 1;
+    SensorChannel &partner = channels[p.channel[1 - k]];
+    
+    if (sample.status != I2C_ERROR_NONE)
+    {
+        p.missed++;
+        p.pending[0] = false;
+        p.pending[1] = false;
+        ch.held = false;
+        partner.held = false;
+        return;
+    }
+    p.sample[k] = sample;
+    p.pending[k] = true;
+    if (!p.pending[1 - k])
+    {
+        ch.held = p.sync && (partner.breaker.failures() == 0);
+        return;
+    }
+    
+    pairPublish(p);
+    p.pending[0] = false;
+    p.pending[1] = false;
+    ch.held = false;
+    partner.held = false;
+    if (!p.sync) {
+        return;
+    }
+    if ((int32_t)(ch.due - partner.due) > 0) {
+        partner.due = ch.due;
+    }
+    else {
+        ch.due = partner.due;
+    }
+}
+
+// Publishes the result of the bus's acquisition and schedules the next
+// one of that channel, no earlier than its breaker allows.
+static void channelDone(int bus, int error)
 {
-    int ret;
+    SensorChannel &ch = channels[bus_channel[bus]];
+    uint32_t now = us_ticker_read();
+    uint32_t backoff = 0;
+    struct sample_t sample;
     
-    bool busy1 = sensor1.loop();
-    bool busy2 = sensor2.loop();
+    sample.timestamp_us = now;
+    sample.raw = 0;
+    sample.kpa_q16 = 0;
+    sample.status = error;
+    sample.start_us = 0;
+    sample.latch_us = 0;
+    if (bus_step[bus] == SENSOR_STEP3)
+    {
+        sample.start_us = ch.converted;
+        if (!error) {
+            sample.latch_us = busPolledAt(bus);
+        }
+    }
     
-    switch(sensorStep)
+    if (!error)
+    {
+        int32_t raw = SensorDrivers::decode(ch.driver, bus);
+        
+        ch.kpa_q16 = ch.scale.q16(raw);
+        sample.raw = raw;
+        sample.kpa_q16 = ch.kpa_q16;
+        channelFilter(ch, sample);
+        
+        ch.completed++;
+        ch.breaker.success(now);
+        bus_errors[bus] = 0;
+        if ((int)(now - ch.started) > duration) {
+            duration = (int)(now - ch.started);
+        }
+    }
+    else
+    {
+        int fault = busFault(bus);
+        
+        if ((fault >= 0) && (fault < I2C_NUM_FAULTS)) {
+            ch.faults[fault]++;
+        }
+        backoff = ch.breaker.failure(now);
+        bus_errors[bus]++;
+    }
+    if ((bus_step[bus] == SENSOR_STEP3) && !error) {
+        channelLearn(ch, busPolls(bus), busPolledAt(bus));
+    }
+    else if ((bus_step[bus] == SENSOR_STEP3) && (busFault(bus) == I2C_FAULT_POLL)) {
+        channelExpired(ch, now);
+    }
+    ch.samples.push(sample);
+    ch.converting = false;
+    ch.error = (error != I2C_ERROR_NONE);
+    ch.done = true;
+    
+    ch.due += ch.period_us;
+    if ((int32_t)(now - ch.due) > 0) {
+        ch.due = now;
+    }
+    if ((int32_t)(now + backoff - ch.due) > 0) {
+        ch.due = now + backoff;
+    }
+    channelPair(bus_channel[bus], sample);
+    bus_channel[bus] = -1;
+    bus_step[bus] = SENSOR_STEP0;
+}
+
+// Clocks a bus free after recover_errors failed acquisitions in a row; a
+// slave left holding SDA low by an aborted transfer lets go again. Only
+// called while no transfer runs on the bus.
+static void busRecover(int bus)
+{
+    if ((recover_errors <= 0) || (bus_errors[bus] < recover_errors)) {
+        return;
+    }
+    uint32_t start = us_ticker_read();
+    
+    if (!buses[bus].bus().recover()) {
+        bus_recover_failed[bus]++;
+    }
+    bus_recover_us[bus] = us_ticker_read() - start;
+    bus_recoveries[bus]++;
+    bus_errors[bus] = 0;
+}
+
+// Independent buses: each one moves on to its next job as soon as it is
+// done with the previous one.
+static void busStep(int bus)
+{
+    bool fetch;
+    int ch;
+    
+    switch (bus_step[bus])
     {
     case SENSOR_STEP0:
-        numMeas++;
-        timer.stop();
-        timer.reset();
-        timer.start();
-        sensor1.read(0xA5, 16);
-        sensor2.read(0xA5, 16);
-        sensorStep = SENSOR_STEP1;
+        busRecover(bus);
+        ch = nextChannel(bus, us_ticker_read(), fetch);
+        if (ch < 0) {
+            break;
+        }
+        if (fetch)
+        {
+            channelFetch(bus, ch);
+            buses[bus].setAddress(channels[ch].addr);
+            SensorDrivers::fetch(channels[ch].driver, buses[bus], bus);
+        }
+        else
+        {
+            channelStart(bus, ch);
+            buses[bus].setAddress(channels[ch].addr);
+            SensorDrivers::prepare(channels[ch].driver, buses[bus]);
+        }
+        ticker.submit(bus);
         break;
-        
+    
     case SENSOR_STEP1:
-        if (!busy1 && !busy2)
+        if (busError(bus)) {
+            channelDone(bus, busError(bus));
+        }
+        else
         {
-            if (sensor1.error() || sensor2.error())
-            {
-                sensor_error = true;
-                sensorStep = SENSOR_STEP0;
-            }
-            else
-            {
-                sensor1.write(0xA5, sensor1.get() & 0x7fd, 16);
-                sensor2.write(0xA5, sensor2.get() & 0x7fd, 16);
-                sensorStep = SENSOR_STEP2;
-            }
+            channelConfig(bus);
+            SensorDrivers::start(channels[bus_channel[bus]].driver, buses[bus], bus);
+            ticker.submit(bus);
         }
         break;
     
     case SENSOR_STEP2:
-        if (!busy1 && !busy2)
+        if (busError(bus)) {
+            channelDone(bus, busError(bus));
+        }
+        else {
+            channelConverting(bus);
+        }
+        break;
+    
+    case SENSOR_STEP3:
+        channelDone(bus, busError(bus));
+        break;
+    }
+}
+
+// Lockstep: all buses with the same kind of job (start or fetch) for the
+// same driver run it together and share every transfer; fetches go
+// first, then the driver of the most overdue job. A bus that fails drops
+// out until the next round.
+static void multiStep(void)
+{
+    uint32_t now = us_ticker_read();
+    uint32_t mask = 0;
+    int next[NUM_BUSES];
+    bool fetch[NUM_BUSES];
+    bool any_fetch = false;
+    int32_t late = 0;
+    int driver = -1;
+    
+    switch (bus_step[0])
+    {
+    case SENSOR_STEP0:
+        for (int i = 0; i < NUM_BUSES; i++)
         {
-            if (sensor1.error() || sensor2.error())
-            {
-                sensor_error = true;
-                sensorStep = SENSOR_STEP0;
+            busRecover(i);
+            next[i] = nextChannel(i, now, fetch[i]);
+            if ((next[i] >= 0) && fetch[i]) {
+                any_fetch = true;
             }
-            else
+        }
+        for (int i = 0; i < NUM_BUSES; i++)
+        {
+            if ((next[i] < 0) || (fetch[i] != any_fetch)) {
+                continue;
+            }
+            SensorChannel &ch = channels[next[i]];
+            int32_t overdue = (int32_t)(now - (fetch[i] ? ch.ready_at : ch.due));
+            
+            if ((driver < 0) || (overdue > late))
             {
-                sensor1.write(0x30, 0x0A, 8);
-                sensor2.write(0x30, 0x0A, 8);
-                sensorStep = SENSOR_STEP3;
+                driver = ch.driver;
+                late = overdue;
+            }
+        }
+        for (int i = 0; i < NUM_BUSES; i++)
+        {
+            if ((next[i] < 0) || (fetch[i] != any_fetch) || (channels[next[i]].driver != driver)) {
+                continue;
+            }
+            if (any_fetch) {
+                channelFetch(i, next[i]);
+            }
+            else {
+                channelStart(i, next[i]);
             }
+            sensors.setAddress(i, channels[next[i]].addr);
+            mask |= (1u << i);
+        }
+        if (mask == 0) {
+            break;
+        }
+        // bus 0 leads the steps even when it has nothing to do
+        round_driver = driver;
+        sensors.select(mask);
+        if (any_fetch)
+        {
+            bus_step[0] = SENSOR_STEP3;
+            SensorDrivers::fetch(driver, sensors, 0);
+        }
+        else
+        {
+            bus_step[0] = SENSOR_STEP1;
+            SensorDrivers::prepare(driver, sensors);
         }
         break;
-        
-    case SENSOR_STEP3:
-        if (!busy1 && !busy2)
+    
+    case SENSOR_STEP1:
+        for (int i = 0; i < NUM_BUSES; i++)
         {
-            if (sensor1.error() || sensor2.error())
-            {
-                sensor_error = true;
-                sensorStep = SENSOR_STEP0;
+            if (bus_channel[i] < 0) {
+                continue;
+            }
+            if (busError(i)) {
+                channelDone(i, busError(i));
             }
             else
             {
-                sensor1.read(0x30, 8);
-                sensor2.read(0x30, 8);
-                sensorStep = SENSOR_STEP4;
+                channelConfig(i);
+                mask |= (1u << i);
             }
         }
+        bus_step[0] = SENSOR_STEP2;
+        if (mask != 0)
+        {
+            sensors.select(mask);
+            SensorDrivers::start(round_driver, sensors, 0);
+        }
         break;
     
-    case SENSOR_STEP4:
-        if (!busy1 && !busy2)
+    case SENSOR_STEP2:
+        for (int i = 0; i < NUM_BUSES; i++)
         {
-            if (sensor1.error() || sensor2.error())
-            {
-                sensor_error = true;
-                sensorStep = SENSOR_STEP0;
+            if (bus_channel[i] < 0) {
+                continue;
             }
-            else if ((sensor1.get() & 0x08) || (sensor2.get() & 0x08)) {
-                sensorStep = SENSOR_STEP3;
+            if (busError(i)) {
+                channelDone(i, busError(i));
             }
-            else
-            {
-                sensor1.read(0x06, 24);
-                sensor2.read(0x06, 24);
-                sensorStep = SENSOR_STEP5;
+            else {
+                channelConverting(i);
             }
         }
+        bus_step[0] = SENSOR_STEP0;
         break;
     
-    case SENSOR_STEP5:
-        if (!busy1 && !busy2)
+    case SENSOR_STEP3:
+        for (int i = 0; i < NUM_BUSES; i++)
         {
-            if (sensor1.error() || sensor2.error()) {
-                sensor_error = true;
+            if (bus_channel[i] >= 0) {
+                channelDone(i, busError(i));
             }
-            else
-            {
-                int32_t p1_aux = (int32_t)sensor1.get();
-                int32_t p2_aux = (int32_t)sensor2.get();
+        }
+        bus_step[0] = SENSOR_STEP0;
+        break;
+    }
+}
 
-                if (p1_aux >= 0x0800000) {
-                    p1_aux -= 0x1000000;
-                }
-                if (p2_aux >= 0x0800000) {
-                    p2_aux -= 0x1000000;
-                }
+int I2c_AddSensor(int bus, int addr, enum SensorI2CType type, int rate_hz)
+{
+    return I2c_AddSensorDriver(bus, addr, I2C_DRIVER_6D_PRESSURE, type, rate_hz);
+}
+
+int I2c_AddSensorDriver(int bus, int addr, int driver, int param, int rate_hz)
+{
+    if ((num_channels >= I2C_MAX_CHANNELS) || (bus < 0) || (bus >= NUM_BUSES) ||
+        (driver < 0) || (driver >= I2C_NUM_DRIVERS)) {
+        return -1;
+    }
+    SensorChannel &ch = channels[num_channels];
+    
+    ch.bus = bus;
+    ch.addr = addr;
+    ch.driver = driver;
+    SensorDrivers::scale(driver, param, ch.scale);
+    ch.period_us = (rate_hz > 0) ? (1000000 / rate_hz) : 0;
+    ch.due = 0;
+    ch.started = 0;
+    ch.converting = false;
+    ch.converted = 0;
+    ch.ready_at = 0;
+    ch.conversion_us = 0;
+    ch.conversion_config = ~0u;
+    ch.kpa_q16 = 0;
+    ch.error = false;
+    ch.done = false;
+    ch.filtering = false;
+    ch.filtered_q16 = 0;
+    ch.pair = -1;
+    ch.held = false;
+    ch.acquisitions = 0;
+    ch.completed = 0;
+    for (int f = 0; f < I2C_NUM_FAULTS; f++) {
+        ch.faults[f] = 0;
+    }
+    return num_channels++;
+}
+
+int I2c_GetConversionTime(int channel)
+{
+    if ((channel < 0) || (channel >= num_channels)) {
+        return 0;
+    }
+    return (int)channels[channel].conversion_us;
+}
+
+int I2c_GetNumChannels(void)
+{
+    return num_channels;
+}
+
+int I2c_GetNumBuses(void)
+{
+    return NUM_BUSES;
+}
 
-                pressure1 = p1_aux;
-                pressure2 = p2_aux;
-
-                convert(sensor_type1, pressure1);
-                convert(sensor_type2, pressure2);
-                
-                sensor_error = false;
-                numOK++;
-                timer.stop();
-                if (timer.read_us() > duration) {
-                    duration = timer.read_us();
+void I2c_SetLockstep(bool enable)
+{
+    lockstep = enable;
+}
+
+void I2c_SetInterruptMode(bool enable)
+{
+    interrupt_mode = enable;
+}
+
+void I2c_SetBusSpeed(int hz)
+{
+    bus_speed = hz;
+}
+
+void I2c_SetLoopBudget(int budget, int unit)
+{
+    loop_budget = (budget > 0) ? budget : 1;
+    loop_unit = unit;
+}
+
+void I2c_SetRetryPolicy(int base_us, int max_us, int trip_failures, int probe_us)
+{
+    retry_base_us = (base_us > 0) ? base_us : 0;
+    retry_max_us = (max_us > 0) ? max_us : 0;
+    retry_trip = trip_failures;
+    retry_probe_us = (probe_us > 0) ? probe_us : 0;
+}
+
+void I2c_SetAutoRecover(int errors)
+{
+    recover_errors = errors;
+}
+
+void I2c_GetBitRate(int &rate1, int &rate2)
+{
+    rate1 = buses[0].bus().bitRate();
+    rate2 = buses[1].bus().bitRate();
+}
+
+bool I2c_GetComTimings(struct timing_t &tm)
+{
+    struct timing_t bus_tm;
+    bool ok = false;
+    
+    if (multibus) {
+        return sensors.timings(tm);
+    }
+    
+    for (int i = 0; i < NUM_BUSES; i++)
+    {
+        if (buses[i].timings(bus_tm) && (!ok || (bus_tm.duration_us > tm.duration_us)))
+        {
+            tm = bus_tm;
+            ok = true;
+        }
+    }
+    return ok;
+}
+
+bool I2c_GetComLatency(int bus, int index, struct latency_t &lt)
+{
+    if ((bus < 0) || (bus >= NUM_BUSES)) {
+        return false;
+    }
+    if (multibus) {
+        return sensors.latency(index, lt);
+    }
+    return buses[bus].latency(index, lt);
+}
+
+void I2c_ResetComTimings(void)
+{
+    sensors.resetTimings();
+    for (int i = 0; i < NUM_BUSES; i++) {
+        buses[i].resetTimings();
+    }
+}
+
+void I2c_DumpComLatency(void)
+{
+    struct latency_t lt;
+    uint32_t counts[I2C_LATENCY_BUCKETS];
+    int num = multibus ? 1 : NUM_BUSES;
+    
+    for (int bus = 0; bus < num; bus++)
+    {
+        for (int i = 0; I2c_GetComLatency(bus, i, lt); i++)
+        {
+            if (lt.count == 0) {
+                continue;
+            }
+            const char *sep = "";
+            
+            if (multibus)
+            {
+                sensors.latencyBuckets(i, counts);
+                printf("I2C all ");
+            }
+            else
+            {
+                buses[bus].latencyBuckets(i, counts);
+                printf("I2C %d ", bus);
+            }
+            printf("%s n=%lu us=%lu/%lu/%lu/%lu h=", lt.state_name, (unsigned long)lt.count,
+                   (unsigned long)lt.min_us, (unsigned long)lt.p50_us, (unsigned long)lt.p99_us,
+                   (unsigned long)lt.max_us);
+            
+            for (int k = 0; k < I2C_LATENCY_BUCKETS; k++)
+            {
+                if (counts[k] != 0)
+                {
+                    printf("%s%d:%lu", sep, k, (unsigned long)counts[k]);
+                    sep = ",";
                 }
             }
-            sensorStep = SENSOR_STEP0;
+            printf("\r\n");
+        }
+    }
+}
+
+void I2c_ResetStats(void)
+{
+    stats_start = us_ticker_read();
+    for (int i = 0; i < num_channels; i++)
+    {
+        channels[i].acquisitions = 0;
+        channels[i].completed = 0;
+        for (int f = 0; f < I2C_NUM_FAULTS; f++) {
+            channels[i].faults[f] = 0;
+        }
+        channels[i].breaker.resetStats();
+    }
+    for (int i = 0; i < num_pairs; i++)
+    {
+        pairs[i].missed = 0;
+        pairs[i].start_skew.reset();
+        pairs[i].latch_skew.reset();
+    }
+    for (int i = 0; i < NUM_BUSES; i++)
+    {
+        stats_transfers[i] = busTransfers(i);
+        stats_slots[i] = buses[i].bus().slots();
+        bus_recoveries[i] = 0;
+        bus_recover_failed[i] = 0;
+        bus_recover_us[i] = 0;
+    }
+}
+
+void I2c_GetStats(struct i2c_stats_t &stats)
+{
+    uint32_t elapsed = us_ticker_read() - stats_start;
+    float secs = (elapsed > 0) ? (elapsed / 1e6f) : 1e-6f;
+    uint32_t samples = 0;
+    
+    stats.elapsed_us = elapsed;
+    stats.num_channels = num_channels;
+    stats.num_buses = NUM_BUSES;
+    
+    for (int i = 0; i < num_channels; i++)
+    {
+        struct channel_stats_t &cs = stats.channel[i];
+        
+        cs.acquisitions = channels[i].acquisitions;
+        cs.samples = channels[i].completed;
+        for (int f = 0; f < I2C_NUM_FAULTS; f++) {
+            cs.faults[f] = channels[i].faults[f];
+        }
+        cs.samples_per_s = cs.samples / secs;
+        cs.breaker = channels[i].breaker.state();
+        cs.failures = channels[i].breaker.failures();
+        cs.trips = channels[i].breaker.trips();
+        cs.recoveries = channels[i].breaker.recoveries();
+        cs.recovery_us = channels[i].breaker.recoveryUs();
+        cs.max_recovery_us = channels[i].breaker.maxRecoveryUs();
+        samples += cs.samples;
+    }
+    stats.samples_per_s = samples / secs;
+    
+    for (int i = 0; i < NUM_BUSES; i++)
+    {
+        struct bus_stats_t &bs = stats.bus[i];
+        int rate = buses[i].bus().bitRate();
+        
+        bs.transfers = busTransfers(i) - stats_transfers[i];
+        bs.slots = buses[i].bus().slots() - stats_slots[i];
+        bs.transfers_per_s = bs.transfers / secs;
+        bs.utilization_pct = (rate > 0) ? ((100.0f * bs.slots) / (rate * secs)) : 0.0f;
+        bs.recoveries = bus_recoveries[i];
+        bs.recover_failed = bus_recover_failed[i];
+        bs.recover_us = bus_recover_us[i];
+    }
+}
+
+// Acquisitions still in progress count in total but not as errors.
+void I2c_GetMeasStats(int &error, int &total)
+{
+    error = 0;
+    total = 0;
+    for (int i = 0; i < num_channels; i++)
+    {
+        for (int f = 0; f < I2C_NUM_FAULTS; f++) {
+            error += (int)channels[i].faults[f];
+        }
+        total += (int)channels[i].acquisitions;
+    }
+}
+
+int I2c_GetMeasDuration(void)
+{
+    return duration;
+}
+
+void I2c_SensorLoop(void)
+{
+    if (multibus)
+    {
+        sensors.loop(loop_budget, loop_unit);
+        if (!sensors.busy()) {
+            multiStep();
+        }
+        return;
+    }
+    
+    for (int i = 0; i < NUM_BUSES; i++)
+    {
+        if (!interrupt_mode) {
+            buses[i].loop(loop_budget, loop_unit);
+        }
+        if (!busBusy(i)) {
+            busStep(i);
+        }
+    }
+}
+
+// True once every channel finished an acquisition since setup.
+static bool sensorsDone(void)
+{
+    for (int i = 0; i < NUM_BUSES; i++)
+    {
+        if (bus_step[i] != SENSOR_STEP0) {
+            return false;
         }
-        break;
     }
+    for (int i = 0; i < num_channels; i++)
+    {
+        if (!channels[i].done) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void I2c_SensorSetup(void)
 {
     printf("I2C Sensor Initialization, please wait...\r\n");
     
-    sensor1.recover();
-    sensor2.recover();
+    if (num_channels == 0)
+    {
+        I2c_AddSensor(0, SENSOR_I2C_ADDR, Pos10kPa, 0);
+        I2c_AddSensor(1, SENSOR_I2C_ADDR, Pos700kPa, 0);
+        if (num_pairs == 0) {
+            I2c_AddPair(0, 1, false);
+        }
+    }
+    
+    if (sensors.buses() == 0)
+    {
+        for (int i = 0; i < NUM_BUSES; i++)
+        {
+            sensors.attach(buses[i].bus(), SENSOR_I2C_ADDR);
+            ticker.attach(buses[i]);
+        }
+    }
+    ticker.stop();
+    multibus = lockstep && !interrupt_mode;
+    
+    // Registers that only change when the driver writes them (the 0x6d
+    // configuration) are read and written once per sensor and then served
+    // from the shadows.
+    for (int i = 0; i < num_channels; i++)
+    {
+        uint8_t reg;
+        int n;
+        
+        if (SensorDrivers::shadow(channels[i].driver, reg, n))
+        {
+            buses[channels[i].bus].shadow(channels[i].addr, reg, n);
+            sensors.shadow(channels[i].bus, channels[i].addr, reg, n);
+        }
+    }
+    for (int i = 0; i < NUM_BUSES; i++) {
+        buses[i].invalidate();
+    }
+    sensors.invalidate();
     
-    sensorStep = SENSOR_STEP0;
-    sensor_error = false;
+    for (int i = 0; i < NUM_BUSES; i++)
+    {
+        buses[i].recover();
+        buses[i].bus().setSpeed(bus_speed);
+        buses[i].bus().calibrate();
+        bus_errors[i] = 0;
+    }
+    for (int i = 0; i < num_channels; i++)
+    {
+        channels[i].breaker.configure(retry_base_us, retry_max_us, retry_trip, retry_probe_us);
+        channels[i].breaker.reset();
+    }
     
-    pressure1 = 0.0;
-    pressure2 = 0.0;
+    I2c_ResetStats();
     
-    sensor_type1 = Pos10kPa;
-    sensor_type2 = Pos700kPa;
+    if (interrupt_mode) {
+        ticker.start();
+    }
     
     for(int retry = 0; retry < 10; retry++)
     {
@@ -237,16 +1052,41 @@ void I2c_SensorSetup(void)
             printf("I2C Sensor Initialization Error. Retry...\r\n");
         }
         
+        for (int i = 0; i < NUM_BUSES; i++)
+        {
+            bus_step[i] = SENSOR_STEP0;
+            bus_channel[i] = -1;
+        }
+        for (int i = 0; i < num_channels; i++)
+        {
+            channels[i].due = us_ticker_read();
+            channels[i].kpa_q16 = 0;
+            channels[i].converting = false;
+            channels[i].error = false;
+            channels[i].done = false;
+            channels[i].held = false;
+        }
+        for (int i = 0; i < num_pairs; i++)
+        {
+            pairs[i].pending[0] = false;
+            pairs[i].pending[1] = false;
+        }
+        
+        initializing = true;
         do {
             I2c_SensorLoop();
-        } while(sensorStep != SENSOR_STEP0);
+            if (interrupt_mode) {
+                sleep();
+            }
+        } while(!sensorsDone());
+        initializing = false;
         
-        if (!sensor_error) {
+        if (!I2c_SensorError()) {
             break;
         }
     }
     
-    if (sensor_error) {
+    if (I2c_SensorError()) {
         printf("I2C Sensor Initialization Failed.\r\n");
     }
     else {
@@ -254,64 +1094,157 @@ void I2c_SensorSetup(void)
     }
 }
 
-bool I2c_Read_Pressure(float &pressure)
+bool I2c_Read_Channel(int channel, float &value)
 {
-    pressure = pressure1;
+    if ((channel < 0) || (channel >= num_channels)) {
+        return false;
+    }
+    value = channels[channel].kpa_q16 * (1.0f / 65536.0f);
     return true;
 }
 
-bool I2c_Read_O2(float &pressure)
+bool I2c_Read_ChannelQ16(int channel, int32_t &kpa_q16)
 {
-    pressure = pressure2;
+    if ((channel < 0) || (channel >= num_channels)) {
+        return false;
+    }
+    kpa_q16 = channels[channel].kpa_q16;
     return true;
 }
 
-bool I2c_SensorError(void)
+int I2c_DrainChannel(int channel, struct sample_t *samples, int max)
 {
-    return sensor_error;
+    if ((channel < 0) || (channel >= num_channels) || (max <= 0)) {
+        return 0;
+    }
+    return channels[channel].samples.drain(samples, max);
 }
 
-static void convert(const enum SensorI2CType type, float &pressure)
+uint32_t I2c_GetDroppedSamples(int channel)
 {
-    // calculate the pressure in kPa
-    switch(type)
-    {
-    case Pos2k5Pa: // (2e23 / 2e12) = 2e11
-        pressure /= 2048.0;
-        break;
+    if ((channel < 0) || (channel >= num_channels)) {
+        return 0;
+    }
+    return channels[channel].samples.dropped();
+}
 
-    case Pos5kPa: // (2e23 / 2e13) = 2e10
-        pressure /= 1024.0;
-        break;
+int I2c_AddPair(int channel1, int channel2, bool sync)
+{
+    if ((num_pairs >= I2C_MAX_PAIRS) || (channel1 == channel2) ||
+        (channel1 < 0) || (channel1 >= num_channels) || (channels[channel1].pair >= 0) ||
+        (channel2 < 0) || (channel2 >= num_channels) || (channels[channel2].pair >= 0)) {
+        return -1;
+    }
+    SensorPair &p = pairs[num_pairs];
+    
+    p.channel[0] = channel1;
+    p.channel[1] = channel2;
+    p.sync = sync;
+    p.pending[0] = false;
+    p.pending[1] = false;
+    p.seq = 0;
+    p.latest.count = 0;
+    p.missed = 0;
+    channels[channel1].pair = num_pairs;
+    channels[channel2].pair = num_pairs;
+    return num_pairs++;
+}
 
-    case Pos10kPa: // (2e23 / 2e14) = 2e9
-        pressure /= 512.0;
-        break;
+bool I2c_ReadPair(int pair, struct pair_t &out)
+{
+    uint32_t seq;
+    
+    if ((pair < 0) || (pair >= num_pairs)) {
+        return false;
+    }
+    SensorPair &p = pairs[pair];
+    
+    do {
+        seq = p.seq;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        out = p.latest;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    } while ((seq & 1) || (p.seq != seq));
+    return (out.count != 0);
+}
 
-    case Pos20kPa: // (2e23 / 2e15) = 2e8
-        pressure /= 256.0;
-        break;
+bool I2c_GetPairStats(int pair, struct pair_stats_t &stats)
+{
+    if ((pair < 0) || (pair >= num_pairs)) {
+        return false;
+    }
+    SensorPair &p = pairs[pair];
+    
+    stats.missed = p.missed;
+    p.start_skew.stats(stats.start_skew);
+    p.latch_skew.stats(stats.latch_skew);
+    stats.start_skew.state = -1;
+    stats.start_skew.state_name = "start";
+    stats.latch_skew.state = -1;
+    stats.latch_skew.state_name = "latch";
+    stats.pairs = stats.start_skew.count;
+    return true;
+}
 
-    case Pos40kPa:
-        pressure /= 128.0;
-        break;
+bool I2c_SetChannelFilter(int channel, const struct filter_config_t &cfg)
+{
+    if ((channel < 0) || (channel >= num_channels)) {
+        return false;
+    }
+    SensorChannel &ch = channels[channel];
+    
+    if (!ch.filter.configure(cfg)) {
+        return false;
+    }
+    ch.filtering = (cfg.median > 1) || (cfg.average > 1) || (cfg.iir_shift > 0) || (cfg.decimate > 1);
+    ch.filtered_q16 = 0;
+    return true;
+}
 
-    case Pos100kPa:
-        pressure /= 64.0;
-        break;
+int I2c_DrainFiltered(int channel, struct sample_t *samples, int max)
+{
+    if ((channel < 0) || (channel >= num_channels) || (max <= 0)) {
+        return 0;
+    }
+    return channels[channel].filtered.drain(samples, max);
+}
 
-    case Pos200kPa:
-        pressure /= 32.0;
-        break;
+bool I2c_Read_Filtered(int channel, float &value)
+{
+    if ((channel < 0) || (channel >= num_channels)) {
+        return false;
+    }
+    value = channels[channel].filtered_q16 * (1.0f / 65536.0f);
+    return true;
+}
 
-    case Pos500kPa:
-        pressure /= 16.0;
-        break;
+bool I2c_Read_FilteredQ16(int channel, int32_t &value_q16)
+{
+    if ((channel < 0) || (channel >= num_channels)) {
+        return false;
+    }
+    value_q16 = channels[channel].filtered_q16;
+    return true;
+}
 
-    case Pos700kPa:
-    case Pos1000kPa:
-        pressure /= 8.0;
-        break;
+bool I2c_Read_Pressure(float &pressure)
+{
+    return I2c_Read_Channel(0, pressure);
+}
+
+bool I2c_Read_O2(float &pressure)
+{
+    return I2c_Read_Channel(1, pressure);
+}
+
+// Set while the last acquisition of any channel failed.
+bool I2c_SensorError(void)
+{
+    for (int i = 0; i < num_channels; i++)
+    {
+        if (channels[i].error) {
+            return true;
+        }
     }
-    pressure /= 1000.0;
+    return false;
 }
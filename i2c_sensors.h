@@ -1,6 +1,8 @@
 #ifndef _I2C_SENSORS_H_
 #define _I2C_SENSORS_H_
 
+#include <stdint.h>
+
 struct timing_t
 {
     int duration_us;
@@ -8,8 +10,279 @@ struct timing_t
     const char *state_name;
 };
 
+// Duration statistics of the loop() calls that started in one engine
+// state. p50_us and p99_us are bucket limits, accurate to a factor of 2.
+struct latency_t
+{
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    int state;
+    const char *state_name;
+};
+
+// Where a failed transfer went wrong, see HighLevelI2C::fault() and
+// MultiBusI2C::fault(). Address covers both the write and the read
+// address byte.
+enum I2cFault {
+    I2C_FAULT_NONE = -1,
+    I2C_FAULT_NACK_ADDR = 0,
+    I2C_FAULT_NACK_REG,
+    I2C_FAULT_NACK_DATA,
+    I2C_FAULT_TIMEOUT,
+    I2C_FAULT_POLL,
+    I2C_NUM_FAULTS,
+};
+
+// Retry state of a channel, see I2c_SetRetryPolicy(). Half open while
+// the probe of an open breaker runs.
+enum I2cBreakerState {
+    I2C_BREAKER_CLOSED = 0,
+    I2C_BREAKER_OPEN,
+    I2C_BREAKER_HALF_OPEN,
+};
+
+// Full-scale ranges of the 0x6d pressure sensor family.
+enum SensorI2CType {
+    Pos2k5Pa,
+    Pos5kPa,
+    Pos10kPa,
+    Pos20kPa,
+    Pos40kPa,
+    Pos100kPa,
+    Pos200kPa,
+    Pos500kPa,
+    Pos700kPa,
+    Pos1000kPa,
+};
+
+// Sensor drivers of I2c_AddSensorDriver(), see i2c_driver.h. The
+// parameter of I2C_DRIVER_6D_PRESSURE is the SensorI2CType and its
+// values are kPa; I2C_DRIVER_6D_TEMPERATURE reads the temperature of the
+// same part in degrees Celsius and takes no parameter.
+enum SensorDriver {
+    I2C_DRIVER_6D_PRESSURE = 0,
+    I2C_DRIVER_6D_TEMPERATURE,
+    I2C_NUM_DRIVERS,
+};
+
+// One finished acquisition of a channel: completion time, raw reading
+// (sign extended), the value in the unit of the driver (kPa for
+// pressure) as Q16.16 and the I2cError of the acquisition. raw and
+// kpa_q16 are 0 when status is not I2C_ERROR_NONE. start_us is when the
+// conversion was started and latch_us when its busy bit was seen clear,
+// i.e. the latest time the sensor latched the result (0 when the
+// acquisition failed before). All times are us_ticker_read().
+// PressureScale (i2c_convert.h) converts raw pressure readings in
+// batches.
+struct sample_t
+{
+    uint32_t timestamp_us;
+    int32_t raw;
+    int32_t kpa_q16;
+    int status;
+    uint32_t start_us;
+    uint32_t latch_us;
+};
+
+#define I2C_MAX_CHANNELS 8
+#define I2C_MAX_BUSES 4
+#define I2C_SAMPLE_RING_SIZE 32
+#define I2C_FILTER_MAX_TAPS 16
+#define I2C_MAX_PAIRS 4
+
+// The latest good acquisitions of a channel pair from the same cycle,
+// see I2c_ReadPair(): values as Q16.16 and the times of sample_t, index
+// 0 for the first channel of the pair. The skews are the second
+// channel's times minus the first's; count numbers the pairs.
+struct pair_t
+{
+    int32_t value_q16[2];
+    uint32_t start_us[2];
+    uint32_t latch_us[2];
+    int32_t start_skew_us;
+    int32_t latch_skew_us;
+    uint32_t count;
+};
+
+// Pairs completed and failed acquisitions of either channel (each ends
+// a cycle without a pair) since I2c_ResetStats(), and the distribution
+// of the absolute start and latch skews.
+struct pair_stats_t
+{
+    uint32_t pairs;
+    uint32_t missed;
+    struct latency_t start_skew;
+    struct latency_t latch_skew;
+};
+
+// Filter pipeline of a channel, see I2c_SetChannelFilter(): median of
+// the last median samples, moving average of the last average samples,
+// first-order IIR with gain 2^-iir_shift, then one output per decimate
+// samples. Stages at 0 or 1 (iir_shift 0) are off.
+struct filter_config_t
+{
+    int median;
+    int average;
+    int iir_shift;
+    int decimate;
+};
+
+// Counters of one channel: acquisitions started, completed without
+// error, and failed by I2cFault. breaker is the current I2cBreakerState
+// and failures the failed acquisitions in a row; trips counts the times
+// the breaker opened and recoveries the successes after failures, with
+// the time from the first of those failures of the last and the slowest.
+struct channel_stats_t
+{
+    uint32_t acquisitions;
+    uint32_t samples;
+    uint32_t faults[I2C_NUM_FAULTS];
+    float samples_per_s;
+    int breaker;
+    int failures;
+    uint32_t trips;
+    uint32_t recoveries;
+    uint32_t recovery_us;
+    uint32_t max_recovery_us;
+};
+
+// Transfers that reached the bus and bit slots clocked (START and STOP
+// included); utilization is the share of the time spent clocking them.
+// recoveries counts the automatic bus recoveries, recover_failed those
+// that left SDA or SCL held low, recover_us the duration of the last.
+struct bus_stats_t
+{
+    uint32_t transfers;
+    uint32_t slots;
+    float transfers_per_s;
+    float utilization_pct;
+    uint32_t recoveries;
+    uint32_t recover_failed;
+    uint32_t recover_us;
+};
+
+// Everything counted since I2c_ResetStats(), see I2c_GetStats().
+struct i2c_stats_t
+{
+    uint32_t elapsed_us;
+    int num_channels;
+    int num_buses;
+    float samples_per_s;
+    struct channel_stats_t channel[I2C_MAX_CHANNELS];
+    struct bus_stats_t bus[I2C_MAX_BUSES];
+};
+
 extern void I2c_SensorSetup(void);
 
+// Registers a sensor at addr on bus (0 .. I2c_GetNumBuses() - 1) and
+// returns its channel number, or -1. rate_hz is the wanted sample rate,
+// 0 samples as fast as the bus allows. The scheduler interleaves the
+// channels of each bus and runs all buses at the same time. Without
+// registrations I2c_SensorSetup() adds the two default sensors as
+// channels 0 (I2c_Read_Pressure) and 1 (I2c_Read_O2). Must be called
+// before I2c_SensorSetup().
+extern int I2c_AddSensor(int bus, int addr, enum SensorI2CType type, int rate_hz);
+
+// As I2c_AddSensor() for a sensor run by driver (SensorDriver) with the
+// driver's parameter. Sensors of different drivers may share a bus; in
+// lockstep a round only joins the buses whose jobs use the same driver.
+extern int I2c_AddSensorDriver(int bus, int addr, int driver, int param, int rate_hz);
+
+extern int I2c_GetNumChannels(void);
+
+// Conversion time of a channel in us as learned by the scheduler. The
+// result is fetched when this time has passed since the start; the
+// busy bit is only polled when the conversion takes longer.
+extern int I2c_GetConversionTime(int channel);
+
+extern int I2c_GetNumBuses(void);
+
+// Latest value of a channel in the unit of its driver (kPa for
+// pressure), as float or Q16.16.
+extern bool I2c_Read_Channel(int channel, float &value);
+
+extern bool I2c_Read_ChannelQ16(int channel, int32_t &kpa_q16);
+
+// Moves up to max queued samples of a channel, oldest first, to samples
+// and returns how many. Every channel queues up to I2C_SAMPLE_RING_SIZE
+// samples for a single consumer; newer samples are dropped (and counted)
+// while its queue is full.
+extern int I2c_DrainChannel(int channel, struct sample_t *samples, int max);
+
+extern uint32_t I2c_GetDroppedSamples(int channel);
+
+// Filters every good sample of a channel as it is acquired and queues
+// the results, in a second ring of I2C_SAMPLE_RING_SIZE, next to the raw
+// stream. The filters work on raw counts with 8 fractional bits, so
+// averaging raises the resolution of the filtered values. Setting the
+// configuration restarts the filters; all stages off (the default)
+// queues nothing. Call from the context of I2c_SensorLoop().
+extern bool I2c_SetChannelFilter(int channel, const struct filter_config_t &cfg);
+
+// Filtered counterparts of I2c_DrainChannel() and I2c_Read_Channel().
+// raw is the filtered reading rounded to counts; the value of the
+// latest output is 0 until the first one.
+extern int I2c_DrainFiltered(int channel, struct sample_t *samples, int max);
+
+extern bool I2c_Read_Filtered(int channel, float &value);
+
+extern bool I2c_Read_FilteredQ16(int channel, int32_t &value_q16);
+
+// Samples two channels as a pair and returns the pair number, or -1.
+// Every cycle pairs the latest good acquisition of each channel. With
+// sync the channel that finishes a cycle first is not started again
+// until its partner has finished too (or failed, or while the partner's
+// breaker is open), then both are due at the same time: in lockstep the
+// conversions of channels on different buses start with the same
+// transfer, and the pair runs at the rate of the slower channel.
+// Without sync both run at their own rates and the skews show how far
+// apart the paired samples are. A channel belongs to one pair at most.
+// Without registrations I2c_SensorSetup() pairs its two default
+// channels without sync as pair 0. Must be called before
+// I2c_SensorSetup().
+extern int I2c_AddPair(int channel1, int channel2, bool sync);
+
+// Copies the latest pair; false until the first one. The copy is
+// consistent even when the scheduler publishes a new pair meanwhile.
+extern bool I2c_ReadPair(int pair, struct pair_t &p);
+
+extern bool I2c_GetPairStats(int pair, struct pair_stats_t &stats);
+
+// Clock all sensor buses together (default) or independently.
+// Must be called before I2c_SensorSetup().
+extern void I2c_SetLockstep(bool enable);
+
+// Clock the buses from a timer interrupt, half an SCL period per tick;
+// I2c_SensorLoop() then only checks for completed transfers. Must be
+// called before I2c_SensorSetup().
+extern void I2c_SetInterruptMode(bool enable);
+
+// SCL frequency in Hz (see I2cSpeed), applied and calibrated by
+// I2c_SensorSetup().
+extern void I2c_SetBusSpeed(int hz);
+
+// How far I2c_SensorLoop() advances the buses per call: budget bit
+// slots (unit I2C_BUDGET_BITS, the default is 1) or budget microseconds
+// (I2C_BUDGET_US) per bus, less when a transfer completes first.
+extern void I2c_SetLoopBudget(int budget, int unit);
+
+// After a failed acquisition a channel waits base_us before it is tried
+// again, doubling with every further failure up to max_us. After
+// trip_failures failures in a row (0 never) its breaker opens and it is
+// only probed every probe_us until an acquisition succeeds. The defaults
+// are 1 ms, 64 ms, 8 and 1 s. Applied by I2c_SensorSetup().
+extern void I2c_SetRetryPolicy(int base_us, int max_us, int trip_failures, int probe_us);
+
+// A bus whose last errors acquisitions all failed is recovered (nine
+// clocks and a STOP, see LowLevelI2C::recover()) before it is used again;
+// 0 disables it. The default is 3.
+extern void I2c_SetAutoRecover(int errors);
+
+extern void I2c_GetBitRate(int &rate1, int &rate2);
+
 extern bool I2c_Read_Pressure(float &pressure);
 
 extern bool I2c_Read_O2(float &pressure);
@@ -20,8 +293,30 @@ extern bool I2c_SensorError(void);
 
 extern bool I2c_GetComTimings(struct timing_t &tm);
 
+// Loop call latency of bus per engine state, index 0 .. until it returns
+// false; with a loop budget each run of steps in one state counts. In
+// lockstep all buses report the shared engine. Collection goes
+// on while reading; I2c_ResetComTimings() clears it.
+extern bool I2c_GetComLatency(int bus, int index, struct latency_t &lt);
+
+extern void I2c_ResetComTimings(void);
+
+// Prints one line per bus and state that saw any loop calls:
+// "I2C <bus> <state> n=<count> us=<min>/<p50>/<p99>/<max> h=<bucket>:<count>,..."
+// with bus "all" in lockstep and only the non-empty buckets listed.
+extern void I2c_DumpComLatency(void);
+
+// Failed and started acquisitions of all channels since the last
+// I2c_ResetStats() (or I2c_SensorSetup()).
 extern void I2c_GetMeasStats(int &error, int &total);
 
+// Fills stats with the counters and the average rates since the last
+// I2c_ResetStats() (or I2c_SensorSetup()). The rates use us_ticker_read(),
+// so reset at least every 71 minutes.
+extern void I2c_GetStats(struct i2c_stats_t &stats);
+
+extern void I2c_ResetStats(void);
+
 extern int I2c_GetMeasDuration(void);
 
 #endif
@@ -0,0 +1,121 @@
+#include <string.h>
+#include "i2c_shadow.h"
+
+I2cShadow::I2cShadow(void)
+{
+    num_entries = 0;
+    num_hits = 0;
+}
+
+// Marks n bytes from reg of a device as cacheable. Only transfers of
+// exactly that block are served from the entry; overlapping ones update
+// it.
+bool I2cShadow::add(uint8_t addr, uint8_t reg, int n)
+{
+    if ((n <= 0) || (n > I2C_SHADOW_MAX_LEN)) {
+        return false;
+    }
+    if (find(addr, reg, n) != NULL) {
+        return true;
+    }
+    if (num_entries >= I2C_SHADOW_ENTRIES) {
+        return false;
+    }
+    Entry &e = entries[num_entries++];
+    
+    e.addr = addr;
+    e.reg = reg;
+    e.len = (uint8_t)n;
+    e.valid = false;
+    return true;
+}
+
+I2cShadow::Entry *I2cShadow::find(uint8_t addr, uint8_t reg, int n)
+{
+    for (int i = 0; i < num_entries; i++)
+    {
+        if ((entries[i].addr == addr) && (entries[i].reg == reg) && (entries[i].len == n)) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Like read() and same() but leaves the hit count alone; a NULL src only
+// asks for a valid entry.
+bool I2cShadow::cached(uint8_t addr, uint8_t reg, int n, const uint8_t *src)
+{
+    Entry *e = find(addr, reg, n);
+    
+    if ((e == NULL) || !e->valid) {
+        return false;
+    }
+    return (src == NULL) || (memcmp(e->val, src, n) == 0);
+}
+
+bool I2cShadow::read(uint8_t addr, uint8_t reg, uint8_t *dst, int n)
+{
+    Entry *e = find(addr, reg, n);
+    
+    if ((e == NULL) || !e->valid) {
+        return false;
+    }
+    memcpy(dst, e->val, n);
+    num_hits++;
+    return true;
+}
+
+bool I2cShadow::same(uint8_t addr, uint8_t reg, const uint8_t *src, int n)
+{
+    Entry *e = find(addr, reg, n);
+    
+    if ((e == NULL) || !e->valid || (memcmp(e->val, src, n) != 0)) {
+        return false;
+    }
+    num_hits++;
+    return true;
+}
+
+// Patches every entry of the device that overlaps the n bytes from reg.
+// An entry the transfer covers completely becomes valid; a partly
+// covered one keeps its other bytes and stays valid or invalid.
+void I2cShadow::update(uint8_t addr, uint8_t reg, const uint8_t *src, int n)
+{
+    for (int i = 0; i < num_entries; i++)
+    {
+        Entry &e = entries[i];
+        int first = (e.reg > reg) ? e.reg : reg;
+        int end = ((e.reg + e.len) < (reg + n)) ? (e.reg + e.len) : (reg + n);
+        
+        if ((e.addr != addr) || (first >= end)) {
+            continue;
+        }
+        memcpy(&e.val[first - e.reg], &src[first - reg], end - first);
+        if ((first == e.reg) && (end == e.reg + e.len)) {
+            e.valid = true;
+        }
+    }
+}
+
+void I2cShadow::invalidate(uint8_t addr)
+{
+    for (int i = 0; i < num_entries; i++)
+    {
+        if (entries[i].addr == addr) {
+            entries[i].valid = false;
+        }
+    }
+}
+
+void I2cShadow::invalidate(void)
+{
+    for (int i = 0; i < num_entries; i++) {
+        entries[i].valid = false;
+    }
+}
+
+// Transfers saved so far.
+uint32_t I2cShadow::hits(void)
+{
+    return num_hits;
+}
@@ -0,0 +1,44 @@
+#ifndef _I2C_SHADOW_H_
+#define _I2C_SHADOW_H_
+
+#include "mbed.h"
+
+#define I2C_SHADOW_ENTRIES 8
+#define I2C_SHADOW_MAX_LEN 4
+
+// Copy of registers that only change when we write them (configuration),
+// kept per device of one bus. Reads of a valid entry are served from the
+// copy and writes of the value it already holds are skipped. Entries are
+// filled by successful transfers (write-through), also by ones that
+// overlap them, and dropped on any error, as the device may have reset. Addresses are 8-bit (shifted)
+// device addresses as used on the wire.
+class I2cShadow
+{
+public:
+    I2cShadow(void);
+    bool add(uint8_t addr, uint8_t reg, int n);
+    bool cached(uint8_t addr, uint8_t reg, int n, const uint8_t *src = NULL);
+    bool read(uint8_t addr, uint8_t reg, uint8_t *dst, int n);
+    bool same(uint8_t addr, uint8_t reg, const uint8_t *src, int n);
+    void update(uint8_t addr, uint8_t reg, const uint8_t *src, int n);
+    void invalidate(uint8_t addr);
+    void invalidate(void);
+    uint32_t hits(void);
+
+private:
+    struct Entry {
+        uint8_t addr;
+        uint8_t reg;
+        uint8_t len;
+        bool valid;
+        uint8_t val[I2C_SHADOW_MAX_LEN];
+    };
+    
+    Entry *find(uint8_t addr, uint8_t reg, int n);
+    
+    Entry entries[I2C_SHADOW_ENTRIES];
+    int num_entries;
+    uint32_t num_hits;
+};
+
+#endif
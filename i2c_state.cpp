@@ -0,0 +1,73 @@
+#include "i2c_state.h"
+
+I2cStateTimer::I2cStateTimer(const StateName *names) : names(names)
+{
+}
+
+void I2cStateTimer::reset(void)
+{
+    for (int i = 0; i < I2C_LATENCY_STATES; i++) {
+        state_latency[i].reset();
+    }
+}
+
+void I2cStateTimer::record(int state, uint32_t us)
+{
+    state_latency[state].record(us);
+}
+
+// The state whose loop calls took longest so far.
+bool I2cStateTimer::timings(struct timing_t &tm)
+{
+    struct latency_t lt;
+    bool ok = false;
+    
+    tm.duration_us = 0;
+    tm.state = -1;
+    tm.state_name = NULL;
+    
+    for (int i = 0; latency(i, lt); i++)
+    {
+        if ((lt.count != 0) && (!ok || ((int)lt.max_us > tm.duration_us)))
+        {
+            tm.duration_us = (int)lt.max_us;
+            tm.state = lt.state;
+            tm.state_name = lt.state_name;
+            ok = true;
+        }
+    }
+    return ok;
+}
+
+// Name of a state as in names[], NULL for unknown ones.
+const char *I2cStateTimer::name(const StateName *names, int state)
+{
+    for (int i = 0; names[i].name != NULL; i++)
+    {
+        if (names[i].state == state) {
+            return names[i].name;
+        }
+    }
+    return NULL;
+}
+
+// Latency of the index-th state in names; false past the last one.
+bool I2cStateTimer::latency(int index, struct latency_t &lt)
+{
+    if ((index < 0) || (names[index].name == NULL)) {
+        return false;
+    }
+    lt.state = names[index].state;
+    lt.state_name = names[index].name;
+    state_latency[lt.state].stats(lt);
+    return true;
+}
+
+// Bucket counts of the index-th state, see LatencyHistogram::buckets().
+int I2cStateTimer::buckets(int index, uint32_t *counts)
+{
+    if ((index < 0) || (names[index].name == NULL)) {
+        return -1;
+    }
+    return state_latency[names[index].state].buckets(counts);
+}
@@ -0,0 +1,119 @@
+#ifndef _I2C_STATE_H_
+#define _I2C_STATE_H_
+
+#include "i2c_lowlevel.h"
+#include "i2c_latency.h"
+#include "i2c_trace.h"
+#include "i2c_sensors.h"
+
+// State names of a bus engine, ended by STATE_NAME_ENTRY_SENTINEL.
+struct StateName {
+    int state;
+    const char *name;
+};
+
+#define STATE_NAME_ENTRY(x) {.state = x, .name = #x}
+#define STATE_NAME_ENTRY_SENTINEL {.state = -1, .name = NULL}
+
+// Fault of a NACK to the byte sent in state, given the engine states
+// that send the register and the data bytes.
+static inline int I2c_NackFault(int state, int reg_state, int data_state)
+{
+    if (state == reg_state) {
+        return I2C_FAULT_NACK_REG;
+    }
+    if (state == data_state) {
+        return I2C_FAULT_NACK_DATA;
+    }
+    return I2C_FAULT_NACK_ADDR;
+}
+
+// Runs the loop() calls of a transaction engine and keeps their latency
+// per state, indexed like the engine's StateName table. The engine
+// provides step() (1 per bit slot clocked), busy(), i2c_state with 0 as
+// its idle state and a trace_source.
+class I2cStateTimer
+{
+public:
+    I2cStateTimer(const StateName *names);
+    void reset(void);
+    bool timings(struct timing_t &tm);
+    bool latency(int index, struct latency_t &lt);
+    int buckets(int index, uint32_t *counts);
+    static const char *name(const StateName *names, int state);
+    
+    template <class Engine>
+    bool loop(Engine &engine)
+    {
+        int old_state = engine.i2c_state;
+        
+        I2C_TRACE_EVENT(engine.trace_source, I2C_TRACE_LOOP_BEGIN, old_state);
+        timer.reset();
+        timer.start();
+        int bits = engine.step();
+        timer.stop();
+        record(old_state, timer.read_us());
+        I2C_TRACE_EVENT(engine.trace_source, I2C_TRACE_LOOP_END, bits);
+        
+        return engine.busy();
+    }
+    
+    // Steps until budget bit slots were clocked (I2C_BUDGET_BITS) or
+    // budget microseconds have passed (I2C_BUDGET_US), or until there is
+    // nothing left to clock right now: the transfer and command list are
+    // done or a DELAY command is waiting. Returns the number of bit slots
+    // clocked. The steps spent in one state up to a transition count as
+    // one sample of that state for timings().
+    template <class Engine>
+    int loop(Engine &engine, int budget, int unit)
+    {
+        int seg_state = engine.i2c_state;
+        uint32_t seg_start = 0;
+        bool seg_open = false;
+        int bits = 0;
+        
+        I2C_TRACE_EVENT(engine.trace_source, I2C_TRACE_LOOP_BEGIN, seg_state);
+        timer.reset();
+        timer.start();
+        
+        for (;;)
+        {
+            int state = engine.i2c_state;
+            
+            bits += engine.step();
+            seg_open = true;
+            if (engine.i2c_state != seg_state)
+            {
+                uint32_t now = timer.read_us();
+                
+                record(seg_state, now - seg_start);
+                seg_state = engine.i2c_state;
+                seg_start = now;
+                seg_open = false;
+            }
+            if (!engine.busy() || ((state == 0) && (engine.i2c_state == 0))) {
+                break;
+            }
+            if ((unit == I2C_BUDGET_US) ? (timer.read_us() >= budget) : (bits >= budget)) {
+                break;
+            }
+        }
+        
+        timer.stop();
+        if (seg_open) {
+            record(seg_state, timer.read_us() - seg_start);
+        }
+        I2C_TRACE_EVENT(engine.trace_source, I2C_TRACE_LOOP_END, bits);
+        
+        return bits;
+    }
+    
+private:
+    void record(int state, uint32_t us);
+    
+    const StateName *names;
+    Timer timer;
+    LatencyHistogram state_latency[I2C_LATENCY_STATES];
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "i2c_ticker.h"
+
+TickerI2C::TickerI2C(void)
+{
+    num_buses = 0;
+    period_us = 0;
+    ticking   = false;
+}
+
+int TickerI2C::attach(HighLevelI2C &bus)
+{
+    if (ticking || (num_buses >= TICKER_I2C_MAX_BUSES)) {
+        return -1;
+    }
+    engines[num_buses] = &bus;
+    pending[num_buses] = false;
+    return num_buses++;
+}
+
+int TickerI2C::buses(void)
+{
+    return num_buses;
+}
+
+// The tick is half a period of the slowest bus, rounded up to whole
+// microseconds (the us ticker resolution), so fast profiles run slower
+// than their nominal SCL frequency in this mode.
+bool TickerI2C::start(void)
+{
+    int hz = 0;
+    
+    if (ticking || (num_buses == 0)) {
+        return false;
+    }
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (!engines[i]->bus().ready()) {
+            return false;
+        }
+        if ((hz == 0) || (engines[i]->bus().speed() < hz)) {
+            hz = engines[i]->bus().speed();
+        }
+    }
+    for (int i = 0; i < num_buses; i++) {
+        engines[i]->bus().setTicked(true);
+    }
+    period_us = (500000 + hz - 1) / hz;
+    for (int i = 0; i < num_buses; i++) {
+        pending[i] = false;
+    }
+    ticking = true;
+    ticker.attach_us(callback(this, &TickerI2C::tick), period_us);
+    return true;
+}
+
+// Transfers still in flight are dropped; stop when busy() is false.
+void TickerI2C::stop(void)
+{
+    if (!ticking) {
+        return;
+    }
+    ticker.detach();
+    ticking = false;
+    for (int i = 0; i < num_buses; i++)
+    {
+        pending[i] = false;
+        engines[i]->bus().abort();
+        engines[i]->bus().setTicked(false);
+    }
+}
+
+bool TickerI2C::running(void)
+{
+    return ticking;
+}
+
+int TickerI2C::period(void)
+{
+    return period_us;
+}
+
+// Passes an engine to the interrupt. An engine with nothing queued is
+// handed back on the next tick.
+void TickerI2C::submit(int bus)
+{
+    if (ticking && (bus >= 0) && (bus < num_buses)) {
+        pending[bus] = true;
+    }
+}
+
+void TickerI2C::submit(void)
+{
+    for (int i = 0; i < num_buses; i++) {
+        submit(i);
+    }
+}
+
+bool TickerI2C::busy(void)
+{
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (pending[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TickerI2C::busy(int bus)
+{
+    return pending[bus];
+}
+
+// Interrupt handler. The application sets a pending flag only while it
+// is clear and the handler clears it only while it is set, so the flags
+// need no locking.
+void TickerI2C::tick(void)
+{
+    for (int i = 0; i < num_buses; i++)
+    {
+        if (pending[i] && !engines[i]->loop()) {
+            pending[i] = false;
+        }
+    }
+}
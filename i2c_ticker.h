@@ -0,0 +1,41 @@
+#ifndef _I2C_TICKER_H_
+#define _I2C_TICKER_H_
+
+#include "i2c_highlevel.h"
+
+#define TICKER_I2C_MAX_BUSES 4
+
+// Runs HighLevelI2C engines from a Ticker interrupt instead of the main
+// loop: every tick advances each busy bus by half an SCL period, so the
+// bus timing no longer depends on how often the application gets around
+// to it. The application queues transfers or command lists on the
+// engines while busy() is false, hands them over with submit() and then
+// only watches busy() until the interrupt is done with them. Each bus is
+// handed over on its own, so buses run independently.
+class TickerI2C
+{
+public:
+    TickerI2C(void);
+    int attach(HighLevelI2C &bus);
+    int buses(void);
+    bool start(void);
+    void stop(void);
+    bool running(void);
+    int period(void);
+    void submit(void);
+    void submit(int bus);
+    bool busy(void);
+    bool busy(int bus);
+
+private:
+    void tick(void);
+
+    HighLevelI2C *engines[TICKER_I2C_MAX_BUSES];
+    int num_buses;
+    volatile bool pending[TICKER_I2C_MAX_BUSES];
+    int period_us;
+    bool ticking;
+    Ticker ticker;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include "i2c_trace.h"
+#include "i2c_vcd.h"
+
+#if I2C_TRACE
+
+static_assert((I2C_TRACE_SIZE & (I2C_TRACE_SIZE - 1)) == 0, "I2C_TRACE_SIZE must be a power of 2");
+
+// Sources beyond this still trace but get no names.
+#define I2C_TRACE_MAX_SOURCES 16
+
+struct TraceSource {
+    const char *kind;
+    I2cStateNameFunc state_name;
+};
+
+static struct trace_event_t trace[I2C_TRACE_SIZE];
+static struct trace_event_t trace_copy[I2C_TRACE_SIZE];
+static volatile uint32_t trace_head = 0;
+static volatile bool trace_enabled = false;
+static TraceSource trace_sources[I2C_TRACE_MAX_SOURCES] = {{"mark", NULL}};
+static int num_sources = 1;
+static void (*trace_listener)(const struct trace_event_t &ev) = NULL;
+
+// Source 0 is left to I2C_TRACE_MARK().
+uint8_t I2c_TraceSource(const char *kind, I2cStateNameFunc state_name)
+{
+    if (num_sources < I2C_TRACE_MAX_SOURCES)
+    {
+        trace_sources[num_sources].kind = kind;
+        trace_sources[num_sources].state_name = state_name;
+    }
+    return (uint8_t)num_sources++;
+}
+
+int I2c_TraceNumSources(void)
+{
+    return (num_sources < I2C_TRACE_MAX_SOURCES) ? num_sources : I2C_TRACE_MAX_SOURCES;
+}
+
+const char *I2c_TraceSourceKind(uint8_t source)
+{
+    return (source < I2c_TraceNumSources()) ? trace_sources[source].kind : NULL;
+}
+
+const char *I2c_TraceStateName(uint8_t source, int state)
+{
+    if ((source >= I2c_TraceNumSources()) || (trace_sources[source].state_name == NULL)) {
+        return NULL;
+    }
+    return trace_sources[source].state_name(state);
+}
+
+void I2c_TraceListen(void (*listener)(const struct trace_event_t &ev))
+{
+    trace_listener = listener;
+}
+
+void I2c_TraceInit(void)
+{
+#ifdef DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    trace_enabled = false;
+    trace_head = 0;
+    trace_enabled = true;
+}
+
+void I2c_TraceEnable(bool enable)
+{
+    trace_enabled = enable;
+}
+
+// Only one context (the sensor loop or the ticker interrupt) runs the
+// engines, so there is a single writer and no locking.
+void I2c_TraceRecord(uint8_t source, uint8_t type, uint16_t arg)
+{
+    if (!trace_enabled) {
+        return;
+    }
+    uint32_t head = trace_head;
+    struct trace_event_t &ev = trace[head & (I2C_TRACE_SIZE - 1)];
+    
+    ev.cycles = I2c_TraceCycles();
+    ev.source = source;
+    ev.type = type;
+    ev.arg = arg;
+    trace_head = head + 1;
+    
+    if (trace_listener != NULL) {
+        trace_listener(ev);
+    }
+}
+
+int I2c_TraceRead(struct trace_event_t *events, int max)
+{
+    uint32_t head = trace_head;
+    uint32_t num = (head > I2C_TRACE_SIZE) ? I2C_TRACE_SIZE : head;
+    
+    if ((uint32_t)max < num) {
+        num = max;
+    }
+    for (uint32_t i = 0; i < num; i++) {
+        events[i] = trace[(head - num + i) & (I2C_TRACE_SIZE - 1)];
+    }
+    return (int)num;
+}
+
+// Events overwritten since I2c_TraceInit().
+uint32_t I2c_TraceDropped(void)
+{
+    return (trace_head > I2C_TRACE_SIZE) ? (trace_head - I2C_TRACE_SIZE) : 0;
+}
+
+uint32_t I2c_TraceCyclesPerUs(void)
+{
+#ifdef DWT
+    return SystemCoreClock / 1000000;
+#else
+    return 1000;
+#endif
+}
+
+void I2c_TraceDump(void)
+{
+    struct trace_event_t *events = trace_copy;
+    bool enabled = trace_enabled;
+    
+    trace_enabled = false;
+    int num = I2c_TraceRead(events, I2C_TRACE_SIZE);
+    
+    printf("I2C trace %d events, %lu dropped, %lu cycles/us\r\n", num,
+           (unsigned long)I2c_TraceDropped(), (unsigned long)I2c_TraceCyclesPerUs());
+    for (int i = 0; i < num; i++)
+    {
+        printf("%lu %u %u %u\r\n", (unsigned long)(events[i].cycles - events[0].cycles),
+               events[i].source, events[i].type, events[i].arg);
+    }
+    trace_enabled = enabled;
+}
+
+// One scope per source that has events: "<kind><source>" with sda/scl
+// wires for pin events and a state string for state events.
+int I2c_TraceVcd(FILE *out)
+{
+    struct trace_event_t *events = trace_copy;
+    static char scopes[I2C_TRACE_MAX_SOURCES][24];
+    int pins_var[I2C_TRACE_MAX_SOURCES];
+    int state_var[I2C_TRACE_MAX_SOURCES];
+    bool enabled = trace_enabled;
+    VcdWriter vcd(out);
+    
+    trace_enabled = false;
+    int num = I2c_TraceRead(events, I2C_TRACE_SIZE);
+    int sources = I2c_TraceNumSources();
+    
+    for (int src = 0; src < sources; src++)
+    {
+        bool pins = false;
+        bool states = false;
+        
+        for (int i = 0; i < num; i++)
+        {
+            if (events[i].source == src)
+            {
+                pins |= (events[i].type == I2C_TRACE_PINS);
+                states |= (events[i].type == I2C_TRACE_STATE);
+            }
+        }
+        snprintf(scopes[src], sizeof(scopes[src]), "%s%d", trace_sources[src].kind, src);
+        pins_var[src] = pins ? vcd.wire(scopes[src], "sda") : -1;
+        if (pins) {
+            vcd.wire(scopes[src], "scl");
+        }
+        state_var[src] = states ? vcd.text(scopes[src], "state") : -1;
+    }
+    vcd.header();
+    
+    uint32_t per_us = I2c_TraceCyclesPerUs();
+    uint64_t cycles = 0;
+    
+    for (int i = 0; i < num; i++)
+    {
+        const struct trace_event_t &ev = events[i];
+        
+        if (i != 0) {
+            cycles += (uint32_t)(ev.cycles - events[i - 1].cycles);
+        }
+        if (ev.source >= sources) {
+            continue;
+        }
+        uint64_t ns = (cycles * 1000) / per_us;
+        
+        if ((ev.type == I2C_TRACE_PINS) && (pins_var[ev.source] >= 0))
+        {
+            vcd.change(ns, pins_var[ev.source], ev.arg & 0x01);
+            vcd.change(ns, pins_var[ev.source] + 1, ev.arg & 0x02);
+        }
+        else if ((ev.type == I2C_TRACE_STATE) && (state_var[ev.source] >= 0)) {
+            vcd.change(ns, state_var[ev.source], I2c_TraceStateName(ev.source, ev.arg));
+        }
+    }
+    trace_enabled = enabled;
+    return num;
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef _I2C_TRACE_H_
+#define _I2C_TRACE_H_
+
+#include "mbed.h"
+
+// Event trace of the bus engines, time stamped with a cycle counter: the
+// Cortex-M DWT CYCCNT on target, CLOCK_MONOTONIC nanoseconds on the host.
+// Built with I2C_TRACE=1 only; otherwise the I2C_TRACE_* macros expand to
+// nothing and no trace code or data is linked in.
+
+enum I2cTraceType {
+    I2C_TRACE_LOOP_BEGIN = 0,   // arg: state loop() started in
+    I2C_TRACE_LOOP_END,         // arg: bit slots clocked
+    I2C_TRACE_STATE,            // arg: state entered
+    I2C_TRACE_MARK,             // arg: free, see I2C_TRACE_MARK()
+    I2C_TRACE_PINS,             // arg: bit 0 SDA, bit 1 SCL released
+};
+
+struct trace_event_t
+{
+    uint32_t cycles;
+    uint8_t source;
+    uint8_t type;
+    uint16_t arg;
+};
+
+// Events kept; older ones are overwritten. Must be a power of 2.
+#define I2C_TRACE_SIZE 512
+
+// Names the states of a source, NULL for unknown ones.
+typedef const char *(*I2cStateNameFunc)(int state);
+
+#if I2C_TRACE
+
+#ifdef DWT
+
+static inline uint32_t I2c_TraceCycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+#else
+
+#include <time.h>
+
+static inline uint32_t I2c_TraceCycles(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(((uint64_t)ts.tv_sec * 1000000000u) + ts.tv_nsec);
+}
+
+#endif
+
+extern void I2c_TraceRecord(uint8_t source, uint8_t type, uint16_t arg);
+
+// Starts the cycle counter and clears the buffer; tracing is then on.
+extern void I2c_TraceInit(void);
+
+extern void I2c_TraceEnable(bool enable);
+
+// Returns a new source number for the events of one engine. kind names
+// the engine class; state_name (NULL when it has no states) labels the
+// I2C_TRACE_STATE events.
+extern uint8_t I2c_TraceSource(const char *kind, I2cStateNameFunc state_name);
+
+extern int I2c_TraceNumSources(void);
+
+extern const char *I2c_TraceSourceKind(uint8_t source);
+
+extern const char *I2c_TraceStateName(uint8_t source, int state);
+
+// Called with every recorded event, e.g. by the host simulator to
+// annotate its own waveforms; NULL removes it.
+extern void I2c_TraceListen(void (*listener)(const struct trace_event_t &ev));
+
+// Copies up to max events, oldest first, and returns how many. Meant to
+// be called with tracing disabled.
+extern int I2c_TraceRead(struct trace_event_t *events, int max);
+
+extern uint32_t I2c_TraceDropped(void);
+
+// Counter ticks per microsecond.
+extern uint32_t I2c_TraceCyclesPerUs(void);
+
+// Prints the buffer, one "<cycles since first> <source> <type> <arg>"
+// line per event.
+extern void I2c_TraceDump(void);
+
+// Writes the buffer as a Value Change Dump: SDA/SCL as driven by every
+// LowLevelI2C and the state names of the engines, in ns. Returns the
+// number of events written.
+extern int I2c_TraceVcd(FILE *out);
+
+#define I2C_TRACE_SOURCE(var) uint8_t var
+#define I2C_TRACE_INIT_SOURCE(var, kind, state_name) ((var) = I2c_TraceSource((kind), (state_name)))
+#define I2C_TRACE_EVENT(source, type, arg) I2c_TraceRecord((source), (type), (uint16_t)(arg))
+#define I2C_TRACE_MARK(arg) I2c_TraceRecord(0, I2C_TRACE_MARK, (uint16_t)(arg))
+
+#else
+
+#define I2C_TRACE_SOURCE(var)
+#define I2C_TRACE_INIT_SOURCE(var, kind, state_name) ((void)0)
+#define I2C_TRACE_EVENT(source, type, arg) ((void)(arg))
+#define I2C_TRACE_MARK(arg) ((void)0)
+
+#endif
+
+#endif
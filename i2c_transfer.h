@@ -0,0 +1,100 @@
+#ifndef _I2C_TRANSFER_H_
+#define _I2C_TRANSFER_H_
+
+#include "i2c_command.h"
+
+// Compile-time descriptions of the register transfers of a device: the
+// register, the width in bytes and, for polls, the busy mask and retries
+// are template parameters, checked when the driver is compiled. The
+// slave address stays a runtime setting of the engine, as one driver
+// serves several devices.
+//
+// command() gives the transfer as an I2cCommand; it is constexpr, so a
+// command list built from descriptors is a constant table. issue()
+// starts the transfer on an engine (HighLevelI2C or MultiBusI2C) with
+// readBytes()/writeBytes() directly, without the bit length checks of
+// read()/write(). Reads ACK every byte but the last one.
+//
+//   typedef I2cReadTransfer<0x06, 3> DataRead;
+//   static constexpr I2cCommand fetch[] = {
+//       I2cPollTransfer<0x30, 0x08, 1000>::command(),
+//       DataRead::command(data),
+//   };
+
+template <uint8_t Reg, int Width>
+struct I2cReadTransfer
+{
+    static_assert((Width >= 1) && (Width <= 255), "transfer width out of range");
+    
+    static constexpr uint8_t reg = Reg;
+    static constexpr int width = Width;
+    
+    static constexpr I2cCommand command(uint8_t *dst)
+    {
+        return I2cCommand{I2C_CMD_READ, Reg, 0, Width, NULL, dst};
+    }
+    
+    // Without dst the engine keeps the value, see get(); up to 4 bytes.
+    template <class Engine>
+    static bool issue(Engine &engine)
+    {
+        static_assert(Width <= 4, "reads into the engine take up to 4 bytes");
+        return engine.readBytes(Reg, NULL, Width);
+    }
+    
+    template <class Engine>
+    static bool issue(Engine &engine, uint8_t *dst)
+    {
+        return engine.readBytes(Reg, dst, Width);
+    }
+};
+
+template <uint8_t Reg, int Width>
+struct I2cWriteTransfer
+{
+    static_assert((Width >= 1) && (Width <= 255), "transfer width out of range");
+    
+    static constexpr uint8_t reg = Reg;
+    static constexpr int width = Width;
+    
+    static constexpr I2cCommand command(const uint8_t *src)
+    {
+        return I2cCommand{I2C_CMD_WRITE, Reg, 0, Width, src, NULL};
+    }
+    
+    template <class Engine>
+    static bool issue(Engine &engine, const uint8_t *src)
+    {
+        return engine.writeBytes(Reg, src, Width);
+    }
+};
+
+// Re-reads the byte at Reg until (byte & Mask) == 0, at most Retries
+// times (0 = no limit). Only in command lists.
+template <uint8_t Reg, uint8_t Mask, int Retries>
+struct I2cPollTransfer
+{
+    static_assert(Mask != 0, "a poll needs busy bits");
+    static_assert(Retries >= 0, "negative poll limit");
+    
+    static constexpr uint8_t reg = Reg;
+    static constexpr uint8_t mask = Mask;
+    
+    static constexpr I2cCommand command(void)
+    {
+        return I2cCommand{I2C_CMD_POLL, Reg, Mask, Retries, NULL, NULL};
+    }
+};
+
+template <int Us>
+struct I2cDelayTransfer
+{
+    static_assert(Us >= 0, "negative delay");
+    
+    static constexpr I2cCommand command(void)
+    {
+        return I2cCommand{I2C_CMD_DELAY, 0, 0, Us, NULL, NULL};
+    }
+};
+
+#endif
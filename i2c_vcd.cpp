@@ -0,0 +1,110 @@
+#include <string.h>
+#include "i2c_vcd.h"
+
+// Identifiers are single printable characters from '!' on.
+#define VCD_ID(var) ((char)('!' + (var)))
+
+VcdWriter::VcdWriter(FILE *file) : out(file)
+{
+    num_vars = 0;
+    now_ns = 0;
+    started = false;
+}
+
+int VcdWriter::add(const char *scope, const char *name, bool text)
+{
+    if (started || (num_vars >= I2C_VCD_MAX_VARS)) {
+        return -1;
+    }
+    var[num_vars].scope = scope;
+    var[num_vars].name = name;
+    var[num_vars].text = text;
+    return num_vars++;
+}
+
+int VcdWriter::wire(const char *scope, const char *name)
+{
+    return add(scope, name, false);
+}
+
+int VcdWriter::text(const char *scope, const char *name)
+{
+    return add(scope, name, true);
+}
+
+int VcdWriter::vars(void)
+{
+    return num_vars;
+}
+
+// Declares the variables, one scope per distinct scope name in order of
+// first use. Wires start as x, strings as "-".
+void VcdWriter::header(void)
+{
+    fprintf(out, "$timescale 1 ns $end\n");
+    
+    for (int i = 0; i < num_vars; i++)
+    {
+        bool seen = false;
+        
+        for (int j = 0; j < i; j++)
+        {
+            if (strcmp(var[j].scope, var[i].scope) == 0) {
+                seen = true;
+            }
+        }
+        if (seen) {
+            continue;
+        }
+        fprintf(out, "$scope module %s $end\n", var[i].scope);
+        for (int j = i; j < num_vars; j++)
+        {
+            if (strcmp(var[j].scope, var[i].scope) == 0)
+            {
+                fprintf(out, "$var %s 1 %c %s $end\n", var[j].text ? "string" : "wire",
+                        VCD_ID(j), var[j].name);
+            }
+        }
+        fprintf(out, "$upscope $end\n");
+    }
+    fprintf(out, "$enddefinitions $end\n#0\n$dumpvars\n");
+    for (int i = 0; i < num_vars; i++)
+    {
+        if (var[i].text) {
+            fprintf(out, "s- %c\n", VCD_ID(i));
+        }
+        else {
+            fprintf(out, "x%c\n", VCD_ID(i));
+        }
+    }
+    fprintf(out, "$end\n");
+    now_ns = 0;
+    started = true;
+}
+
+void VcdWriter::time(uint64_t ns)
+{
+    if (ns > now_ns)
+    {
+        fprintf(out, "#%llu\n", (unsigned long long)ns);
+        now_ns = ns;
+    }
+}
+
+void VcdWriter::change(uint64_t ns, int v, int value)
+{
+    if (!started || (v < 0) || (v >= num_vars)) {
+        return;
+    }
+    time(ns);
+    fprintf(out, "%c%c\n", value ? '1' : '0', VCD_ID(v));
+}
+
+void VcdWriter::change(uint64_t ns, int v, const char *value)
+{
+    if (!started || (v < 0) || (v >= num_vars)) {
+        return;
+    }
+    time(ns);
+    fprintf(out, "s%s %c\n", (value != NULL) ? value : "?", VCD_ID(v));
+}
@@ -0,0 +1,41 @@
+#ifndef _I2C_VCD_H_
+#define _I2C_VCD_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define I2C_VCD_MAX_VARS 32
+
+// Minimal Value Change Dump writer (1 ns timescale) for viewing bus
+// waveforms in GTKWave. Variables are one-bit wires or strings (state
+// names) and are grouped into scopes; declare them all, then call
+// header() once and report changes in time order.
+class VcdWriter
+{
+public:
+    VcdWriter(FILE *out);
+    int wire(const char *scope, const char *name);
+    int text(const char *scope, const char *name);
+    void header(void);
+    void change(uint64_t ns, int var, int value);
+    void change(uint64_t ns, int var, const char *value);
+    int vars(void);
+
+private:
+    struct Var {
+        const char *scope;
+        const char *name;
+        bool text;
+    };
+    
+    int add(const char *scope, const char *name, bool text);
+    void time(uint64_t ns);
+    
+    FILE *out;
+    Var var[I2C_VCD_MAX_VARS];
+    int num_vars;
+    uint64_t now_ns;
+    bool started;
+};
+
+#endif